@@ -0,0 +1,835 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "background.h"
+#include "blobs.h"
+#include "calculate.h"
+#include "decode.h"
+#include "detect.h"
+#include "flight.h"
+#include "mask.h"
+#include "worker_pool.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// every heap allocation in the process comes through here, opencv's included
+// (cv::fastMalloc ends up in posix_memalign), so a benchmark can report
+// allocations per frame. needs glibc's __libc_* entry points; elsewhere the
+// count just stays at zero.
+static std::atomic<uint64_t> heap_allocations(0);
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+static inline void count_allocation() {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void* malloc(size_t size) noexcept {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept {
+    count_allocation();
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+void free(void* ptr) noexcept {
+    __libc_free(ptr);
+}
+}
+#endif
+
+struct bench_result {
+    std::string name;
+    int frames;
+    double total_ms;
+    uint64_t allocations;
+};
+
+static void print_result(const bench_result& r) {
+    double per_frame_ns = r.frames > 0 ? r.total_ms * 1e6 / r.frames : 0;
+    double allocs = r.frames > 0 ? (double)r.allocations / r.frames : 0;
+    char line[160];
+    snprintf(line, sizeof(line), "  %-40s %12.0f ns/frame %8.1f allocs/frame %10.1f fps",
+             r.name.c_str(), per_frame_ns, allocs, per_frame_ns > 0 ? 1e9 / per_frame_ns : 0);
+    std::cout << line << std::endl;
+}
+
+static bench_result run_bench(const std::string& name, int frames, const std::function<void(int)>& body) {
+    // one untimed pass to warm caches, decoder state and scratch buffers
+    body(0);
+    uint64_t allocations = heap_allocations.load(std::memory_order_relaxed);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < frames; i++) {
+        body(i);
+    }
+    bench_result r;
+    r.name = name;
+    r.frames = frames;
+    r.total_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+    r.allocations = heap_allocations.load(std::memory_order_relaxed) - allocations;
+    return r;
+}
+
+static std::vector<uint8_t> read_bytes(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// a recording is either a directory of .jpg files or a raw .mjpeg stream of
+// back to back jpegs, split on SOI/EOI markers
+static std::vector<std::vector<uint8_t>> load_mjpeg(const std::string& path) {
+    std::vector<std::vector<uint8_t>> frames;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return frames;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        std::vector<std::string> names;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return frames;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && (name.substr(name.size() - 4) == ".jpg" || name.substr(name.size() - 5) == ".jpeg")) {
+                names.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (const auto& n : names) {
+            frames.push_back(read_bytes(n));
+        }
+        return frames;
+    }
+
+    std::vector<uint8_t> stream = read_bytes(path);
+    size_t start = std::string::npos;
+    for (size_t i = 0; i + 1 < stream.size(); i++) {
+        if (stream[i] != 0xFF) continue;
+        if (stream[i + 1] == 0xD8 && start == std::string::npos) {
+            start = i;
+        } else if (stream[i + 1] == 0xD9 && start != std::string::npos) {
+            frames.push_back(std::vector<uint8_t>(stream.begin() + start, stream.begin() + i + 2));
+            start = std::string::npos;
+        }
+    }
+    return frames;
+}
+
+static int bench_decode(const std::string& path, int iterations) {
+    std::vector<std::vector<uint8_t>> frames = load_mjpeg(path);
+    if (frames.empty()) {
+        std::cerr << "no mjpeg frames in " << path << std::endl;
+        return 1;
+    }
+    int n = (int)frames.size() * iterations;
+    std::cout << "decode: " << frames.size() << " frames x " << iterations << std::endl;
+
+    // the path main.cpp used to take: full bgr decode then a gray conversion
+    cv::Mat bgr, reference;
+    print_result(run_bench("imdecode bgr + cvtColor", n, [&](int i) {
+        const std::vector<uint8_t>& f = frames[i % frames.size()];
+        bgr = cv::imdecode(cv::Mat(1, (int)f.size(), CV_8UC1, (void*)f.data()), cv::IMREAD_COLOR);
+        cv::cvtColor(bgr, reference, cv::COLOR_BGR2GRAY);
+    }));
+
+    cv::Mat gray;
+    print_result(run_bench("imdecode grayscale", n, [&](int i) {
+        const std::vector<uint8_t>& f = frames[i % frames.size()];
+        gray = cv::imdecode(cv::Mat(1, (int)f.size(), CV_8UC1, (void*)f.data()), cv::IMREAD_GRAYSCALE);
+    }));
+
+    const int scales[] = {1, 2, 4, 8};
+    for (int scale : scales) {
+        for (int fast = 0; fast < 2; fast++) {
+            mjpeg_decoder decoder(scale, fast != 0);
+            std::string name = "mjpeg_decoder 1/" + std::to_string(scale) + (fast ? " ifast" : " islow");
+            print_result(run_bench(name, n, [&](int i) {
+                const std::vector<uint8_t>& f = frames[i % frames.size()];
+                decoder.decode(f.data(), f.size(), gray);
+            }));
+        }
+    }
+
+    // luma straight from the jpeg vs. reconstructed bgr converted back to gray
+    mjpeg_decoder decoder;
+    const std::vector<uint8_t>& f = frames[0];
+    bgr = cv::imdecode(cv::Mat(1, (int)f.size(), CV_8UC1, (void*)f.data()), cv::IMREAD_COLOR);
+    cv::cvtColor(bgr, reference, cv::COLOR_BGR2GRAY);
+    if (decoder.decode(f.data(), f.size(), gray) && gray.size() == reference.size()) {
+        std::cout << "  max abs diff vs bgr path: " << cv::norm(gray, reference, cv::NORM_INF) << std::endl;
+    }
+    return 0;
+}
+
+// dim noisy frames with a few bright blobs, roughly what the cameras see
+static std::vector<cv::Mat> synthetic_frames(int width, int height, int count) {
+    std::vector<cv::Mat> frames;
+    cv::RNG rng(12345);
+    for (int i = 0; i < count; i++) {
+        cv::Mat frame(height, width, CV_8UC1);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 60);
+        for (int b = 0; b < 6; b++) {
+            cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+            cv::circle(frame, center, rng.uniform(2, 20), cv::Scalar(rng.uniform(150, 256)), -1);
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// the chain detect.cpp runs without the fused kernel
+static void opencv_mask(const cv::Mat& frame, int threshold, cv::Mat& blurred, cv::Mat& out) {
+    static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
+    cv::GaussianBlur(frame, blurred, cv::Size(9, 9), 2);
+    cv::threshold(blurred, out, threshold, 255, cv::THRESH_BINARY);
+    cv::morphologyEx(out, out, cv::MORPH_OPEN, kernel);
+    cv::morphologyEx(out, out, cv::MORPH_CLOSE, kernel);
+}
+
+// pixels where the fused mask of frame differs from the opencv chain's
+static size_t mask_mismatches(mask_builder& builder, const cv::Mat& frame, int threshold) {
+    cv::Mat blurred, expected, mask, diff;
+    opencv_mask(frame, threshold, blurred, expected);
+    builder.build(frame, threshold, mask);
+    cv::compare(mask, expected, diff, cv::CMP_NE);
+    return (size_t)cv::countNonZero(diff);
+}
+
+// the fused kernel is meant to be bit-exact with the opencv chain, so any
+// differing pixel in any isa fails the run. besides the timed frames it is
+// checked on widths that leave a simd tail and on frames small enough for
+// the fallback
+static int bench_mask(int width, int height, int iterations) {
+    const int threshold = 200;
+    std::vector<cv::Mat> frames = synthetic_frames(width, height, 16);
+    int n = (int)frames.size() * iterations;
+    std::cout << "mask: " << width << "x" << height << " x " << n << ", threshold " << threshold << std::endl;
+
+    std::vector<cv::Mat> reference(frames.size());
+    cv::Mat blurred;
+    print_result(run_bench("opencv blur/threshold/open/close", n, [&](int i) {
+        opencv_mask(frames[i % frames.size()], threshold, blurred, reference[i % frames.size()]);
+    }));
+
+    std::vector<cv::Mat> odd = synthetic_frames(std::max(9, width - 13), std::max(9, height - 5), 2);
+    const cv::Size small_sizes[] = { cv::Size(33, 9), cv::Size(9, 40), cv::Size(8, 8), cv::Size(5, 17), cv::Size(40, 3) };
+    for (const auto& size : small_sizes) {
+        std::vector<cv::Mat> small = synthetic_frames(size.width, size.height, 1);
+        odd.push_back(small[0]);
+    }
+
+    int failed = 0;
+    std::string detected = mask_kernel_isa();
+    const char* isas[] = {"scalar", "sse2", "avx2"};
+    for (const char* isa : isas) {
+        if (!force_mask_kernel_isa(isa)) {
+            continue;
+        }
+        mask_builder builder;
+        cv::Mat mask;
+        print_result(run_bench(std::string("fused ") + isa, n, [&](int i) {
+            builder.build(frames[i % frames.size()], threshold, mask);
+        }));
+
+        size_t mismatched = 0;
+        for (const auto& f : frames) {
+            mismatched += mask_mismatches(builder, f, threshold);
+        }
+        size_t odd_mismatched = 0;
+        for (const auto& f : odd) {
+            odd_mismatched += mask_mismatches(builder, f, threshold);
+        }
+        std::cout << "    pixels differing from opencv: " << mismatched << ", odd sizes " << odd_mismatched
+                  << (mismatched + odd_mismatched ? "  FAIL" : "") << std::endl;
+        if (mismatched + odd_mismatched) {
+            failed = 1;
+        }
+    }
+    force_mask_kernel_isa(detected);
+    return failed;
+}
+
+// static hot spots that stay put, the noise around them changing frame to
+// frame, and a ball that moves across
+static int bench_background(int width, int height, int iterations) {
+    const int count = 16;
+    cv::RNG rng(777);
+    cv::Mat scene(height, width, CV_8UC1, cv::Scalar(20));
+    for (int s = 0; s < 12; s++) {
+        cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+        cv::circle(scene, center, rng.uniform(6, 24), cv::Scalar(rng.uniform(220, 256)), -1);
+    }
+    std::vector<cv::Mat> quiet, shots;
+    for (int i = 0; i < count; i++) {
+        cv::Mat noise(height, width, CV_8UC1);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+        cv::Mat frame;
+        cv::add(scene, noise, frame);
+        quiet.push_back(frame.clone());
+        cv::circle(frame, cv::Point(width * (i + 1) / (count + 2), height / 2), 18, cv::Scalar(245), -1);
+        shots.push_back(frame);
+    }
+    int n = count * iterations;
+    std::cout << "background: " << width << "x" << height << " x " << n << ", 12 hot spots" << std::endl;
+
+    std::string detected = background_kernel_isa();
+    background_model reference;
+    force_background_kernel_isa("scalar");
+    for (const auto& f : quiet) {
+        reference.update(f);
+    }
+    std::vector<cv::Mat> expected(count);
+    for (int i = 0; i < count; i++) {
+        reference.subtract(shots[i], cv::Rect(0, 0, width, height), expected[i]);
+    }
+
+    const char* isas[] = {"scalar", "sse2", "avx2"};
+    for (const char* isa : isas) {
+        if (!force_background_kernel_isa(isa)) {
+            continue;
+        }
+        background_model model;
+        for (const auto& f : quiet) {
+            model.update(f);
+        }
+        cv::Mat foreground, diff;
+        size_t mismatched = 0;
+        for (int i = 0; i < count; i++) {
+            model.subtract(shots[i], cv::Rect(0, 0, width, height), foreground);
+            cv::compare(foreground, expected[i], diff, cv::CMP_NE);
+            mismatched += cv::countNonZero(diff);
+        }
+        print_result(run_bench(std::string("subtract ") + isa, n, [&](int i) {
+            model.subtract(shots[i % count], cv::Rect(0, 0, width, height), foreground);
+        }));
+        print_result(run_bench(std::string("update ") + isa, n, [&](int i) {
+            model.update(quiet[i % count]);
+        }));
+        std::cout << "    pixels differing from scalar: " << mismatched << std::endl;
+    }
+    force_background_kernel_isa(detected);
+
+    // what the contour loop is handed with and without the model
+    ball_detector detector(200, 0.7f);
+    candidate_list candidates;
+    int raw = 0, subtracted = 0, found = 0;
+    for (int i = 0; i < count; i++) {
+        frame_envelope frame;
+        frame.image = shots[i];
+        detector.set_background(nullptr);
+        detector.find_candidates(frame, candidates);
+        raw += candidates.count;
+        detector.set_background(&reference);
+        found += detector.find_candidates(frame, candidates).found;
+        subtracted += candidates.count;
+    }
+    std::cout << "  candidates per frame: " << (double)raw / count << " raw, " << (double)subtracted / count
+              << " background subtracted; ball found in " << found << "/" << count << std::endl;
+    return 0;
+}
+
+// one soft-edged ball per frame at a known sub-pixel centre
+static int bench_candidates(int iterations) {
+    const int width = 1280, height = 720, threshold = 200;
+    const int count = 64;
+    std::vector<cv::Mat> frames, masks;
+    std::vector<cv::Point2f> truth;
+    cv::RNG rng(777);
+    mask_builder builder;
+    for (int i = 0; i < count; i++) {
+        cv::Mat frame(height, width, CV_8UC1);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 40);
+        cv::Point2f c((float)rng.uniform(100.0, width - 100.0), (float)rng.uniform(100.0, height - 100.0));
+        const int shift = 4;
+        cv::circle(frame, cv::Point(cvRound(c.x * (1 << shift)), cvRound(c.y * (1 << shift))),
+                   rng.uniform(8, 24) << shift, cv::Scalar(245), -1, cv::LINE_AA, shift);
+        cv::Mat mask;
+        builder.build(frame, threshold, mask);
+        frames.push_back(frame);
+        masks.push_back(mask);
+        truth.push_back(c);
+    }
+    int n = count * iterations;
+    std::cout << "candidates: " << width << "x" << height << " x " << n << std::endl;
+
+    // best circular candidate per frame, as the detector would pick it
+    auto contour_center = [&](int i, cv::Point2f& best) {
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(masks[i % count], contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        float best_score = 0;
+        for (const auto& contour : contours) {
+            float area = cv::contourArea(contour);
+            float perimeter = cv::arcLength(contour, true);
+            float circularity = (4.0 * CV_PI * area) / (perimeter * perimeter);
+            if (circularity > 0.7f && circularity * area > best_score) {
+                float radius;
+                cv::minEnclosingCircle(contour, best, radius);
+                best_score = circularity * area;
+            }
+        }
+        return best_score > 0;
+    };
+
+    blob_extractor extractor;
+    auto blob_center = [&](int i, cv::Point2f& best) {
+        float best_score = 0;
+        for (const auto& b : extractor.extract(masks[i % count], frames[i % count])) {
+            if (b.circularity > 0.7f && b.circularity * b.area > best_score) {
+                best = b.center;
+                best_score = b.circularity * b.area;
+            }
+        }
+        return best_score > 0;
+    };
+
+    cv::Point2f center;
+    print_result(run_bench("findContours + minEnclosingCircle", n, [&](int i) { contour_center(i, center); }));
+    print_result(run_bench("components + moments", n, [&](int i) { blob_center(i, center); }));
+
+    double contour_error = 0, blob_error = 0;
+    int contour_found = 0, blob_found = 0;
+    for (int i = 0; i < count; i++) {
+        if (contour_center(i, center)) {
+            contour_error += cv::norm(center - truth[i]);
+            contour_found++;
+        }
+        if (blob_center(i, center)) {
+            blob_error += cv::norm(center - truth[i]);
+            blob_found++;
+        }
+    }
+    std::cout << "  mean centre error: contours " << (contour_found ? contour_error / contour_found : 0)
+              << " px (" << contour_found << "/" << count << "), moments "
+              << (blob_found ? blob_error / blob_found : 0) << " px (" << blob_found << "/" << count << ")" << std::endl;
+
+    // both engines are gated by the same min_circularity, so they should
+    // score the same shape the same
+    struct shape {
+        const char* name;
+        std::function<void(cv::Mat&, int)> draw;
+    };
+    const shape shapes[] = {
+        {"disc", [](cv::Mat& m, int r) { cv::circle(m, cv::Point(64, 64), r, cv::Scalar(255), -1); }},
+        {"square", [](cv::Mat& m, int r) { cv::rectangle(m, cv::Rect(64 - r, 64 - r, 2 * r, 2 * r), cv::Scalar(255), -1); }},
+        {"rect 1.5:1", [](cv::Mat& m, int r) { cv::rectangle(m, cv::Rect(64 - r, 64 - r * 2 / 3, 2 * r, r * 4 / 3), cv::Scalar(255), -1); }},
+        {"ellipse 2:1 30deg", [](cv::Mat& m, int r) { cv::ellipse(m, cv::Point(64, 64), cv::Size(r, r / 2), 30, 0, 360, cv::Scalar(255), -1); }},
+    };
+    std::cout << "  circularity, contours / components:" << std::endl;
+    for (const auto& s : shapes) {
+        std::cout << "    " << s.name;
+        for (int r : {6, 12, 24}) {
+            cv::Mat mask = cv::Mat::zeros(128, 128, CV_8UC1);
+            s.draw(mask, r);
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+            double perimeter = contours.empty() ? 0 : cv::arcLength(contours[0], true);
+            double contour = perimeter > 0 ? 4 * CV_PI * cv::contourArea(contours[0]) / (perimeter * perimeter) : 0;
+            const auto& blobs = extractor.extract(mask, cv::Mat());
+            char line[64];
+            snprintf(line, sizeof(line), "  r%d %.3f / %.3f", r, contour, blobs.empty() ? 0.0 : blobs[0].circularity);
+            std::cout << line;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// a camera frame with one ball inside `area` plus `clutter` distractors spread
+// over the whole frame: elongated club-like streaks, specks too small to pass
+// the area check and a couple of static hot spots
+struct detect_scene {
+    std::string name;
+    std::vector<cv::Mat> frames;
+    std::vector<cv::Point2f> truth;
+};
+
+static detect_scene make_scene(int ball_radius, int clutter, cv::Rect area, int count) {
+    const int width = 1280, height = 720;
+    detect_scene scene;
+    scene.name = "r" + std::to_string(ball_radius) + " clutter " + std::to_string(clutter);
+    cv::RNG rng(4242 + ball_radius * 31 + clutter);
+    for (int i = 0; i < count; i++) {
+        cv::Mat frame(height, width, CV_8UC1);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 50);
+        for (int c = 0; c < clutter; c++) {
+            cv::Point p(rng.uniform(0, width), rng.uniform(0, height));
+            switch (c % 3) {
+            case 0:
+                cv::ellipse(frame, p, cv::Size(rng.uniform(20, 60), rng.uniform(3, 8)), rng.uniform(0.0, 180.0),
+                            0, 360, cv::Scalar(rng.uniform(210, 256)), -1);
+                break;
+            case 1:
+                cv::circle(frame, p, rng.uniform(1, 3), cv::Scalar(255), -1);
+                break;
+            default:
+                // hot spots sit still from frame to frame
+                cv::RNG fixed(c);
+                cv::circle(frame, cv::Point(fixed.uniform(0, width), fixed.uniform(0, height)),
+                           fixed.uniform(4, 12), cv::Scalar(230), -1);
+                break;
+            }
+        }
+        const int shift = 4;
+        cv::Point2f c((float)rng.uniform(area.x + ball_radius + 2.0, area.x + area.width - ball_radius - 2.0),
+                      (float)rng.uniform(area.y + ball_radius + 2.0, area.y + area.height - ball_radius - 2.0));
+        cv::circle(frame, cv::Point(cvRound(c.x * (1 << shift)), cvRound(c.y * (1 << shift))),
+                   ball_radius << shift, cv::Scalar(245), -1, cv::LINE_AA, shift);
+        scene.frames.push_back(frame);
+        scene.truth.push_back(c);
+    }
+    return scene;
+}
+
+// the scoring ball_detector::detect runs over its mask, minus the debug capture
+static float score_contours(const cv::Mat& mask, float min_area, float max_area, float min_circ, cv::Point2f& best) {
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    float best_score = 0;
+    for (const auto& contour : contours) {
+        float area = cv::contourArea(contour);
+        if (area < min_area || area > max_area) {
+            continue;
+        }
+        cv::Point2f center;
+        float radius;
+        cv::minEnclosingCircle(contour, center, radius);
+        float perimeter = cv::arcLength(contour, true);
+        float circularity = (4.0 * CV_PI * area) / (perimeter * perimeter);
+        if (circularity > min_circ && circularity * area > best_score) {
+            best_score = circularity * area;
+            best = center;
+        }
+    }
+    return best_score;
+}
+
+static float score_components(blob_extractor& extractor, const cv::Mat& mask, const cv::Mat& gray,
+                              float min_area, float max_area, float min_circ, cv::Point2f& best) {
+    float best_score = 0;
+    for (const auto& b : extractor.extract(mask, gray)) {
+        if (b.area < min_area || b.area > max_area) {
+            continue;
+        }
+        if (b.circularity > min_circ && b.circularity * b.area > best_score) {
+            best_score = b.circularity * b.area;
+            best = b.center;
+        }
+    }
+    return best_score;
+}
+
+static int bench_detect(int iterations) {
+    const int count = 16;
+    const int radii[] = {6, 14, 28};
+    const int clutters[] = {0, 12, 48};
+    // where the ball is teed up; the roi runs search only this
+    const cv::Rect area(440, 210, 400, 300);
+    std::cout << "detect: 1280x720, roi " << area.width << "x" << area.height << ", "
+              << count * iterations << " frames per row" << std::endl;
+
+    for (int radius : radii) {
+        for (int clutter : clutters) {
+            detect_scene scene = make_scene(radius, clutter, area, count);
+            int n = count * iterations;
+            std::cout << " " << scene.name << std::endl;
+
+            std::vector<frame_envelope> frames;
+            for (int i = 0; i < count; i++) {
+                frames.push_back(frame_envelope(scene.frames[i], bench_clock::now(), i));
+            }
+
+            ball_detector full(200, 0.7);
+            ball_detector windowed(200, 0.7);
+            windowed.set_roi(area);
+            detection_debug debug;
+
+            print_result(run_bench("find_ball", n, [&](int i) { full.find_ball(frames[i % count]); }));
+            print_result(run_bench("find_ball roi", n, [&](int i) { windowed.find_ball(frames[i % count]); }));
+            print_result(run_bench("find_ball_debug", n, [&](int i) { full.find_ball_debug(frames[i % count], debug); }));
+            print_result(run_bench("find_ball_debug roi", n, [&](int i) {
+                windowed.find_ball_debug(frames[i % count], debug);
+            }));
+
+            // the candidate loop on its own, over masks built up front
+            mask_builder builder;
+            std::vector<cv::Mat> masks(count);
+            for (int i = 0; i < count; i++) {
+                builder.build(scene.frames[i], 200, masks[i]);
+            }
+            blob_extractor extractor;
+            cv::Point2f center;
+            print_result(run_bench("scoring: contours", n, [&](int i) {
+                score_contours(masks[i % count], 50, 5000, 0.7f, center);
+            }));
+            print_result(run_bench("scoring: components", n, [&](int i) {
+                score_components(extractor, masks[i % count], scene.frames[i % count], 50, 5000, 0.7f, center);
+            }));
+
+            int hits_full = 0, hits_roi = 0;
+            for (int i = 0; i < count; i++) {
+                ball_detection d = full.find_ball(frames[i]);
+                hits_full += d.found && cv::norm(d.position - scene.truth[i]) < 2.0;
+                d = windowed.find_ball(frames[i]);
+                hits_roi += d.found && cv::norm(d.position - scene.truth[i]) < 2.0;
+            }
+            std::cout << "  ball found within 2 px: full " << hits_full << "/" << count
+                      << ", roi " << hits_roi << "/" << count << std::endl;
+        }
+    }
+    return 0;
+}
+
+// swallows everything, so the log lines still get formatted but go nowhere
+class null_buffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static int bench_calculate(int iterations) {
+    // a 120 fps burst: ball crosses the bottom camera then the top one
+    const int per_camera = 6;
+    capture_clock::time_point t0 = capture_clock::now();
+    const std::chrono::nanoseconds period(8333333);
+    std::vector<ball_detection> top, bottom;
+    for (int i = 0; i < per_camera; i++) {
+        ball_detection d;
+        d.found = true;
+        d.radius = 14;
+        d.sequence = i;
+        d.timestamp = t0 + period * i;
+        d.position = cv::Point2f(200.0f + 150.0f * i, 500.0f - 20.0f * i);
+        bottom.push_back(d);
+        d.sequence = i + 2;
+        d.timestamp = t0 + period * (i + 2);
+        d.position = cv::Point2f(150.0f * i, 480.0f - 20.0f * i);
+        top.push_back(d);
+    }
+    int n = 10000 * iterations;
+    std::cout << "calculate: " << per_camera << "+" << per_camera << " detections x " << n << std::endl;
+
+    worker_pool pool;
+    std::shared_ptr<const carry_table> table = load_carry_table("carry_table.bin", flight_conditions(), &pool);
+    shot_calculator calc;
+    calc.set_carry_table(table);
+    shot_calculator uncached;
+    shot_data shot;
+    std::streambuf* console = std::cout.rdbuf();
+    null_buffer discard;
+
+    // calculate_shot logs every result, which is most of its cost
+    std::cout.rdbuf(&discard);
+    bench_result logged = run_bench("calculate_shot", n, [&](int) { shot = calc.calculate_shot(top, bottom); });
+    // a stream in a failed state skips formatting, leaving only the maths
+    std::cout.rdbuf(nullptr);
+    bench_result muted = run_bench("calculate_shot, log disabled", n, [&](int) { shot = calc.calculate_shot(top, bottom); });
+    // the flight model solved per shot instead of read from the table
+    int solves = std::max(1, n / 100);
+    bench_result direct = run_bench("calculate_shot, no carry table", solves, [&](int) { shot = uncached.calculate_shot(top, bottom); });
+    std::cout.rdbuf(console);
+    std::cout.clear();
+
+    volatile float carry = 0;
+    bench_result lookup = run_bench("carry_table::lookup", n, [&](int i) {
+        carry = carry + table->lookup(40.0f + i % 120, 5.0f + i % 30, 2500.0f + 10 * (i % 500)).carry_ft;
+    });
+    bench_result simulate = run_bench("simulate_flight", solves, [&](int i) {
+        carry = carry + simulate_flight(40.0f + i % 120, 5.0f + i % 30, 2500.0f + 10 * (i % 500)).carry_ft;
+    });
+
+    print_result(logged);
+    print_result(muted);
+    print_result(direct);
+    print_result(lookup);
+    print_result(simulate);
+    std::cout << "  " << shot.speed_mph << " mph, " << shot.launch_angle_deg << " deg, "
+              << shot.carry_ft << " ft carry" << std::endl;
+    return 0;
+}
+
+// what the preview costs per frame before it reaches gl: the conversions the
+// texture path used to make, the row copy into a mapped pbo it makes now, and
+// the area downscale when the view is smaller than the frame
+static int bench_convert(int iterations) {
+    const int width = 1280, height = 720;
+    std::vector<cv::Mat> frames = synthetic_frames(width, height, 8);
+    std::vector<cv::Mat> colour;
+    for (const auto& f : frames) {
+        cv::Mat bgr;
+        cv::cvtColor(f, bgr, cv::COLOR_GRAY2BGR);
+        colour.push_back(bgr);
+    }
+    int n = (int)frames.size() * iterations * 10;
+    std::cout << "convert: " << width << "x" << height << " x " << n << std::endl;
+
+    cv::Mat out;
+    print_result(run_bench("cvtColor gray -> rgb", n, [&](int i) {
+        cv::cvtColor(frames[i % frames.size()], out, cv::COLOR_GRAY2RGB);
+    }));
+    print_result(run_bench("cvtColor gray -> rgba", n, [&](int i) {
+        cv::cvtColor(frames[i % frames.size()], out, cv::COLOR_GRAY2RGBA);
+    }));
+    print_result(run_bench("cvtColor bgr -> rgb", n, [&](int i) {
+        cv::cvtColor(colour[i % colour.size()], out, cv::COLOR_BGR2RGB);
+    }));
+    print_result(run_bench("cvtColor bgr -> gray", n, [&](int i) {
+        cv::cvtColor(colour[i % colour.size()], out, cv::COLOR_BGR2GRAY);
+    }));
+
+    std::vector<uint8_t> staging((size_t)width * height);
+    print_result(run_bench("gray row copy (pbo fill)", n, [&](int i) {
+        const cv::Mat& f = frames[i % frames.size()];
+        for (int y = 0; y < f.rows; y++) {
+            memcpy(staging.data() + (size_t)y * width, f.ptr(y), width);
+        }
+    }));
+    print_result(run_bench("resize area 1/2", n, [&](int i) {
+        cv::resize(frames[i % frames.size()], out, cv::Size(width / 2, height / 2), 0, 0, cv::INTER_AREA);
+    }));
+    return 0;
+}
+
+// stacking a burst's pairs for playback, as compose_burst_frame does it and
+// with the destination kept between frames
+static int bench_burst(int iterations) {
+    const int width = 1280, height = 720, pairs = 40;
+    std::vector<cv::Mat> top = synthetic_frames(width, height, pairs);
+    std::vector<cv::Mat> bottom = synthetic_frames(width, height, pairs);
+    int n = pairs * iterations;
+    std::cout << "burst: " << pairs << " pairs of " << width << "x" << height << " x " << iterations << std::endl;
+
+    print_result(run_bench("vconcat into a new mat", n, [&](int i) {
+        cv::Mat combined;
+        cv::vconcat(top[i % pairs], bottom[i % pairs], combined);
+    }));
+    cv::Mat combined;
+    print_result(run_bench("vconcat into a reused mat", n, [&](int i) {
+        cv::vconcat(top[i % pairs], bottom[i % pairs], combined);
+    }));
+    cv::Mat stacked(height * 2, width, CV_8UC1);
+    print_result(run_bench("copyTo preallocated halves", n, [&](int i) {
+        top[i % pairs].copyTo(stacked(cv::Rect(0, 0, width, height)));
+        bottom[i % pairs].copyTo(stacked(cv::Rect(0, height, width, height)));
+    }));
+    return 0;
+}
+
+static void usage() {
+    std::cout << "usage: launch_monitor_bench <benchmark> [args]\n"
+              << "  decode <dir|file.mjpeg> [iterations]   mjpeg gray decode vs bgr decode + cvtColor\n"
+              << "  mask [width height] [iterations]       fused mask kernel vs the opencv chain, fails if they differ\n"
+              << "  background [width height] [iterations] background model update and subtract, candidates it removes\n"
+              << "  candidates [iterations]                contour vs connected-component extraction\n"
+              << "  detect [iterations]                    find_ball/find_ball_debug and scoring by ball size and clutter\n"
+              << "  calculate [iterations]                 shot_calculator::calculate_shot and the carry table\n"
+              << "  convert [iterations]                   preview colour conversion and downscale\n"
+              << "  burst [iterations]                     stacking burst pairs for playback\n"
+              << "  all [iterations]                       every synthetic benchmark above\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string which = argv[1];
+
+    if (which == "decode" && argc >= 3) {
+        int iterations = argc >= 4 ? std::max(1, atoi(argv[3])) : 1;
+        return bench_decode(argv[2], iterations);
+    }
+
+    if (which == "mask") {
+        int width = argc >= 4 ? atoi(argv[2]) : 1280;
+        int height = argc >= 4 ? atoi(argv[3]) : 720;
+        int iterations = argc >= 5 ? std::max(1, atoi(argv[4])) : 10;
+        return bench_mask(width, height, iterations);
+    }
+
+    if (which == "background") {
+        int width = argc >= 4 ? atoi(argv[2]) : 1280;
+        int height = argc >= 4 ? atoi(argv[3]) : 720;
+        int iterations = argc >= 5 ? std::max(1, atoi(argv[4])) : 10;
+        return bench_background(width, height, iterations);
+    }
+
+    if (which == "candidates") {
+        int iterations = argc >= 3 ? std::max(1, atoi(argv[2])) : 10;
+        return bench_candidates(iterations);
+    }
+
+    int iterations = argc >= 3 ? std::max(1, atoi(argv[2])) : 5;
+    if (which == "detect") {
+        return bench_detect(iterations);
+    }
+    if (which == "calculate") {
+        return bench_calculate(iterations);
+    }
+    if (which == "convert") {
+        return bench_convert(iterations);
+    }
+    if (which == "burst") {
+        return bench_burst(iterations);
+    }
+    if (which == "all") {
+        // run everything, but fail if any of them did
+        int failed = bench_mask(1280, 720, iterations);
+        failed |= bench_background(1280, 720, iterations);
+        failed |= bench_candidates(iterations);
+        failed |= bench_detect(iterations);
+        failed |= bench_calculate(iterations);
+        failed |= bench_convert(iterations);
+        failed |= bench_burst(iterations);
+        return failed;
+    }
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "engine.h"
+
+// the launch monitor with no window: cameras in, one json line per shot out,
+// on stdout and to every client connected to --listen. everything else the
+// core logs is plain text, so a consumer keeps the lines that start with '{'.
+
+static std::atomic<bool> quit(false);
+
+static void on_signal(int) {
+    quit = true;
+}
+
+static std::string shot_json(const shot_result& result, int number) {
+    std::ostringstream out;
+    const shot_data& s = result.shot;
+    out << "{\"shot\": " << number << ", \"time\": " << (long long)std::time(nullptr)
+        << ", \"valid\": " << (s.valid ? "true" : "false")
+        << ", \"speed_mph\": " << s.speed_mph << ", \"launch_angle_deg\": " << s.launch_angle_deg
+        << ", \"carry_ft\": " << s.carry_ft << ", \"total_ft\": " << s.distance_ft
+        << ", \"apex_ft\": " << s.apex_ft << ", \"descent_deg\": " << s.descent_deg << ", \"spin_rpm\": " << s.spin_rpm
+        << ", \"spin_measured\": " << (s.spin_measured ? "true" : "false")
+        << ", \"fit_points\": " << s.fit_points << ", \"fit_rms_px\": " << s.fit_rms_px
+        << ", \"gate_ms\": " << s.gate_ms;
+    if (result.burst) {
+        out << ", \"frames\": " << result.burst->frames.size()
+            << ", \"found_top\": " << result.burst->dets_top.size()
+            << ", \"found_bottom\": " << result.burst->dets_bottom.size()
+            << ", \"test\": " << (result.burst->test ? "true" : "false");
+    }
+    out << "}";
+    return out.str();
+}
+
+static int open_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        std::cerr << "cannot listen on port " << port << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// a client that can't take a line (gone, or not reading) is dropped rather
+// than allowed to stall the loop
+static void broadcast(std::vector<int>& clients, const std::string& line) {
+    for (size_t i = 0; i < clients.size();) {
+        ssize_t sent = send(clients[i], line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent != (ssize_t)line.size()) {
+            close(clients[i]);
+            clients.erase(clients.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void usage() {
+    std::cout << "usage: launch_monitor_headless [-c config] [--listen port] [--metrics file] [top_source bottom_source]\n"
+              << "  -c <file>        app config (default launch_monitor.conf, if present)\n"
+              << "  --listen <port>  also stream shots as json lines over tcp\n"
+              << "  --metrics <file> write latency histograms and frame counters there on exit\n";
+}
+
+int main(int argc, char** argv) {
+    std::string config_file = "launch_monitor.conf";
+    int port = 0;
+    std::string metrics_file;
+    std::vector<std::string> sources;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) config_file = argv[++i];
+        else if (arg == "--listen" && i + 1 < argc) port = atoi(argv[++i]);
+        else if (arg == "--metrics" && i + 1 < argc) metrics_file = argv[++i];
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else {
+            sources.push_back(arg);
+        }
+    }
+    if (!sources.empty() && sources.size() != 2) {
+        usage();
+        return 1;
+    }
+
+    app_config config;
+    struct stat st;
+    if (stat(config_file.c_str(), &st) == 0) {
+        config.load(config_file);
+    }
+    if (sources.size() == 2) {
+        config.top_source = sources[0];
+        config.bottom_source = sources[1];
+    }
+
+    int listener = -1;
+    if (port > 0) {
+        listener = open_listener(port);
+        if (listener < 0) {
+            return 1;
+        }
+        std::cout << "streaming shots on port " << port << std::endl;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    launch_engine engine(config, false);
+    if (!engine.open()) {
+        std::cerr << "cameras failed to open" << std::endl;
+        return 1;
+    }
+    engine.start();
+    engine.get_monitor().start();
+    std::cout << "monitoring " << config.top_source << " + " << config.bottom_source << std::endl;
+
+    std::vector<int> clients;
+    int shots = 0;
+    while (!quit.load()) {
+        if (listener >= 0) {
+            int client;
+            while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+                clients.push_back(client);
+            }
+        }
+
+        shot_result result;
+        if (!engine.wait_result(result, std::chrono::milliseconds(200))) {
+            continue;
+        }
+        std::string line = shot_json(result, ++shots) + "\n";
+        std::cout << line << std::flush;
+        broadcast(clients, line);
+    }
+
+    engine.stop();
+    if (!metrics_file.empty()) {
+        engine.get_metrics().dump(metrics_file);
+    }
+    for (const auto& s : engine.stats()) {
+        std::cout << s.name << ": " << s.processed << " processed, " << s.average_service_us << " us avg";
+        if (s.has_input) {
+            std::cout << ", queue max " << s.input.high_water << "/" << s.input.capacity
+                      << ", dropped " << s.input.dropped;
+        }
+        std::cout << std::endl;
+    }
+    for (int c : clients) {
+        close(c);
+    }
+    if (listener >= 0) {
+        close(listener);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// what one camera sees when nothing is happening: a running mean and variance
+// per pixel, learnt while the monitor is armed. mat seams, the tee and glints
+// off the enclosure sit in it, so subtracting it leaves only what is new in a
+// frame and the contour loop no longer has to turn them away every time.
+//
+// a pixel is foreground when it is more than `deviations` standard deviations
+// above its mean. foreground pixels keep their gray level and the rest go to
+// 0, so the detector's brightness threshold means what it always did; a slow
+// change in the light moves the mean with it instead of pushing the floor
+// over the threshold.
+//
+// update() and subtract() are single passes over the frame in the same
+// dispatched simd style as the fused mask. update() folds the model down to
+// an 8-bit floor per pixel, which is all subtract() reads.
+class background_model {
+private:
+    int width;
+    int height;
+    int learnt;                 // frames folded in since the last reset
+    float rate;                 // weight of a new frame in the running mean
+    float deviations;
+    float min_sigma;            // noise floor, so a pixel that never changed isn't infinitely sensitive
+    int warmup;                 // frames before the model is trusted
+    std::vector<float> mean;
+    std::vector<float> variance;
+    std::vector<uint8_t> floor; // saturated mean + deviations * sigma
+public:
+    background_model(float rate = 0.05f, float deviations = 3.0f, float min_sigma = 4.0f, int warmup = 8);
+
+    void reset();
+    void update(const cv::Mat& gray);
+    // window of gray (frame coordinates) with the background zeroed, into
+    // foreground; window must lie inside a frame the size the model was learnt at
+    void subtract(const cv::Mat& gray, cv::Rect window, cv::Mat& foreground) const;
+
+    bool ready() const { return learnt >= warmup; }
+    bool matches(const cv::Mat& gray) const { return gray.cols == width && gray.rows == height; }
+    int frames_learnt() const { return learnt; }
+};
+
+// as mask_kernel_isa / force_mask_kernel_isa, for the background passes
+const char* background_kernel_isa();
+bool force_background_kernel_isa(const std::string& isa);
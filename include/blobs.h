@@ -0,0 +1,41 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+struct blob {
+    int area;                   // mask pixels
+    cv::Rect bounds;
+    cv::Point2f center;         // intensity-weighted centroid
+    float radius;               // radius of the disc with the same area
+    float circularity;          // 4 pi area / perimeter^2, 1 for a disc
+};
+
+// single pass connected components (8-connected) over a binary mask. rows are
+// scanned into runs, runs touching a run on the row above are unioned, and
+// each run adds its pixels to area, binary and gray-weighted first moments and
+// the boundary crossings a perimeter is estimated from. no contours are built and all storage is reused between
+// frames, so after the first few frames extract() does not allocate.
+class blob_extractor {
+private:
+    struct run {
+        int x0, x1;             // [x0, x1)
+        int parent;
+        // binary first moments, boundary crossings for the perimeter and
+        // weighted first moments for the centre
+        double n, sx, sy;
+        double edges;
+        double w, wx, wy;
+        int min_x, max_x, min_y, max_y;
+    };
+
+    std::vector<run> runs;
+    std::vector<blob> blobs;
+
+    int find_root(int i);
+    void unite(int a, int b);
+public:
+    // mask and gray are the same size; gray may be empty for unweighted centres
+    const std::vector<blob>& extract(const cv::Mat& mask, const cv::Mat& gray);
+};
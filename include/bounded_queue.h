@@ -0,0 +1,177 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// what a full queue does with one more item. block pushes back on the
+// producer, the drop policies keep the producer moving and count the loss.
+enum class drop_policy {
+    block,
+    drop_oldest,
+    drop_newest
+};
+
+struct queue_stats {
+    size_t depth;
+    size_t capacity;
+    size_t high_water;
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t dropped;
+    double average_wait_us;     // time items sat in the queue before a pop
+
+    queue_stats() : depth(0), capacity(0), high_water(0), pushed(0), popped(0), dropped(0), average_wait_us(0) {}
+};
+
+// fixed-capacity multi-producer/multi-consumer queue between pipeline stages.
+// slots are allocated once, so steady state never touches the heap. close()
+// wakes everyone: pushes fail from then on and pops drain what is left.
+template <typename T>
+class bounded_queue {
+private:
+    struct entry {
+        T item;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    std::vector<entry> slots;
+    size_t head;                // next pop
+    size_t count;
+    drop_policy policy;
+    bool closed;
+    mutable std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t dropped;
+    size_t high_water;
+    double wait_us_total;
+
+    void take(T& item) {
+        entry& e = slots[head];
+        item = std::move(e.item);
+        e.item = T();
+        wait_us_total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - e.queued).count();
+        head = (head + 1) % slots.size();
+        count--;
+        popped++;
+    }
+public:
+    bounded_queue(size_t capacity, drop_policy policy = drop_policy::block)
+        : slots(capacity > 0 ? capacity : 1)
+        , head(0)
+        , count(0)
+        , policy(policy)
+        , closed(false)
+        , pushed(0)
+        , popped(0)
+        , dropped(0)
+        , high_water(0)
+        , wait_us_total(0)
+    {}
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    // false when the queue is closed or the item was the one dropped
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (policy == drop_policy::block) {
+            not_full.wait(guard, [this]() { return closed || count < slots.size(); });
+        }
+        if (closed) {
+            return false;
+        }
+        if (count == slots.size()) {
+            dropped++;
+            if (policy == drop_policy::drop_newest) {
+                return false;
+            }
+            slots[head].item = T();
+            head = (head + 1) % slots.size();
+            count--;
+        }
+        entry& e = slots[(head + count) % slots.size()];
+        e.item = std::move(item);
+        e.queued = std::chrono::steady_clock::now();
+        count++;
+        pushed++;
+        if (count > high_water) {
+            high_water = count;
+        }
+        guard.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    // blocks until there is an item; false once closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [this]() { return closed || count > 0; });
+        if (count == 0) {
+            return false;
+        }
+        take(item);
+        guard.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    bool pop_for(T& item, std::chrono::microseconds timeout) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (!not_empty.wait_for(guard, timeout, [this]() { return closed || count > 0; }) || count == 0) {
+            return false;
+        }
+        take(item);
+        guard.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (count == 0) {
+            return false;
+        }
+        take(item);
+        guard.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    bool is_closed() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return closed;
+    }
+    size_t depth() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return count;
+    }
+
+    queue_stats stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        queue_stats s;
+        s.depth = count;
+        s.capacity = slots.size();
+        s.high_water = high_water;
+        s.pushed = pushed;
+        s.popped = popped;
+        s.dropped = dropped;
+        s.average_wait_us = popped ? wait_us_total / popped : 0;
+        return s;
+    }
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "detect.h"
+#include "flight.h"
+#include "spin.h"
+#include <memory>
 #include <vector>
 
 struct shot_data {
@@ -9,32 +12,95 @@ struct shot_data {
     float distance_ft;
     float carry_ft;
     bool valid;
-    
-    shot_data() : speed_mph(0), launch_angle_deg(0), distance_ft(0), carry_ft(0), valid(false) {}
+    float apex_ft;
+    float descent_deg;
+    float spin_rpm;             // what the carry was computed with
+    bool spin_measured;         // false when that's the configured default
+    float spin_confidence;
+
+    // how well the trajectory fit the detections it was solved from
+    int fit_points;
+    float fit_rms_px;
+    float fit_max_px;
+    float gate_ms;              // time to cover distance_between_inches, from the fit
+
+    shot_data()
+        : speed_mph(0), launch_angle_deg(0), distance_ft(0), carry_ft(0), valid(false)
+        , apex_ft(0), descent_deg(0), spin_rpm(0), spin_measured(false), spin_confidence(0)
+        , fit_points(0), fit_rms_px(0), fit_max_px(0), gate_ms(0)
+    {}
 };
 struct camera_calibration {
     float distance_between_inches;
     float pixels_per_inch;        
     float frame_rate;               
+    float tee_column;           // bottom camera column of the ball at rest; the top
+                                // camera's same column is distance_between_inches on
     camera_calibration() 
         : distance_between_inches(5.0f)
         , pixels_per_inch(720.0f / 10.0f)
         , frame_rate(120.0f)
+        , tee_column(640.0f)
     {}
 };
+
+// one detection in rig inches: x downrange from the tee, z up with gravity
+// taken out, t seconds after the earliest detection
+struct trajectory_point {
+    double t;
+    double x;
+    double z;
+    double weight;
+};
+
+// x(t) = x0 + vx t and z(t) = z0 + vz t, where z is height plus g t^2 / 2,
+// so gravity is known and both axes are straight-line weighted fits
+struct trajectory_fit {
+    double x0, vx;
+    double z0, vz;
+    bool ok;
+    trajectory_fit() : x0(0), vx(0), z0(0), vz(0), ok(false) {}
+};
+// solves a shot from every detection of both cameras instead of one frame of
+// each: the detections become points on a single ballistic trajectory, the
+// trajectory is fitted by weighted least squares (circularity and radius
+// agreement, then huber passes against outliers), launch is read off the fit
+// where it leaves the tee, and the gate crossing time is interpolated. timing is no longer quantised to
+// frame periods and no single noisy detection decides the result.
 class shot_calculator {
 private:
     camera_calibration calibration;
+    // carry comes from the table when there is one, else straight from the
+    // flight model
+    std::shared_ptr<const carry_table> carry;
+    flight_conditions conditions;
+    float default_spin_rpm;
     double time_between(const ball_detection& first, const ball_detection& last);
     float pixel_distance(const cv::Point2f& p1, const cv::Point2f& p2);
+    // which way downrange runs in image x, from how the ball moved in each camera
+    float image_direction(const std::vector<ball_detection>& top_camera,
+                          const std::vector<ball_detection>& bottom_camera);
+    std::vector<trajectory_point> to_rig(const std::vector<ball_detection>& top_camera,
+                                         const std::vector<ball_detection>& bottom_camera,
+                                         float direction, capture_clock::time_point origin);
 public:
     shot_calculator();
     shot_calculator(const camera_calibration& cal);
+    // spin, when it was measured, replaces the default for the carry
     shot_data calculate_shot(
         const std::vector<ball_detection>& top_camera,
-        const std::vector<ball_detection>& bottom_camera
+        const std::vector<ball_detection>& bottom_camera,
+        const spin_estimate* spin = nullptr
     );
     void set_camera_distance(float inches);
     void set_pixels_per_inch(float ppi);
+    void set_tee_column(float column);
     void set_frame_rate(float fps);
-};
\ No newline at end of file
+    void set_carry_table(std::shared_ptr<const carry_table> table);
+    void set_conditions(const flight_conditions& conditions) { this->conditions = conditions; }
+    // used until spin is measured
+    void set_default_spin(float rpm) { default_spin_rpm = rpm; }
+    const camera_calibration& get_calibration() const { return calibration; }
+};
+
+trajectory_fit fit_trajectory(const std::vector<trajectory_point>& points);
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decode.h"
+#include "frame.h"
+#include "frame_pool.h"
+#include "metrics.h"
+#include "ring.h"
+
+struct capture_settings {
+    int width;
+    int height;
+    int fps;
+    int buffer_count;
+    int pool_frames;
+    bool realtime;
+
+    // the pool has to cover the capture ring, the pre-trigger buffer and a
+    // full burst held by the consumer at the same time
+    capture_settings()
+        : width(1280)
+        , height(720)
+        , fps(120)
+        , buffer_count(8)
+        , pool_frames(96)
+        , realtime(true)
+    {}
+};
+
+// where frames come from. read() blocks until the next frame or a short
+// timeout and must only be called from one thread.
+class capture_source {
+public:
+    virtual ~capture_source() {}
+    virtual bool open() = 0;
+    virtual bool read(frame_envelope& frame) = 0;
+    virtual bool is_open() const = 0;
+    virtual uint64_t dropped() const { return 0; }
+    virtual std::string describe() const = 0;
+    // false when timestamps are a simulated clock rather than the moment the
+    // frame was acquired, so they can't be compared with capture_clock::now()
+    virtual bool is_live() const { return true; }
+};
+
+// cv::VideoCapture on a v4l2 index. copies every frame and only exposes a
+// millisecond timestamp, kept as a fallback. mjpeg is passed through
+// undecoded when the backend allows it.
+class opencv_source : public capture_source {
+private:
+    int device;
+    capture_settings settings;
+    cv::VideoCapture cap;
+    uint64_t next_sequence;
+
+    capture_clock::time_point buffer_timestamp();
+public:
+    opencv_source(int device, const capture_settings& settings = capture_settings());
+    bool open() override;
+    bool read(frame_envelope& frame) override;
+    bool is_open() const override { return cap.isOpened(); }
+    std::string describe() const override;
+};
+
+struct v4l2_stream;
+
+// native v4l2 streaming with mmap'd driver buffers. frames are cv::Mat headers
+// over driver memory and the buffer is requeued when the last copy of the
+// envelope lease goes away, so hold on to frames only as long as needed.
+class v4l2_source : public capture_source {
+private:
+    std::string device;
+    capture_settings settings;
+    std::shared_ptr<v4l2_stream> stream;
+    bool have_sequence;
+    uint64_t last_sequence;
+    std::atomic<uint64_t> dropped_frames;
+public:
+    v4l2_source(const std::string& device, const capture_settings& settings = capture_settings());
+    ~v4l2_source();
+    bool open() override;
+    bool read(frame_envelope& frame) override;
+    bool is_open() const override;
+    uint64_t dropped() const override { return dropped_frames.load(); }
+    std::string describe() const override { return device; }
+};
+
+// a directory of images or a video file played back as a camera. timestamps
+// are synthesised from the frame rate; with realtime off frames come out as
+// fast as they can be loaded.
+class file_source : public capture_source {
+private:
+    std::string path;
+    capture_settings settings;
+    std::vector<std::string> files;
+    cv::VideoCapture video;
+    bool loop;
+    bool opened;
+    size_t index;
+    uint64_t next_sequence;
+    capture_clock::time_point start_time;
+public:
+    file_source(const std::string& path, const capture_settings& settings = capture_settings(), bool loop = true);
+    bool open() override;
+    bool read(frame_envelope& frame) override;
+    bool is_open() const override { return opened; }
+    std::string describe() const override { return path; }
+    bool is_live() const override { return false; }
+    size_t frame_count() const;
+};
+
+// "/dev/videoN" -> v4l2_source, "opencv:N" -> opencv_source, "synthetic:top"
+// or "synthetic:bottom" -> a generated scene, anything else is treated as a
+// file or directory
+std::unique_ptr<capture_source> make_capture_source(const std::string& spec, const capture_settings& settings = capture_settings());
+
+// decodes or converts a frame to 8-bit gray in place, into a buffer from the
+// pool. frames backed by driver memory are copied out so the driver buffer can
+// be requeued right away; gray frames that already own their memory pass
+// through.
+bool convert_to_gray(frame_envelope& frame, mjpeg_decoder& decoder, frame_pool& pool);
+
+// one thread per camera draining the source at sensor rate into an spsc ring.
+// the ui thread is the only consumer.
+class camera_capture {
+private:
+    static const size_t ring_size = 32;
+
+    std::string name;
+    std::unique_ptr<capture_source> source;
+    int pool_frames;
+    frame_pool pool;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> frames_captured;
+    std::atomic<uint64_t> frames_dropped;
+    mjpeg_decoder decoder;
+    spsc_ring<frame_envelope, ring_size> ring;
+
+    // optional, owned by whoever called set_metrics
+    latency_histogram* interval_time;
+    latency_histogram* decode_time;
+    metric_counter* lost_count;
+    metric_counter* duplicate_count;
+    metric_counter* ring_full_count;
+    bool have_last;
+    uint64_t last_sequence;
+    capture_clock::time_point last_timestamp;
+
+    void run();
+    void account(const frame_envelope& frame);
+public:
+    camera_capture(const std::string& name, std::unique_ptr<capture_source> source, int pool_frames = capture_settings().pool_frames);
+    ~camera_capture();
+    camera_capture(const camera_capture&) = delete;
+    camera_capture& operator=(const camera_capture&) = delete;
+
+    bool open();
+    // "<name>.capture_interval", ".decode", ".lost", ".duplicate", ".ring_full";
+    // call before start()
+    void set_metrics(metrics_registry& registry);
+    void start();
+    void stop();
+    bool pop(frame_envelope& frame);
+    size_t pending() const { return ring.size(); }
+    bool is_open() const { return source && source->is_open(); }
+    bool is_live() const { return source && source->is_live(); }
+    bool is_running() const { return running.load(); }
+    uint64_t captured() const { return frames_captured.load(); }
+    uint64_t dropped() const { return frames_dropped.load() + (source ? source->dropped() : 0); }
+    const frame_pool& frames() const { return pool; }
+};
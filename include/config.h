@@ -27,13 +27,31 @@ struct app_config {
     bool flip_top;
     bool flip_bottom;
     bool swap;
+    std::string top_source;
+    std::string bottom_source;
     detector_config top_detector;
     detector_config bottom_detector;
+    bool record_shots;
+    std::string recording_dir;
+    std::string carry_table;
+    float air_density;
+    float default_spin_rpm;
+    bool background_model;
+    float tee_column;           // bottom camera pixel column of the ball on the tee
 
     app_config()
         : flip_top(true)
         , flip_bottom(false)
         , swap(false)
+        , top_source("/dev/video0")
+        , bottom_source("/dev/video2")
+        , record_shots(true)
+        , recording_dir("shots")
+        , carry_table("carry_table.bin")
+        , air_density(1.204f)
+        , default_spin_rpm(3000.0f)
+        , background_model(true)
+        , tee_column(640.0f)
     {}
 
     bool save(const std::string& filename) {
@@ -47,6 +65,15 @@ struct app_config {
         file << "flip_top=" << flip_top << "\n";
         file << "flip_bottom=" << flip_bottom << "\n";
         file << "swap=" << swap << "\n";
+        file << "top_source=" << top_source << "\n";
+        file << "bottom_source=" << bottom_source << "\n";
+        file << "record_shots=" << record_shots << "\n";
+        file << "recording_dir=" << recording_dir << "\n";
+        file << "carry_table=" << carry_table << "\n";
+        file << "air_density=" << air_density << "\n";
+        file << "default_spin_rpm=" << default_spin_rpm << "\n";
+        file << "background_model=" << background_model << "\n";
+        file << "tee_column=" << tee_column << "\n";
 
         file << "\n# Top Camera\n";
         file << "top_threshold=" << top_detector.threshold << "\n";
@@ -95,6 +122,15 @@ struct app_config {
             if (key == "flip_top") flip_top = (value == "1");
             else if (key == "flip_bottom") flip_bottom = (value == "1");
             else if (key == "swap") swap = (value == "1");
+            else if (key == "top_source") top_source = value;
+            else if (key == "bottom_source") bottom_source = value;
+            else if (key == "record_shots") record_shots = (value == "1");
+            else if (key == "recording_dir") recording_dir = value;
+            else if (key == "carry_table") carry_table = value;
+            else if (key == "air_density") air_density = std::stof(value);
+            else if (key == "default_spin_rpm") default_spin_rpm = std::stof(value);
+            else if (key == "background_model") background_model = (value == "1");
+            else if (key == "tee_column") tee_column = std::stof(value);
 
             else if (key == "top_threshold") top_detector.threshold = std::stoi(value);
             else if (key == "top_circularity") top_detector.circularity = std::stof(value);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct mjpeg_decoder_state;
+
+// decodes mjpeg frames straight to 8-bit luma. only the y plane goes through
+// the idct and no colour conversion or upsampling runs, so a 4:2:2 camera
+// frame costs roughly a third of a full bgr decode. scale 2/4/8 downsamples
+// in the dct domain for paths that don't need full resolution.
+//
+// keeps the libjpeg decompressor alive between frames, one per thread.
+class mjpeg_decoder {
+private:
+    std::unique_ptr<mjpeg_decoder_state> state;
+    int scale_denom;
+    bool fast_idct;
+public:
+    mjpeg_decoder(int scale_denom = 1, bool fast_idct = false);
+    ~mjpeg_decoder();
+    mjpeg_decoder(const mjpeg_decoder&) = delete;
+    mjpeg_decoder& operator=(const mjpeg_decoder&) = delete;
+
+    bool decode(const uint8_t* data, size_t size, cv::Mat& gray);
+    bool decode(const cv::Mat& encoded, cv::Mat& gray);
+    void set_scale(int denom);
+    void set_fast_idct(bool fast) { fast_idct = fast; }
+    int get_scale() const { return scale_denom; }
+};
@@ -2,14 +2,44 @@
 
 #include <opencv2/opencv.hpp>
 #include <chrono>
+#include <cstdint>
 #include <vector>
+#include "background.h"
+#include "frame.h"
 
 struct ball_detection {
     cv::Point2f position;
     float radius;
-    std::chrono::high_resolution_clock::time_point timestamp;
+    float circularity;      // of the winning candidate, 1 is a perfect disc
+    capture_clock::time_point timestamp;
+    uint64_t sequence;
     bool found;
-    ball_detection() : position(0, 0), radius(0), found(false) {}
+    ball_detection() : position(0, 0), radius(0), circularity(0), sequence(0), found(false) {}
+};
+
+// one blob that passed the area and circularity checks, in frame coordinates
+struct ball_candidate {
+    cv::Point2f position;
+    float radius;
+    float circularity;
+    float area;
+    float score;            // circularity * area, what find_ball ranks by
+};
+
+// the best few candidates of one frame, held inline so filling one never
+// allocates. offer() keeps them best first and drops the weakest once full.
+struct candidate_list {
+    static const int capacity = 8;
+    ball_candidate items[capacity];
+    int count;
+    capture_clock::time_point timestamp;
+    uint64_t sequence;
+
+    candidate_list() : count(0), sequence(0) {}
+    void clear() { count = 0; }
+    void offer(const ball_candidate& candidate);
+    // candidate index as a detection; 0 is what find_ball returns
+    ball_detection detection(int index = 0) const;
 };
 
 struct contour_info {
@@ -32,6 +62,30 @@ struct detection_debug {
     detection_debug() : contours_found(0), contours_passed_area(0), contours_passed_circularity(0), max_brightness(0) {}
 };
 
+// compile-time instrumentation for ball_detector::detect. no_debug builds the
+// bare pipeline with every capture compiled out; capture_debug records the
+// masks and every candidate into a detection_debug. used through
+// find_ball_debug it only runs on one call in `every`, so a diagnostics view
+// costs a fraction of a detection per frame instead of a second full pass.
+struct no_debug {
+    static constexpr bool enabled = false;
+};
+
+struct capture_debug {
+    static constexpr bool enabled = true;
+    detection_debug* debug;
+    int every;
+    uint64_t calls;
+    capture_debug(detection_debug& debug, int every = 1) : debug(&debug), every(every), calls(0) {}
+    bool sample() { return every <= 1 || calls++ % every == 0; }
+};
+
+// how candidates are pulled out of the mask: contours with minEnclosingCircle
+// and perimeter circularity, or labelled blobs with moment centroids
+enum class candidate_engine { contours, components };
+
+void draw_detection(cv::Mat& image, const ball_detection& detection, cv::Point2f offset = cv::Point2f(0, 0));
+
 class ball_detector {
 private:
     int brightness_threshold;
@@ -40,21 +94,44 @@ private:
     float max_area;
     cv::Rect roi;
     bool use_roi;
+    bool fused_mask;
+    candidate_engine engine;
+    const background_model* background;     // not owned; subtracted before thresholding once ready
 public:
     ball_detector(int threshold = 200, float min_circ = 0.7);
-    ball_detection find_ball(const cv::Mat& frame);
-    ball_detection find_ball_visual(cv::Mat& frame);
-    ball_detection find_ball_debug(const cv::Mat& frame, detection_debug& debug);
+    // the one detection pipeline; instantiated for no_debug and capture_debug
+    template <typename policy>
+    ball_detection detect(const frame_envelope& frame, cv::Rect window, policy& instrument,
+                          candidate_list* candidates = nullptr);
+    ball_detection find_ball(const frame_envelope& frame);
+    // search only inside window (frame coordinates), e.g. a tracker's gate
+    ball_detection find_ball(const frame_envelope& frame, cv::Rect window);
+    // every passing blob, not just the winner, for a tracker to choose from;
+    // returns the winner as find_ball would
+    ball_detection find_candidates(const frame_envelope& frame, candidate_list& candidates,
+                                   cv::Rect window = cv::Rect());
+    ball_detection find_ball_visual(frame_envelope& frame);
+    ball_detection find_ball_debug(const frame_envelope& frame, detection_debug& debug);
+    // runs only when the sampler is due; returns whether it did
+    bool find_ball_debug(const frame_envelope& frame, capture_debug& sampler, ball_detection* result = nullptr);
     void set_threshold(int threshold);
     void set_circularity(float min_circ);
     void set_min_area(float area);
     void set_max_area(float area);
     void set_roi(cv::Rect rect);
     void disable_roi();
+    void set_fused_mask(bool enabled);
+    void set_engine(candidate_engine e);
+    // the caller keeps the model alive and doesn't update it while this
+    // detector runs; nullptr goes back to raw frames
+    void set_background(const background_model* model);
     int get_threshold() const { return brightness_threshold; }
     float get_circularity() const { return min_circularity; }
     float get_min_area() const { return min_area; }
     float get_max_area() const { return max_area; }
     cv::Rect get_roi() const { return roi; }
     bool is_using_roi() const { return use_roi; }
+    bool is_using_fused_mask() const { return fused_mask; }
+    candidate_engine get_engine() const { return engine; }
+    const background_model* get_background() const { return background; }
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bounded_queue.h"
+#include "calculate.h"
+#include "capture.h"
+#include "config.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "recording.h"
+#include "shot_monitor.h"
+#include "spin.h"
+#include "worker_pool.h"
+
+// a solved burst on its way to whoever shows or sends it
+struct shot_result {
+    shot_data shot;
+    std::shared_ptr<const burst_capture> burst;
+};
+
+void apply_detector_config(ball_detector& detector, const detector_config& config);
+
+// everything between the cameras and a solved shot, with no ui in it: the two
+// capture threads and the ingest -> monitor -> solve (-> record) pipeline. a
+// front end only starts it, feeds it settings and takes results off the end;
+// the gui also takes preview frames, a headless build never asks for them.
+class launch_engine {
+private:
+    app_config config;
+    bool preview;
+    std::atomic<bool> flip_top;
+    std::atomic<bool> flip_bottom;
+    std::atomic<bool> swap;
+    std::atomic<bool> record_shots;
+
+    // declared ahead of everything that reports into it
+    metrics_registry metrics;
+    latency_histogram& trigger_to_result;
+    latency_histogram& spin_time;
+
+    worker_pool pool;
+    camera_capture cam_top;
+    camera_capture cam_bottom;
+    shot_calculator calc;
+    spin_estimator spinner;
+
+    // monitor and solve block when full so no burst frame is lost; the preview
+    // only needs the newest pair; disk is the one stage allowed to fall
+    // behind, a shot it can't take is skipped
+    bounded_queue<frame_pair> monitor_frames;
+    bounded_queue<frame_pair> preview_frames;
+    bounded_queue<burst_capture> bursts;
+    bounded_queue<shot_result> results;
+    bounded_queue<shot_record> recordings;
+
+    shot_monitor monitor;
+    pipeline pipe;
+    pipeline_stage* render;
+    pipeline_stage* present;
+    bool running;
+
+    bool ingest();
+    void solve(burst_capture& burst);
+public:
+    // preview = false leaves the preview queue out of the pipeline entirely
+    launch_engine(const app_config& config, bool preview = true);
+    ~launch_engine();
+    launch_engine(const launch_engine&) = delete;
+    launch_engine& operator=(const launch_engine&) = delete;
+
+    // opens both cameras; false if either failed
+    bool open();
+    void start();
+    // closes the pipeline's queues, so an engine is not restarted after this
+    void stop();
+    bool is_running() const { return running; }
+
+    // newest preview pair, dropping anything older; false if nothing new
+    bool latest_preview(frame_pair& pair);
+    bool poll_result(shot_result& result);
+    bool wait_result(shot_result& result, std::chrono::milliseconds timeout);
+
+    void set_flip(bool top, bool bottom) { flip_top = top; flip_bottom = bottom; }
+    void set_swap(bool enabled) { swap = enabled; }
+    void set_record_shots(bool enabled) { record_shots = enabled; }
+
+    shot_monitor& get_monitor() { return monitor; }
+    // capture, decode and detect per camera and trigger-to-result come from
+    // the engine; front ends add their own (texture upload, frame time)
+    metrics_registry& get_metrics() { return metrics; }
+    worker_pool& get_pool() { return pool; }
+    const camera_capture& top_camera() const { return cam_top; }
+    const camera_capture& bottom_camera() const { return cam_bottom; }
+    const std::string& recording_dir() const { return config.recording_dir; }
+    // for front ends doing the render/present work on their own thread
+    pipeline_stage& render_stage() { return *render; }
+    pipeline_stage& present_stage() { return *present; }
+    std::vector<stage_stats> stats() const { return pipe.stats(); }
+};
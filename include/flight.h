@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class worker_pool;
+
+// ball flight with air: drag and magnus lift from speed and spin, integrated
+// until the ball comes back down to launch height, then a simple bounce and
+// roll. this is what turns a launch into carry; the vacuum formula it
+// replaces has no drag and overstates carry by half or more.
+
+struct flight_conditions {
+    float air_density;          // kg/m^3, 1.204 at sea level and 20 C
+    float rolling_friction;     // deceleration of a rolling ball, as a share of g
+
+    flight_conditions()
+        : air_density(1.204f)
+        , rolling_friction(0.12f)
+    {}
+};
+
+struct flight_result {
+    float carry_ft;
+    float total_ft;
+    float apex_ft;
+    float descent_deg;          // below horizontal, when the ball lands
+    float flight_s;
+
+    flight_result() : carry_ft(0), total_ft(0), apex_ft(0), descent_deg(0), flight_s(0) {}
+};
+
+// the full integration, a few hundred microseconds. negative launch angles and
+// spin count as 0, the same as carry_table's edges
+flight_result simulate_flight(float speed_mph, float launch_angle_deg, float spin_rpm,
+                              const flight_conditions& conditions = flight_conditions());
+
+// simulate_flight sampled over a speed x angle x spin grid and read back by
+// trilinear interpolation, so a shot costs a lookup instead of an ode solve.
+// building takes a second or two across the pool, so it's cached on disk and
+// rebuilt only when the grid or the conditions change.
+class carry_table {
+public:
+    struct axis {
+        float first;
+        float step;
+        int count;
+        float last() const { return first + step * (count - 1); }
+    };
+private:
+    axis speed;                 // mph
+    axis angle;                 // deg
+    axis spin;                  // rpm
+    flight_conditions conditions;
+    std::vector<flight_result> entries;
+
+    size_t index(int s, int a, int r) const { return ((size_t)s * angle.count + a) * spin.count + r; }
+public:
+    carry_table();
+
+    // fills every entry; with a pool the speed slices run in parallel
+    void build(const flight_conditions& conditions, worker_pool* pool = nullptr);
+    bool save(const std::string& path) const;
+    // false if the file is missing, damaged or was built for other conditions
+    bool load(const std::string& path, const flight_conditions& conditions);
+
+    // outside the grid the nearest edge is used
+    flight_result lookup(float speed_mph, float launch_angle_deg, float spin_rpm) const;
+
+    bool empty() const { return entries.empty(); }
+    const flight_conditions& get_conditions() const { return conditions; }
+};
+
+// the table cached at path, or built and written there if it's not usable
+std::shared_ptr<const carry_table> load_carry_table(const std::string& path, const flight_conditions& conditions,
+                                                    worker_pool* pool = nullptr);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// all capture timestamps are taken on the monotonic clock, which is also
+// what v4l2 stamps driver buffers with
+typedef std::chrono::steady_clock capture_clock;
+
+enum class frame_format {
+    gray,
+    bgr,
+    yuyv,
+    mjpeg
+};
+
+// a frame plus where it came from. the timestamp is the acquisition time of
+// the buffer, not the time anyone got around to processing it, so detection
+// can be deferred or replayed without changing the measured timing.
+//
+// lease keeps whatever backs image alive (e.g. an mmap'd driver buffer) and
+// hands it back when the last copy of the envelope is dropped.
+struct frame_envelope {
+    cv::Mat image;
+    capture_clock::time_point timestamp;
+    uint64_t sequence;
+    frame_format format;
+    std::shared_ptr<void> lease;
+
+    frame_envelope() : sequence(0), format(frame_format::gray) {}
+    frame_envelope(const cv::Mat& image, capture_clock::time_point timestamp, uint64_t sequence)
+        : image(image)
+        , timestamp(timestamp)
+        , sequence(sequence)
+        , format(frame_format::gray)
+    {}
+
+    frame_envelope clone() const {
+        frame_envelope copy(image.clone(), timestamp, sequence);
+        copy.format = format;
+        return copy;
+    }
+    bool empty() const { return image.empty(); }
+};
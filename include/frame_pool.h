@@ -0,0 +1,42 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// fixed set of frame buffers allocated once up front. cv::Mat already
+// reference counts its data, so a slot is free again as soon as the pool holds
+// the only reference; frames are passed around as plain cv::Mat copies.
+//
+// acquire() is called by a single producer thread, references can be dropped
+// from anywhere. pool_misses() counts every frame that didn't end up in a pool
+// buffer after warm-up (pool exhausted, a frame changed shape, or a converter
+// that allocated its own output), so a steady-state loop should keep it at
+// zero. it only covers frame buffers: libjpeg still allocates its per-image
+// pools on every decode, and the imdecode fallback a whole frame.
+class frame_pool {
+private:
+    std::vector<cv::Mat> slots;
+    size_t next;
+    cv::Size frame_size;
+    int frame_type;
+    std::atomic<uint64_t> acquired;
+    std::atomic<uint64_t> misses;
+
+    static bool is_free(const cv::Mat& slot);
+public:
+    frame_pool();
+    frame_pool(const frame_pool&) = delete;
+    frame_pool& operator=(const frame_pool&) = delete;
+
+    void reserve(cv::Size size, int type, size_t capacity);
+    cv::Mat acquire();
+    void count_miss() { misses++; }
+
+    size_t capacity() const { return slots.size(); }
+    size_t in_use() const;
+    cv::Size size() const { return frame_size; }
+    uint64_t acquisitions() const { return acquired.load(); }
+    uint64_t pool_misses() const { return misses.load(); }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the detector's mask chain (9x9 gaussian sigma 2, binary threshold, 5x5
+// elliptical open then close) fused into one streaming pass. each source row
+// is read once and every stage works on a handful of cached rows, so the whole
+// thing stays in l1/l2 instead of making five full-frame passes.
+//
+// the blur is done in 8-bit fixed point like opencv's bit-exact 8u gaussian
+// and borders follow opencv (reflect101 for the blur, constant max/min for
+// erode/dilate). launch_monitor_bench mask reports any difference against the
+// opencv chain.
+class mask_builder {
+private:
+    struct morph_stage {
+        bool erode;
+        std::vector<uint8_t> raw;   // 8 rows, padded by 2 on each side
+        std::vector<uint8_t> hop;   // 8 rows of 5-wide horizontal min/max
+        std::vector<uint8_t> out;   // one output row
+    };
+
+    int width;
+    int height;
+    uint16_t coeffs[9];
+    std::vector<uint8_t> padded;     // one source row with reflected borders
+    std::vector<uint16_t> hblur;     // 16 rows of horizontally blurred source
+    std::vector<uint8_t> binary;     // one thresholded row
+    std::vector<uint8_t> border_hi;
+    std::vector<uint8_t> border_lo;
+    morph_stage stages[4];
+
+    void resize(int w, int h);
+    void push_morph(int stage, int row, const uint8_t* data, uint8_t* dst, size_t dst_step);
+    void emit_morph(int stage, int row, uint8_t* dst, size_t dst_step);
+    const uint8_t* morph_row(int stage, int row, bool hop) const;
+public:
+    mask_builder();
+
+    void build(const uint8_t* src, size_t src_step, int w, int h, int threshold,
+               uint8_t* dst, size_t dst_step, uint8_t* thresh_dst = nullptr, size_t thresh_step = 0);
+    void build(const cv::Mat& gray, int threshold, cv::Mat& mask, cv::Mat* thresholded = nullptr);
+};
+
+// the instruction set the kernels were dispatched to at startup ("avx2",
+// "sse2" or "scalar"); forcing one is for benchmarking and must happen before
+// any detection runs
+const char* mask_kernel_isa();
+bool force_mask_kernel_isa(const std::string& isa);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// always-on instrumentation: monotonic counters and fixed-bucket latency
+// histograms, registered once by name and then updated from any thread with
+// relaxed atomics, no locks and no allocation. readers take snapshots, which
+// may be a sample or two out of step with each other but are never torn.
+
+class metric_counter {
+private:
+    std::atomic<uint64_t> value;
+public:
+    metric_counter() : value(0) {}
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+};
+
+struct histogram_snapshot {
+    std::string name;
+    uint64_t count;
+    double mean_us;
+    double max_us;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    std::vector<uint64_t> buckets;
+
+    histogram_snapshot() : count(0), mean_us(0), max_us(0), p50_us(0), p90_us(0), p99_us(0) {}
+};
+
+// 1-2-5 steps from 1 us to 1 s plus an overflow bucket, enough resolution to
+// tell a 2 ms stage from a 5 ms one without any per-sample cost beyond a
+// short scan and three atomic adds
+class latency_histogram {
+public:
+    static const int bucket_count = 20;
+    // upper bound of each bucket but the last, in nanoseconds
+    static const uint64_t bounds_ns[bucket_count - 1];
+private:
+    std::atomic<uint64_t> buckets[bucket_count];
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> longest_ns;
+public:
+    latency_histogram();
+
+    void record(std::chrono::nanoseconds elapsed);
+    template <typename duration>
+    void record(duration elapsed) { record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)); }
+
+    uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+    histogram_snapshot snapshot() const;
+    void reset();
+};
+
+struct metrics_snapshot {
+    std::vector<histogram_snapshot> histograms;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+};
+
+// owns every metric by name. registering takes a lock and should happen at
+// setup; the returned references stay valid for the registry's lifetime, so
+// hot paths keep a pointer and never come back here.
+class metrics_registry {
+private:
+    mutable std::mutex lock;
+    std::map<std::string, std::unique_ptr<latency_histogram>> histograms;
+    std::map<std::string, std::unique_ptr<metric_counter>> counters;
+public:
+    latency_histogram& histogram(const std::string& name);
+    metric_counter& counter(const std::string& name);
+
+    metrics_snapshot snapshot() const;
+    void reset();
+    // a plain text table of everything, for comparing boxes offline
+    bool dump(const std::string& path) const;
+};
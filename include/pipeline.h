@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.h"
+
+struct stage_stats {
+    std::string name;
+    int parallelism;            // 0 for a stage driven from outside, e.g. the ui thread
+    uint64_t processed;
+    double average_service_us;
+    double max_service_us;
+    bool has_input;
+    queue_stats input;
+
+    stage_stats() : parallelism(0), processed(0), average_service_us(0), max_service_us(0), has_input(false) {}
+};
+
+// one step of the pipeline: parallelism threads each calling step() until the
+// stage is stopped. step does one unit of work and returns false when there
+// was nothing to do, so only real work lands in the service counters.
+class pipeline_stage {
+private:
+    std::string name;
+    int parallelism;
+    std::function<bool()> step;
+    std::function<queue_stats()> input_stats;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> service_ns;
+    std::atomic<uint64_t> max_service_ns;
+
+    void run();
+public:
+    pipeline_stage(const std::string& name, std::function<bool()> step, int parallelism = 1,
+                   std::function<queue_stats()> input_stats = nullptr);
+    ~pipeline_stage();
+    pipeline_stage(const pipeline_stage&) = delete;
+    pipeline_stage& operator=(const pipeline_stage&) = delete;
+
+    void start();
+    // stops after the current step; whoever feeds a blocking step must close its queue
+    void stop();
+    // account one unit of work done outside the stage's own threads
+    void record(std::chrono::steady_clock::duration service);
+    stage_stats stats() const;
+    const std::string& get_name() const { return name; }
+};
+
+// stages wired together by bounded queues. the pipeline owns the stages, the
+// caller owns the queues and decides each one's capacity and drop policy.
+class pipeline {
+private:
+    std::vector<std::unique_ptr<pipeline_stage>> stages;
+    std::vector<std::function<void()>> closers;
+    bool started;
+public:
+    pipeline();
+    ~pipeline();
+    pipeline(const pipeline&) = delete;
+    pipeline& operator=(const pipeline&) = delete;
+
+    // a stage that produces from somewhere other than a queue (camera rings);
+    // step is polled, with a short sleep whenever it reports no work
+    pipeline_stage& add_source(const std::string& name, std::function<bool()> step);
+
+    // a stage fed by input, with body called once per item. a stage with state
+    // that depends on item order must stay at parallelism 1
+    template <typename T>
+    pipeline_stage& add_stage(const std::string& name, bounded_queue<T>& input,
+                              std::function<void(T&)> body, int parallelism = 1) {
+        auto step = [&input, body]() {
+            T item;
+            // bounded wait so a stopped stage notices even with the queue open
+            if (!input.pop_for(item, std::chrono::milliseconds(20))) {
+                return false;
+            }
+            body(item);
+            return true;
+        };
+        stages.push_back(std::unique_ptr<pipeline_stage>(
+            new pipeline_stage(name, step, parallelism, [&input]() { return input.stats(); })));
+        closers.push_back([&input]() { input.close(); });
+        return *stages.back();
+    }
+
+    // a queue drained by a thread the pipeline doesn't own (the ui); that
+    // thread calls record() on the returned stage so it shows in stats()
+    template <typename T>
+    pipeline_stage& add_sink(const std::string& name, bounded_queue<T>& input) {
+        stages.push_back(std::unique_ptr<pipeline_stage>(
+            new pipeline_stage(name, nullptr, 0, [&input]() { return input.stats(); })));
+        closers.push_back([&input]() { input.close(); });
+        return *stages.back();
+    }
+
+    void start();
+    // closes every queue first so blocked producers and consumers wake, then
+    // joins the stages in the order they were added
+    void stop();
+    std::vector<stage_stats> stats() const;
+};
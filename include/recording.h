@@ -0,0 +1,128 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "calculate.h"
+#include "detect.h"
+#include "frame.h"
+#include "shot_monitor.h"
+
+// one shot on disk, laid out so a reader can mmap it and point cv::Mat headers
+// straight at the pixels:
+//
+//   recording_header
+//   recording_frame[frame_count]
+//   frame_count x { top plane, bottom plane }, each plane 64-byte aligned
+//
+// planes are raw 8-bit gray, either the full frame or the detector roi. all
+// coordinates (detections, crops, rois) are frame coordinates, and timestamps
+// are the capture clock in nanoseconds, so only differences between them mean
+// anything. fields are fixed width and little-endian.
+//
+// version 2 added the tee column and each detection's circularity, which the
+// trajectory fit needs; version 1 files can't be re-solved the same way and
+// are refused.
+
+static const char recording_magic[8] = { 'L', 'M', 'S', 'H', 'O', 'T', 0, 0 };
+static const uint32_t recording_version = 2;
+
+struct recording_detector {
+    int32_t threshold;
+    float circularity;
+    float min_area;
+    float max_area;
+    int32_t use_roi;
+    int32_t roi[4];
+};
+
+struct recording_camera {
+    int32_t width;              // full frame
+    int32_t height;
+    int32_t crop[4];            // x, y, w, h of the stored plane
+    uint64_t plane_offset;      // of this camera's plane within a pair
+    recording_detector detector;
+};
+
+struct recording_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t frame_count;
+    uint32_t pre_trigger_frames;
+    uint64_t frames_offset;
+    uint64_t planes_offset;
+    uint64_t pair_stride;
+    int64_t recorded_unix;
+    float distance_between_inches;
+    float pixels_per_inch;
+    float frame_rate;
+    float tee_column;
+    float speed_mph;
+    float launch_angle_deg;
+    float carry_ft;
+    float distance_ft;
+    int32_t valid;
+    recording_camera cameras[2];    // top, bottom
+};
+
+struct recording_detection {
+    float x;
+    float y;
+    float radius;
+    float circularity;
+    int32_t found;
+};
+
+struct recording_frame {
+    int64_t timestamp_ns[2];
+    uint64_t sequence[2];
+    recording_detection detection[2];
+};
+
+// everything the writer needs, shared with the ui so no frame is copied
+struct shot_record {
+    std::shared_ptr<const burst_capture> burst;
+    shot_data shot;
+    camera_calibration calibration;
+    bool crop_to_roi;
+
+    shot_record() : crop_to_roi(true) {}
+};
+
+// writes to path.part and renames, so a reader never sees half a shot
+bool write_recording(const std::string& path, const shot_record& record);
+// dir/shot_YYYYmmdd_HHMMSS.lmshot, creating dir if needed; a suffix keeps
+// shots within the same second apart
+std::string next_recording_path(const std::string& dir);
+// newest .lmshot in dir by name, empty if there is none
+std::string latest_recording(const std::string& dir);
+
+class recording_reader {
+private:
+    std::shared_ptr<void> mapping;
+    const uint8_t* base;
+    size_t length;
+    const recording_header* header;
+    const recording_frame* frames;
+public:
+    recording_reader();
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    const recording_header& get_header() const { return *header; }
+    size_t frame_count() const { return header ? header->frame_count : 0; }
+    size_t pre_trigger_frames() const { return header ? header->pre_trigger_frames : 0; }
+
+    // camera 0 is top, 1 is bottom. the image is the stored plane in place,
+    // and the envelope's lease keeps the file mapped for as long as it lives
+    frame_envelope frame(int camera, size_t index) const;
+    ball_detection detection(int camera, size_t index) const;
+    cv::Rect crop(int camera) const;
+    ball_detector detector(int camera) const;
+    camera_calibration calibration() const;
+    shot_data shot() const;
+};
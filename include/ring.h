@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// single-producer/single-consumer ring, one thread pushes and one thread pops.
+// capacity must be a power of two so the index wrap is a mask.
+template <typename T, size_t N>
+class spsc_ring {
+private:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "spsc_ring capacity must be a power of two");
+
+    T slots[N];
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+public:
+    spsc_ring() : head(0), tail(0) {}
+
+    bool push(T&& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        slots[h & (N - 1)] = std::move(item);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots[t & (N - 1)]);
+        slots[t & (N - 1)] = T();
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return N; }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "background.h"
+#include "detect.h"
+#include "frame.h"
+#include "metrics.h"
+#include "ring.h"
+#include "track.h"
+#include "trigger.h"
+#include "worker_pool.h"
+
+// both cameras' frames for one capture instant, already flipped and gray
+struct frame_pair {
+    frame_envelope top;
+    frame_envelope bottom;
+};
+
+// one captured frame pair and what was detected on it. the images are pool
+// buffers shared with the capture thread, overlays are drawn on demand.
+struct burst_frame {
+    frame_envelope top;
+    frame_envelope bottom;
+    ball_detection det_top;
+    ball_detection det_bottom;
+};
+
+// a finished burst or test capture, handed on whole to whatever solves it
+struct burst_capture {
+    std::vector<burst_frame> frames;
+    size_t pre_trigger_frames;
+    std::vector<ball_detection> dets_top;       // found detections only, in capture order
+    std::vector<ball_detection> dets_bottom;
+    ball_detector detector_top;                 // settings the burst was detected with
+    ball_detector detector_bottom;
+    bool test;
+
+    burst_capture() : pre_trigger_frames(0), test(false) {}
+};
+
+enum class monitor_state { idle, waiting, capturing, cooldown };
+
+// what the ui shows about the monitor, copied out once per processed pair
+struct monitor_status {
+    monitor_state state;
+    bool testing;
+    int captured;
+    int burst_frames;
+    int cooldown;
+    int test_top;
+    int test_bottom;
+    double searched_top;        // share of frame pixels the armed tracker ran on
+    double searched_bottom;
+    double burst_searched_top;  // the same for burst frames
+    double burst_searched_bottom;
+    double trigger_us_top;
+    double trigger_us_bottom;
+    uint64_t fired_top;
+    uint64_t fired_bottom;
+    double latency_top;
+    double latency_bottom;
+    int tracks_top;             // live candidate tracks while capturing
+    int tracks_bottom;
+    uint64_t dropped_bursts;    // captures with no ball in flight in either camera
+    bool background;            // subtracting a background model during capture
+    int background_frames;      // frames the models have learnt from, the fewer of the two
+
+    monitor_status()
+        : state(monitor_state::idle), testing(false), captured(0), burst_frames(0), cooldown(0)
+        , test_top(0), test_bottom(0), searched_top(1), searched_bottom(1)
+        , burst_searched_top(1), burst_searched_bottom(1)
+        , trigger_us_top(0), trigger_us_bottom(0), fired_top(0), fired_bottom(0)
+        , latency_top(0), latency_bottom(0), tracks_top(0), tracks_bottom(0), dropped_bursts(0)
+        , background(false), background_frames(0)
+    {}
+};
+
+// the armed -> capturing -> cooldown state machine, plus manual test captures.
+// process() is called from one thread with every frame pair in order; start,
+// stop, test_capture and set_detectors may be called from any thread and take
+// effect at the next pair. a finished burst goes to the handler given at
+// construction, which must not block for long: the next pair waits on it.
+class shot_monitor {
+private:
+    static const int pre_trigger_size = 15;
+
+    worker_pool& pool;
+    std::function<void(burst_capture&&)> on_burst;
+    int burst_frames;
+    int cooldown_frames;
+    float motion_threshold;     // px the ball must move between checks to count as a shot
+
+    ball_detector detector_top;
+    ball_detector detector_bottom;
+    ball_tracker tracker_top;
+    ball_tracker tracker_bottom;
+    trigger_detector trigger_top;
+    trigger_detector trigger_bottom;
+    // every candidate of a burst goes to these, and the ball is the best
+    // track once the burst is over
+    track_manager tracks_top;
+    track_manager tracks_bottom;
+    candidate_list candidates_top;
+    candidate_list candidates_bottom;
+    std::vector<candidate_list> frame_candidates_top;       // one per burst frame, pre-trigger ones included
+    std::vector<candidate_list> frame_candidates_bottom;
+    std::vector<ball_detection> chosen;                     // track_manager::choose's output, reused
+    uint64_t burst_searched_top;        // pixels track_manager::search ran the detector on
+    uint64_t burst_searched_bottom;
+    uint64_t burst_pixels_top;
+    uint64_t burst_pixels_bottom;
+    uint64_t dropped_bursts;
+    // learnt from every few frames while armed and nothing fires, subtracted
+    // while capturing. the ball at rest on the tee ends up in them, which is
+    // why watching for it still uses the raw frames
+    background_model background_top;
+    background_model background_bottom;
+    bool use_background;
+    int background_interval;
+    int frames_since_background;
+    latency_histogram* background_time;
+
+    spsc_ring<burst_frame, 16> frame_buffer;
+    burst_capture burst;
+    burst_capture test_burst;
+    bool monitoring;
+    bool testing;
+    bool motion;
+    int cooldown;
+    bool have_prev_ball;
+    int frames_since_prev;
+    ball_detection prev_ball_top;
+    ball_detection prev_ball_bottom;
+    latency_histogram* detect_time_top;
+    latency_histogram* detect_time_bottom;
+
+    // written by other threads, picked up at the top of process()
+    mutable std::mutex control_lock;
+    ball_detector pending_top;
+    ball_detector pending_bottom;
+    bool detectors_dirty;
+    bool start_requested;
+    bool stop_requested;
+    bool test_requested;
+    bool pending_background;
+    monitor_status status;
+
+    void apply_requests();
+    void watch(const frame_pair& pair);
+    void capture(const frame_pair& pair);
+    // candidates for burst.frames[index] in both cameras, fed to the tracks
+    void search_burst_frame(size_t index);
+    // whether a candidate still sits where the ball was at rest in every
+    // camera that saw it there, i.e. whatever moved wasn't the ball
+    bool ball_at_rest(const frame_pair& pair);
+    // true if either camera had a plausible ball track; rewrites the burst's
+    // detections to it
+    bool adopt_tracks();
+    void test_frame(const frame_pair& pair);
+    void publish();
+    void learn_background(const frame_pair& pair);
+    // points the detectors at the models, or back at raw frames
+    void subtract_background(bool enabled);
+public:
+    shot_monitor(worker_pool& pool, std::function<void(burst_capture&&)> on_burst,
+                 int burst_frames = 40, int cooldown_frames = 90, float motion_threshold = 50.0f);
+    shot_monitor(const shot_monitor&) = delete;
+    shot_monitor& operator=(const shot_monitor&) = delete;
+
+    void process(const frame_pair& pair);
+
+    void start();
+    void stop();
+    void test_capture();
+    void set_detectors(const ball_detector& top, const ball_detector& bottom);
+    void set_background_model(bool enabled);
+    // whether frame timestamps are the capture clock; trigger latency is only
+    // measured for live sources. call before start()
+    void set_live_source(bool live);
+    monitor_status get_status() const;
+    // times every detection as "top.detect" / "bottom.detect" and background
+    // updates as "background.update"; call before the first process()
+    void set_metrics(metrics_registry& registry);
+};
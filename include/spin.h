@@ -0,0 +1,66 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "frame.h"
+
+struct burst_capture;
+
+// spin from how the ball's markings turn between sightings. both cameras
+// look side on, along the backspin axis, so backspin turns the markings in
+// the image plane: each sighting is unwrapped to log-polar rings around the
+// ball centre, where that rotation is a circular shift along the angle axis,
+// and pairs of sightings are registered by circular correlation.
+//
+// one frame period is too long to tell 150 degrees of turn from 510, so a
+// single camera only knows spin modulo one turn per frame. the two cameras
+// aren't triggered together, though, and a pair across them spans a different
+// interval; the rate that agrees with every pair is the answer. sidespin
+// tilts the markings out of the image plane and shows up as a worse fit, not
+// as a separate number.
+
+// one sighting of the ball: the frame it was seen in and where, in that
+// frame's pixels
+struct spin_view {
+    cv::Mat image;
+    cv::Point2f center;
+    float radius;
+    capture_clock::time_point timestamp;
+};
+
+struct spin_estimate {
+    float rpm;                  // backspin positive, topspin negative
+    float confidence;           // 0 to 1, how well the best rate explains every pair
+    int pairs;                  // sighting pairs that registered
+    bool ok;
+
+    spin_estimate() : rpm(0), confidence(0), pairs(0), ok(false) {}
+};
+
+class spin_estimator {
+public:
+    static const int rings = 8;
+    static const int angles = 128;
+private:
+    float max_gap_s;            // pairs further apart than this aren't registered
+    float min_texture;          // gray level rms a sighting needs to be worth using
+    float min_peak;             // normalised correlation a pair needs to count
+    float min_rpm;
+    float max_rpm;
+
+    // log-polar samples of the ball, rings x angles, rings running outward;
+    // false if the ball is too close to the frame edge or has no markings
+    bool unwrap(const spin_view& view, std::vector<float>& polar) const;
+public:
+    spin_estimator();
+
+    spin_estimate estimate(const std::vector<spin_view>& top, const std::vector<spin_view>& bottom) const;
+    spin_estimate estimate(const burst_capture& burst) const;
+
+    void set_max_gap(float seconds) { max_gap_s = seconds; }
+    void set_range(float low_rpm, float high_rpm) { min_rpm = low_rpm; max_rpm = high_rpm; }
+};
+
+// rotation of b against a in degrees, (-180, 180], from two unwrapped
+// sightings; peak is the normalised correlation at that shift
+float register_rotation(const std::vector<float>& a, const std::vector<float>& b, float& peak);
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "calculate.h"
+#include "capture.h"
+#include "frame.h"
+
+// rendered two-camera shots with known answers, for benchmarking and
+// regression runs without a hitting bay.
+//
+// the rig is seen side on: x is downrange and y is up, in inches from the
+// ball on the tee. both cameras share pixels_per_inch and a vertical datum;
+// the bottom camera has the tee at `tee`, the top camera looks the same way
+// distance_between_inches further downrange. that is the geometry
+// shot_calculator assumes, so any error it reports on these scenes is its own.
+
+struct synthetic_shot {
+    float speed_mph;
+    float launch_angle_deg;
+    double launch_time;     // seconds into the shot's slot, at any sub-frame phase
+    float spin_rpm;         // backspin, turning the markings on the ball
+};
+
+struct synthetic_rig {
+    camera_calibration calibration;
+    cv::Size frame_size;
+    cv::Point2f tee;                // bottom camera pixel of the ball at rest
+    float ball_diameter_inches;
+    float exposure;                 // share of the frame period the shutter is open, 0 freezes the ball
+    float background;               // mean gray level of an empty frame
+    float noise_sigma;
+    float ball_level;
+    int hot_spots;                  // static bright specks per camera, like the tee or a mat seam
+    float drop_rate;                // chance that any one frame of a camera never arrives
+    int slot_frames;                // frames per shot: on the tee, flight, then empty through cooldown
+    int rest_frames;                // frames the ball sits on the tee before launch
+    float top_phase;                // share of a frame period the top camera's shutter trails the bottom's
+
+    synthetic_rig()
+        : frame_size(1280, 720)
+        , tee(160, 540)
+        , ball_diameter_inches(1.68f)
+        , exposure(0.02f)
+        , background(20)
+        , noise_sigma(4)
+        , ball_level(245)
+        , hot_spots(3)
+        , drop_rate(0)
+        , slot_frames(200)
+        , rest_frames(30)
+        , top_phase(0.37f)
+    {
+        calibration.tee_column = tee.x;
+    }
+
+    float ball_radius_px() const { return 0.5f * ball_diameter_inches * calibration.pixels_per_inch; }
+};
+
+// where the ball is in one camera's frame
+struct synthetic_truth {
+    cv::Point2f pixel;
+    bool visible;
+    bool in_flight;
+};
+
+// renders frames of the rig. stateless once built, so both cameras' sources
+// can share one, and safe to call from any thread.
+class scene_generator {
+private:
+    static const int background_count = 16;
+
+    synthetic_rig rig;
+    uint64_t seed;
+    capture_clock::time_point epoch;        // frame 0 of every source built on this
+    std::vector<cv::Mat> backgrounds[2];
+public:
+    scene_generator(const synthetic_rig& rig, uint64_t seed = 1);
+
+    // ball centre in rig inches, t seconds into the slot of `shot`
+    cv::Point2f position(const synthetic_shot& shot, double t) const;
+    // how far the markings have turned by then, radians in image angle
+    double turn(const synthetic_shot& shot, double t) const;
+    // when a camera's frame_index is exposed, seconds after the epoch
+    double frame_time(int camera, uint64_t frame_index) const;
+    // a rig point in camera 0 (top) or 1 (bottom) pixels
+    cv::Point2f project(int camera, cv::Point2f inches) const;
+    synthetic_truth truth(int camera, const synthetic_shot& shot, double t) const;
+    // camera's view t seconds into the slot, with the shutter open around t
+    void render(int camera, const synthetic_shot& shot, double t, uint64_t frame_index, cv::Mat& out) const;
+    // whether frame_index of camera goes missing; fixed for a given seed
+    bool dropped(int camera, uint64_t frame_index) const;
+
+    const synthetic_rig& get_rig() const { return rig; }
+    uint64_t get_seed() const { return seed; }
+    capture_clock::time_point get_epoch() const { return epoch; }
+};
+
+// count shots uniform over the ranges, each launched at a random sub-frame
+// phase a little after the rig's rest_frames
+std::vector<synthetic_shot> random_shots(const synthetic_rig& rig, int count, float min_speed, float max_speed,
+                                         float min_angle, float max_angle, float min_spin, float max_spin,
+                                         uint64_t seed = 1);
+
+// one camera of a generated scene played as a capture source: shot after
+// shot, one slot each, stamped exactly at the generator's frame_time. a
+// dropped frame is skipped the way a camera loses one, its sequence number is
+// never seen.
+class synthetic_source : public capture_source {
+private:
+    int camera;
+    std::shared_ptr<const scene_generator> generator;
+    std::vector<synthetic_shot> shots;
+    bool realtime;
+    bool loop;
+    bool opened;
+    uint64_t index;
+    std::atomic<uint64_t> dropped_frames;
+public:
+    synthetic_source(int camera, std::shared_ptr<const scene_generator> generator, const std::vector<synthetic_shot>& shots,
+                     bool realtime = true, bool loop = true);
+    bool open() override;
+    bool read(frame_envelope& frame) override;
+    bool is_open() const override { return opened; }
+    uint64_t dropped() const override { return dropped_frames.load(); }
+    std::string describe() const override;
+    bool is_live() const override { return false; }
+
+    // the shot a frame sequence number belongs to
+    size_t shot_index(uint64_t sequence) const;
+    const std::vector<synthetic_shot>& get_shots() const { return shots; }
+    uint64_t frame_count() const { return (uint64_t)shots.size() * generator->get_rig().slot_frames; }
+};
+
+// "synthetic:top" / "synthetic:bottom", optionally ":<seed>": endless random
+// shots on the default rig. the same seed on both cameras gives one scene.
+std::unique_ptr<capture_source> make_synthetic_source(const std::string& spec, const capture_settings& settings);
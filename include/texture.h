@@ -0,0 +1,41 @@
+#pragma once
+
+#include "imgui.h"
+#include <GLFW/glfw3.h>
+#include <opencv2/opencv.hpp>
+
+// a gl texture fed from cv::Mat frames. gray frames stay one byte per pixel
+// (GL_R8, swizzled to gray when sampled) and bgr goes up as GL_BGR, so nothing
+// is colour-converted on the cpu. storage is only re-specified when the size
+// or channel count changes; every other update is a glTexSubImage2D streamed
+// through one of two pixel buffer objects, so the copy into gl memory never
+// waits on the previous transfer.
+class image_texture {
+private:
+    int width, height;
+    int channels;
+    GLuint texture_id;
+    GLuint pbo[2];
+    int pbo_next;
+    size_t pbo_size;
+    cv::Mat scaled;
+
+    void allocate(int w, int h, int c);
+    void upload(const cv::Mat& image);
+public:
+    image_texture();
+    ~image_texture();
+    image_texture(const image_texture&) = delete;
+    image_texture& operator=(const image_texture&) = delete;
+
+    // max_size is the on-screen size in pixels; a frame larger than that in
+    // both directions is area-downscaled first so only what's drawn goes up.
+    // an empty max_size uploads at full resolution
+    void update(const cv::Mat& frame, cv::Size max_size = cv::Size());
+    void* get_id() {
+        return (void*)(intptr_t)texture_id;
+    }
+    ImVec2 size() {
+        return ImVec2((float)width, (float)height);
+    }
+};
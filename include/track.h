@@ -0,0 +1,126 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include "detect.h"
+#include "frame.h"
+
+// follows one ball across frames with a constant-velocity model and only
+// runs the detector in a gate around the predicted position. a miss in the
+// gate falls back to a full search of the same frame, so recall is the same as
+// calling find_ball directly; the saving comes from every frame the ball is
+// where it was expected (sitting on the tee, or in flight once two detections
+// give a velocity).
+class ball_tracker {
+private:
+    ball_detector& detector;
+    ball_detection last;
+    cv::Point2f velocity;       // px per second
+    bool has_velocity;
+    bool locked;
+    cv::Rect gate;
+    float min_half_size;
+    double max_gap;             // seconds between detections to still trust a velocity
+
+    uint64_t gated_hits;
+    uint64_t gated_misses;
+    uint64_t full_searches;
+    uint64_t pixels_searched;
+    uint64_t pixels_total;
+
+    cv::Rect predict_gate(const frame_envelope& frame) const;
+    void update(const ball_detection& detection, bool from_gate);
+public:
+    ball_tracker(ball_detector& detector, float min_half_size = 48.0f, double max_gap = 0.1);
+
+    ball_detection track(const frame_envelope& frame);
+    // take a detection made elsewhere (e.g. a parallel catch-up over buffered
+    // frames) as if track() had produced it; feed them in frame order
+    void observe(const ball_detection& detection);
+    void reset();
+
+    bool is_locked() const { return locked; }
+    cv::Rect get_gate() const { return gate; }
+    cv::Point2f get_velocity() const { return velocity; }
+
+    uint64_t gate_hits() const { return gated_hits; }
+    uint64_t gate_misses() const { return gated_misses; }
+    uint64_t full_search_count() const { return full_searches; }
+    // share of frame pixels actually run through the detector so far
+    double searched_fraction() const { return pixels_total ? (double)pixels_searched / pixels_total : 1.0; }
+};
+
+// one hypothesis: candidates from successive frames, at most one per frame,
+// that move like a single object
+struct candidate_track {
+    std::vector<ball_detection> points;     // in frame order
+    cv::Point2f velocity;                   // px per second, from the last two points
+    float radius;                           // running mean
+    int misses;                             // frames in a row with nothing in the gate
+    bool alive;                             // still taking points
+
+    candidate_track() : velocity(0, 0), radius(0), misses(0), alive(false) {}
+};
+
+// picks the ball out of everything bright over one burst from one camera. each
+// frame's candidates are matched to the live tracks (nearest to the predicted
+// position, inside a gate, similar size), and whatever is left starts a track
+// of its own. a clubhead, the tee or a reflection wins single frames but not a
+// track: the ball is the one that moves fast, on a smooth path, at a steady
+// size and round all the way. tracks live in fixed slots and keep their
+// storage between bursts, so feeding frames doesn't allocate. search() finds a
+// frame's candidates only where the tracks will look for them, plus a full
+// search every few frames for anything new.
+class track_manager {
+public:
+    static const int max_tracks = 8;
+private:
+    candidate_track tracks[max_tracks];
+    size_t max_points;
+    float gate_radii;           // gate in ball radii around the prediction
+    float gate_travel;          // plus this share of the predicted step
+    float max_jump;             // px/s a track with one point may move at, it has no velocity yet
+    int max_misses;
+    float min_speed;            // px/s below which a track is furniture, not a ball in flight
+    float gate_margin;          // px around a search window for the blur and morphology footprint
+    int full_search_interval;   // burst frames between full searches, so new tracks can start
+
+    int free_slot() const;
+    // where t should be at `at` and how far from there a candidate may be
+    void predict(const candidate_track& t, capture_clock::time_point at, cv::Point2f& position, float& gate) const;
+    // the windows update() would take candidates from at `at`, one per live
+    // track with a velocity, clipped to bounds and merged where they overlap
+    // so no blob is seen twice; returns how many of max_tracks were written
+    int gates(capture_clock::time_point at, cv::Rect bounds, cv::Rect* windows) const;
+    // frame `index` of a burst is searched whole when that's due, when a
+    // track was born on the last frame (no velocity, so no gate yet) or when a
+    // still track just came up empty (the ball leaving the tee outruns its
+    // gate). a moving track that misses keeps a gate that widens with the gap
+    bool needs_full_search(size_t index) const;
+public:
+    explicit track_manager(size_t max_points = 64);
+
+    void reset();
+    void update(const candidate_list& candidates);
+
+    // how much a track looks like a ball in flight; 0 for anything too short,
+    // too slow or too erratic to be one
+    float score(int index) const;
+    // the first point of a track that arrived moving; a ball at rest grows a
+    // track that it then carries on in flight, and the rest isn't trajectory
+    size_t flight_start(int index) const;
+    // the highest scoring track, or -1 if none is plausible
+    int best() const;
+    // what a burst is solved from, live and in replay alike: detections[i]
+    // becomes the best track's point from frames[i], counting from its flight
+    // start, or not found. frames are the candidate lists update() was fed, in
+    // the same order. false, leaving detections alone, if no track is plausible
+    bool choose(const std::vector<candidate_list>& frames, size_t count, std::vector<ball_detection>& detections) const;
+    const candidate_track& track(int index) const { return tracks[index]; }
+    int live_tracks() const;
+    // frame `index` of a burst's candidates for the next update(), searched
+    // only where the live tracks' gates are, with a full search when one is
+    // needed; adds the pixels run through the detector to searched
+    ball_detection search(ball_detector& detector, const frame_envelope& frame, size_t index,
+                          candidate_list& candidates, uint64_t& searched) const;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include "frame.h"
+
+// cheap armed-state check: bins the tee region down to block means and counts
+// blocks that moved away from a slowly adapting reference. it never looks for
+// the ball itself, it only says "something changed on the tee", at which point
+// the caller escalates to full-resolution detection.
+class trigger_detector {
+private:
+    int block_size;
+    float diff_threshold;   // mean abs change of a block, in gray levels
+    int min_blocks;
+    float adapt_rate;       // reference follows lighting drift at this rate per frame
+    bool armed;
+    bool live;              // frame timestamps are on the capture clock
+    cv::Rect region;
+    cv::Mat binned;
+    cv::Mat binned_f;
+    cv::Mat reference;
+    cv::Mat diff;
+    cv::Mat changed;
+
+    uint64_t frames;
+    uint64_t fires;
+    double total_us;
+    int last_changed;
+    double last_latency_ms;
+public:
+    trigger_detector(int block_size = 8, float diff_threshold = 12.0f, int min_blocks = 2);
+
+    // start watching region (frame coordinates); the next frame becomes the reference
+    void arm(cv::Rect region);
+    void disarm();
+    bool update(const frame_envelope& frame);
+    // called once a firing is confirmed as a shot, records capture-to-decision
+    // latency; only meaningful for live frames, otherwise it stays 0
+    void mark_triggered(const frame_envelope& frame);
+    void set_live(bool live) { this->live = live; }
+
+    bool is_armed() const { return armed; }
+    bool is_live() const { return live; }
+    cv::Rect get_region() const { return region; }
+    uint64_t frame_count() const { return frames; }
+    uint64_t fire_count() const { return fires; }
+    double average_us() const { return frames ? total_us / frames : 0; }
+    int changed_blocks() const { return last_changed; }
+    double latency_ms() const { return last_latency_ms; }
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// small fixed set of threads for fanning detection work out. submit() hands
+// back a future, so callers wait on exactly the results they need and keep
+// their own ordering; nothing here reorders results.
+class worker_pool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+
+    void run();
+public:
+    // 0 picks one thread per core, minus the two capture threads
+    explicit worker_pool(size_t threads = 0);
+    ~worker_pool();
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    template <typename F>
+    std::future<typename std::invoke_result<F>::type> submit(F&& f) {
+        typedef typename std::invoke_result<F>::type result_type;
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+        std::future<result_type> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            tasks.emplace_back([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+};
@@ -0,0 +1,595 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "background.h"
+#include "calculate.h"
+#include "capture.h"
+#include "config.h"
+#include "decode.h"
+#include "detect.h"
+#include "recording.h"
+#include "shot_monitor.h"
+#include "synthetic.h"
+#include "track.h"
+#include "worker_pool.h"
+
+// runs recorded shots, raw image/video pairs, or generated scenes through
+// detection and the shot math with no window and no cameras. time comes from the recordings
+// (or the nominal frame rate for raw input), never the wall clock, so a run
+// goes as fast as the cpu allows and gives the same numbers every time.
+
+typedef std::chrono::steady_clock replay_clock;
+
+// detector settings given on the command line win over the recorded ones
+struct detector_overrides {
+    int threshold;
+    float circularity;
+    float min_area;
+    float max_area;
+    int engine;             // -1 keeps the recorded/default engine
+
+    detector_overrides() : threshold(-1), circularity(-1), min_area(-1), max_area(-1), engine(-1) {}
+
+    void apply(ball_detector& d) const {
+        if (threshold >= 0) d.set_threshold(threshold);
+        if (circularity >= 0) d.set_circularity(circularity);
+        if (min_area >= 0) d.set_min_area(min_area);
+        if (max_area >= 0) d.set_max_area(max_area);
+        if (engine >= 0) d.set_engine(engine ? candidate_engine::components : candidate_engine::contours);
+    }
+};
+
+struct replay_options {
+    std::vector<std::string> recordings;
+    std::string top_source;
+    std::string bottom_source;
+    bool flip_top;
+    bool flip_bottom;
+    bool swap;
+    int fps;
+    std::string csv_path;
+    std::string json_path;
+    detector_overrides overrides;
+    std::string carry_table_path;
+    std::shared_ptr<const carry_table> carry;
+    std::string config_path;
+    bool background;        // subtract a background model during bursts, as the live monitor does
+
+    // generated scenes: shot count, their ranges and how rough the rig is
+    int synthetic;
+    uint64_t seed;
+    float min_speed, max_speed;
+    float min_angle, max_angle;
+    float min_spin, max_spin;
+    synthetic_rig rig;
+
+    replay_options()
+        : flip_top(false), flip_bottom(false), swap(false), fps(120), carry_table_path("carry_table.bin")
+        , config_path("launch_monitor.conf"), background(true)
+        , synthetic(0), seed(1), min_speed(20), max_speed(80), min_angle(5), max_angle(30)
+        , min_spin(2000), max_spin(8000)
+    {}
+};
+
+struct shot_row {
+    std::string source;
+    int frames;
+    int found_top;
+    int found_bottom;
+    shot_data shot;
+    bool has_recorded;
+    shot_data recorded;
+    bool has_truth;
+    synthetic_shot truth;
+    double detect_ms;
+    double searched;        // share of plane pixels detection ran on, < 0 if not known
+
+    shot_row() : frames(0), found_top(0), found_bottom(0), has_recorded(false), has_truth(false), detect_ms(0)
+        , searched(-1) {}
+};
+
+static bool has_suffix(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// a directory argument expands to the .lmshot files in it, in name order
+static void collect_recordings(const std::string& path, std::vector<std::string>& out) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        std::cerr << "no such file or directory: " << path << std::endl;
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        out.push_back(path);
+        return;
+    }
+    std::vector<std::string> names;
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (has_suffix(name, ".lmshot")) {
+            names.push_back(path + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    out.insert(out.end(), names.begin(), names.end());
+}
+
+// the recorded detector, moved into the coordinates of the stored plane: a
+// plane cropped to the roi is searched whole, any other roi is shifted by the crop
+static ball_detector plane_detector(const recording_reader& reader, int camera, const detector_overrides& overrides) {
+    ball_detector d = reader.detector(camera);
+    overrides.apply(d);
+    cv::Rect crop = reader.crop(camera);
+    if (d.is_using_roi()) {
+        cv::Rect roi = d.get_roi() & crop;
+        if (roi.area() == 0 || roi == crop) {
+            d.disable_roi();
+        } else {
+            d.set_roi(roi - crop.tl());
+        }
+    }
+    return d;
+}
+
+static shot_row replay_recording(const std::string& path, const replay_options& options, worker_pool& pool) {
+    shot_row row;
+    row.source = path;
+
+    recording_reader reader;
+    if (!reader.open(path)) {
+        return row;
+    }
+    row.frames = (int)reader.frame_count();
+    row.has_recorded = true;
+    row.recorded = reader.shot();
+
+    ball_detector detectors[2] = { plane_detector(reader, 0, options.overrides), plane_detector(reader, 1, options.overrides) };
+
+    // live capture subtracts a model learnt while armed. only the last few
+    // quiet frames before the trigger survive in a recording, so the model is
+    // learnt from every one of them (the last pre-trigger frame is the one
+    // that fired); with fewer than the warmup it stays unready and detection
+    // runs on raw frames
+    background_model backgrounds[2];
+    if (options.background && reader.pre_trigger_frames() > 1) {
+        for (int c = 0; c < 2; c++) {
+            for (size_t i = 0; i + 1 < reader.pre_trigger_frames(); i++) {
+                backgrounds[c].update(reader.frame(c, i).image);
+            }
+            detectors[c].set_background(&backgrounds[c]);
+        }
+    }
+    cv::Point2f offsets[2] = { cv::Point2f((float)reader.crop(0).x, (float)reader.crop(0).y),
+                               cv::Point2f((float)reader.crop(1).x, (float)reader.crop(1).y) };
+
+    // the ball is picked the way the monitor picks it live: frames searched
+    // in capture order where the tracks look, then the best track. cameras
+    // are independent, so one job each; a camera with no plausible track
+    // keeps its per-frame winners
+    size_t count = reader.frame_count();
+    std::vector<ball_detection> results[2];
+    std::vector<candidate_list> candidates[2];
+    for (int c = 0; c < 2; c++) {
+        results[c].resize(count);
+        candidates[c].resize(count);
+    }
+
+    replay_clock::time_point begin = replay_clock::now();
+    std::vector<std::future<void>> jobs;
+    uint64_t searched[2] = { 0, 0 }, pixels[2] = { 0, 0 };
+    for (int c = 0; c < 2; c++) {
+        jobs.push_back(pool.submit([&, c]() {
+            track_manager tracks(count);
+            for (size_t i = 0; i < count; i++) {
+                frame_envelope frame = reader.frame(c, i);
+                pixels[c] += (uint64_t)frame.image.total();
+                results[c][i] = tracks.search(detectors[c], frame, i, candidates[c][i], searched[c]);
+                tracks.update(candidates[c][i]);
+            }
+            tracks.choose(candidates[c], count, results[c]);
+            for (auto& d : results[c]) {
+                if (d.found) {
+                    d.position += offsets[c];
+                }
+            }
+        }));
+    }
+    for (auto& job : jobs) {
+        job.get();
+    }
+    row.detect_ms = std::chrono::duration<double, std::milli>(replay_clock::now() - begin).count();
+    if (pixels[0] + pixels[1] > 0) {
+        row.searched = (double)(searched[0] + searched[1]) / (pixels[0] + pixels[1]);
+    }
+
+    std::vector<ball_detection> found[2];
+    std::vector<spin_view> views[2];
+    for (int c = 0; c < 2; c++) {
+        for (size_t i = 0; i < results[c].size(); i++) {
+            const ball_detection& d = results[c][i];
+            if (!d.found) continue;
+            found[c].push_back(d);
+            spin_view v = { reader.frame(c, i).image, d.position - offsets[c], d.radius, d.timestamp };
+            views[c].push_back(v);
+        }
+    }
+    row.found_top = (int)found[0].size();
+    row.found_bottom = (int)found[1].size();
+
+    spin_estimate spin = spin_estimator().estimate(views[0], views[1]);
+    shot_calculator calc(reader.calibration());
+    calc.set_carry_table(options.carry);
+    row.shot = options.swap ? calc.calculate_shot(found[1], found[0], &spin) : calc.calculate_shot(found[0], found[1], &spin);
+    return row;
+}
+
+static bool read_gray(capture_source& source, mjpeg_decoder& decoder, bool flip, frame_envelope& frame) {
+    if (!source.read(frame)) {
+        return false;
+    }
+    if (frame.format == frame_format::mjpeg) {
+        cv::Mat gray;
+        if (!decoder.decode(frame.image, gray)) {
+            return false;
+        }
+        frame.image = gray;
+    } else if (frame.image.channels() == 3) {
+        cv::Mat gray;
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+        frame.image = gray;
+    }
+    frame.format = frame_format::gray;
+    if (flip) {
+        cv::flip(frame.image, frame.image, -1);
+    }
+    return true;
+}
+
+// input with no shots marked in it goes through the real shot monitor: same
+// trigger, same bursts, same tracker as the live app. a synthetic top source
+// also says which generated shot each burst was
+static std::vector<shot_row> replay_pairs(capture_source& top, capture_source& bottom, const std::string& label,
+                                          ball_detector detector_top, ball_detector detector_bottom,
+                                          shot_calculator& calc, const replay_options& options, worker_pool& pool,
+                                          int& pairs, const synthetic_source* synthetic = nullptr) {
+    std::vector<shot_row> rows;
+    pairs = 0;
+    if (!top.open() || !bottom.open()) {
+        return rows;
+    }
+
+    options.overrides.apply(detector_top);
+    options.overrides.apply(detector_bottom);
+
+    spin_estimator spinner;
+    replay_clock::time_point burst_begin = replay_clock::now();
+    shot_monitor monitor(pool, [&](burst_capture&& burst) {
+        shot_row row;
+        uint64_t first = burst.frames.front().top.sequence;
+        row.source = label + " @" + std::to_string(first);
+        row.frames = (int)burst.frames.size();
+        row.found_top = (int)burst.dets_top.size();
+        row.found_bottom = (int)burst.dets_bottom.size();
+        spin_estimate spin = spinner.estimate(burst);
+        row.shot = options.swap ? calc.calculate_shot(burst.dets_bottom, burst.dets_top, &spin)
+                                : calc.calculate_shot(burst.dets_top, burst.dets_bottom, &spin);
+        if (synthetic) {
+            row.has_truth = true;
+            row.truth = synthetic->get_shots()[synthetic->shot_index(first)];
+        }
+        row.detect_ms = std::chrono::duration<double, std::milli>(replay_clock::now() - burst_begin).count();
+        rows.push_back(row);
+    });
+    monitor.set_detectors(detector_top, detector_bottom);
+    monitor.set_background_model(options.background);
+    monitor.set_live_source(false);
+    monitor.start();
+
+    mjpeg_decoder decoder_top, decoder_bottom;
+    frame_pair pair;
+    while (read_gray(top, decoder_top, options.flip_top, pair.top) &&
+           read_gray(bottom, decoder_bottom, options.flip_bottom, pair.bottom)) {
+        if (monitor.get_status().state == monitor_state::waiting) {
+            burst_begin = replay_clock::now();
+        }
+        monitor.process(pair);
+        pairs++;
+    }
+    return rows;
+}
+
+static std::vector<shot_row> replay_sources(const replay_options& options, worker_pool& pool, int& pairs) {
+    capture_settings settings;
+    settings.fps = options.fps;
+    settings.realtime = false;
+    file_source top(options.top_source, settings, false);
+    file_source bottom(options.bottom_source, settings, false);
+
+    shot_calculator calc;
+    calc.set_frame_rate((float)options.fps);
+    calc.set_carry_table(options.carry);
+    return replay_pairs(top, bottom, options.top_source + " + " + options.bottom_source,
+                        ball_detector(), ball_detector(), calc, options, pool, pairs);
+}
+
+static std::vector<shot_row> replay_synthetic(const replay_options& options, worker_pool& pool, int& pairs) {
+    std::shared_ptr<const scene_generator> generator = std::make_shared<scene_generator>(options.rig, options.seed);
+    std::vector<synthetic_shot> shots = random_shots(options.rig, options.synthetic, options.min_speed, options.max_speed,
+                                                     options.min_angle, options.max_angle, options.min_spin, options.max_spin,
+                                                     options.seed);
+    synthetic_source top(0, generator, shots, false, false);
+    synthetic_source bottom(1, generator, shots, false, false);
+
+    // the default area limits are for a smaller ball than the rig renders;
+    // size them to it, leaving room for motion blur
+    float radius = options.rig.ball_radius_px();
+    float area = (float)CV_PI * radius * radius;
+    ball_detector detector;
+    detector.set_min_area(0.25f * area);
+    detector.set_max_area(3.0f * area);
+
+    shot_calculator calc(options.rig.calibration);
+    calc.set_carry_table(options.carry);
+    return replay_pairs(top, bottom, "synthetic", detector, detector, calc, options, pool, pairs, &top);
+}
+
+// mean and worst error against the generated truth, over the shots that solved
+static void print_accuracy(const std::vector<shot_row>& rows, int generated) {
+    int solved = 0, spun = 0;
+    double speed_sum = 0, speed_max = 0, angle_sum = 0, angle_max = 0, spin_sum = 0, spin_max = 0;
+    for (const auto& r : rows) {
+        if (!r.has_truth || !r.shot.valid) {
+            continue;
+        }
+        double speed = std::fabs(r.shot.speed_mph - r.truth.speed_mph);
+        double angle = std::fabs(r.shot.launch_angle_deg - r.truth.launch_angle_deg);
+        speed_sum += speed;
+        angle_sum += angle;
+        speed_max = std::max(speed_max, speed);
+        angle_max = std::max(angle_max, angle);
+        solved++;
+        if (r.shot.spin_measured) {
+            double spin = std::fabs(r.shot.spin_rpm - r.truth.spin_rpm);
+            spin_sum += spin;
+            spin_max = std::max(spin_max, spin);
+            spun++;
+        }
+    }
+    std::cout << "synthetic: " << generated << " shots generated, " << rows.size() << " triggered, " << solved << " solved";
+    if (solved > 0) {
+        std::cout << "; speed error mean " << speed_sum / solved << " max " << speed_max << " mph"
+                  << ", angle error mean " << angle_sum / solved << " max " << angle_max << " deg";
+    }
+    if (spun > 0) {
+        std::cout << "; spin measured on " << spun << ", error mean " << spin_sum / spun << " max " << spin_max << " rpm";
+    }
+    std::cout << std::endl;
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void write_csv(const std::string& path, const std::vector<shot_row>& rows) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "failed to write " << path << std::endl;
+        return;
+    }
+    file << "source,frames,found_top,found_bottom,valid,speed_mph,launch_angle_deg,carry_ft,total_ft,"
+            "apex_ft,descent_deg,spin_rpm,spin_measured,fit_points,fit_rms_px,fit_max_px,gate_ms,"
+            "recorded_valid,recorded_speed_mph,detect_ms,fps,searched,true_speed_mph,true_launch_angle_deg,true_spin_rpm\n";
+    for (const auto& r : rows) {
+        file << r.source << ',' << r.frames << ',' << r.found_top << ',' << r.found_bottom << ','
+             << r.shot.valid << ',' << r.shot.speed_mph << ',' << r.shot.launch_angle_deg << ','
+             << r.shot.carry_ft << ',' << r.shot.distance_ft << ',' << r.shot.apex_ft << ',' << r.shot.descent_deg << ','
+             << r.shot.spin_rpm << ',' << r.shot.spin_measured << ','
+             << r.shot.fit_points << ',' << r.shot.fit_rms_px << ',' << r.shot.fit_max_px << ',' << r.shot.gate_ms << ',';
+        if (r.has_recorded) file << r.recorded.valid << ',' << r.recorded.speed_mph << ',';
+        else file << ",,";
+        file << r.detect_ms << ',' << (r.detect_ms > 0 ? r.frames * 1000.0 / r.detect_ms : 0) << ',';
+        if (r.searched >= 0) file << r.searched;
+        file << ',';
+        if (r.has_truth) file << r.truth.speed_mph << ',' << r.truth.launch_angle_deg << ',' << r.truth.spin_rpm << '\n';
+        else file << ",,\n";
+    }
+    std::cout << "wrote " << rows.size() << " shots to " << path << std::endl;
+}
+
+static void write_json(const std::string& path, const std::vector<shot_row>& rows, int frames, double seconds) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "failed to write " << path << std::endl;
+        return;
+    }
+    file << "{\n  \"frames\": " << frames << ",\n  \"seconds\": " << seconds
+         << ",\n  \"fps\": " << (seconds > 0 ? frames / seconds : 0) << ",\n  \"shots\": [";
+    for (size_t i = 0; i < rows.size(); i++) {
+        const shot_row& r = rows[i];
+        file << (i ? ",\n" : "\n") << "    {\"source\": \"" << json_escape(r.source) << "\", \"frames\": " << r.frames
+             << ", \"found_top\": " << r.found_top << ", \"found_bottom\": " << r.found_bottom
+             << ", \"valid\": " << (r.shot.valid ? "true" : "false")
+             << ", \"speed_mph\": " << r.shot.speed_mph << ", \"launch_angle_deg\": " << r.shot.launch_angle_deg
+             << ", \"carry_ft\": " << r.shot.carry_ft << ", \"total_ft\": " << r.shot.distance_ft
+             << ", \"apex_ft\": " << r.shot.apex_ft << ", \"descent_deg\": " << r.shot.descent_deg
+             << ", \"spin_rpm\": " << r.shot.spin_rpm << ", \"spin_measured\": " << (r.shot.spin_measured ? "true" : "false")
+             << ", \"fit\": {\"points\": " << r.shot.fit_points << ", \"rms_px\": " << r.shot.fit_rms_px
+             << ", \"max_px\": " << r.shot.fit_max_px << ", \"gate_ms\": " << r.shot.gate_ms << "}";
+        if (r.has_recorded) {
+            file << ", \"recorded\": {\"valid\": " << (r.recorded.valid ? "true" : "false")
+                 << ", \"speed_mph\": " << r.recorded.speed_mph << "}";
+        }
+        if (r.has_truth) {
+            file << ", \"truth\": {\"speed_mph\": " << r.truth.speed_mph
+                 << ", \"launch_angle_deg\": " << r.truth.launch_angle_deg << ", \"spin_rpm\": " << r.truth.spin_rpm << "}";
+        }
+        file << ", \"detect_ms\": " << r.detect_ms;
+        if (r.searched >= 0) {
+            file << ", \"searched\": " << r.searched;
+        }
+        file << "}";
+    }
+    file << "\n  ]\n}\n";
+    std::cout << "wrote " << rows.size() << " shots to " << path << std::endl;
+}
+
+// "min:max", or one value for both
+static void parse_range(const std::string& s, float& low, float& high) {
+    size_t colon = s.find(':');
+    low = (float)atof(s.substr(0, colon).c_str());
+    high = colon == std::string::npos ? low : (float)atof(s.substr(colon + 1).c_str());
+    if (high < low) std::swap(low, high);
+}
+
+static void usage() {
+    std::cout << "usage: launch_monitor_replay [options] <shot.lmshot|dir>...\n"
+              << "       launch_monitor_replay [options] --top <dir|video> --bottom <dir|video>\n"
+              << "       launch_monitor_replay [options] --synthetic <shots>\n"
+              << "  -c <file>              app config (default launch_monitor.conf, if present)\n"
+              << "  --no-background        detect on raw frames even if the config enables the background model\n"
+              << "  --csv <file>           per-shot metrics as csv\n"
+              << "  --json <file>          per-shot metrics and throughput as json\n"
+              << "  --threshold <n>        override the recorded detector settings\n"
+              << "  --circularity <f>\n"
+              << "  --min-area <f>\n"
+              << "  --max-area <f>\n"
+              << "  --engine contours|components\n"
+              << "  --swap                 swap cameras for the shot math\n"
+              << "  --fps <n>              frame rate stamped on raw input (default 120)\n"
+              << "  --flip-top, --flip-bottom\n"
+              << "  --carry-table <file>   cached flight table, built there if missing (default carry_table.bin)\n"
+              << "generated scenes:\n"
+              << "  --seed <n>             scene and shot seed (default 1)\n"
+              << "  --speed <min:max>      launch speed range in mph (default 20:80)\n"
+              << "  --angle <min:max>      launch angle range in degrees (default 5:30)\n"
+              << "  --spin <min:max>       backspin range in rpm (default 2000:8000)\n"
+              << "  --exposure <f>         shutter open share of the frame period, for motion blur (default 0.02)\n"
+              << "  --noise <sigma>        sensor noise in gray levels (default 4)\n"
+              << "  --hot-spots <n>        static bright specks per camera (default 3)\n"
+              << "  --drops <p>            chance of losing any one frame (default 0)\n";
+}
+
+int main(int argc, char** argv) {
+    replay_options options;
+    bool no_background = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-c" && has_value) options.config_path = argv[++i];
+        else if (arg == "--csv" && has_value) options.csv_path = argv[++i];
+        else if (arg == "--json" && has_value) options.json_path = argv[++i];
+        else if (arg == "--top" && has_value) options.top_source = argv[++i];
+        else if (arg == "--bottom" && has_value) options.bottom_source = argv[++i];
+        else if (arg == "--threshold" && has_value) options.overrides.threshold = atoi(argv[++i]);
+        else if (arg == "--circularity" && has_value) options.overrides.circularity = (float)atof(argv[++i]);
+        else if (arg == "--min-area" && has_value) options.overrides.min_area = (float)atof(argv[++i]);
+        else if (arg == "--max-area" && has_value) options.overrides.max_area = (float)atof(argv[++i]);
+        else if (arg == "--engine" && has_value) options.overrides.engine = std::string(argv[++i]) == "components" ? 1 : 0;
+        else if (arg == "--carry-table" && has_value) options.carry_table_path = argv[++i];
+        else if (arg == "--fps" && has_value) options.fps = std::max(1, atoi(argv[++i]));
+        else if (arg == "--synthetic" && has_value) options.synthetic = std::max(0, atoi(argv[++i]));
+        else if (arg == "--seed" && has_value) options.seed = std::stoull(argv[++i]);
+        else if (arg == "--speed" && has_value) parse_range(argv[++i], options.min_speed, options.max_speed);
+        else if (arg == "--angle" && has_value) parse_range(argv[++i], options.min_angle, options.max_angle);
+        else if (arg == "--spin" && has_value) parse_range(argv[++i], options.min_spin, options.max_spin);
+        else if (arg == "--exposure" && has_value) options.rig.exposure = (float)atof(argv[++i]);
+        else if (arg == "--noise" && has_value) options.rig.noise_sigma = (float)atof(argv[++i]);
+        else if (arg == "--hot-spots" && has_value) options.rig.hot_spots = std::max(0, atoi(argv[++i]));
+        else if (arg == "--drops" && has_value) options.rig.drop_rate = (float)atof(argv[++i]);
+        else if (arg == "--swap") options.swap = true;
+        else if (arg == "--no-background") no_background = true;
+        else if (arg == "--flip-top") options.flip_top = true;
+        else if (arg == "--flip-bottom") options.flip_bottom = true;
+        else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else {
+            collect_recordings(arg, options.recordings);
+        }
+    }
+    bool raw = !options.top_source.empty() && !options.bottom_source.empty();
+    if (options.recordings.empty() && !raw && options.synthetic == 0) {
+        usage();
+        return 1;
+    }
+
+    app_config config;
+    struct stat st;
+    if (stat(options.config_path.c_str(), &st) == 0) {
+        config.load(options.config_path);
+    }
+    options.background = config.background_model && !no_background;
+
+    worker_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    options.carry = load_carry_table(options.carry_table_path, flight_conditions(), &pool);
+    std::vector<shot_row> rows;
+    int frames = 0;
+
+    replay_clock::time_point start = replay_clock::now();
+    if (raw) {
+        int pairs = 0;
+        rows = replay_sources(options, pool, pairs);
+        frames = pairs;
+    }
+    if (options.synthetic > 0) {
+        int pairs = 0;
+        std::vector<shot_row> generated = replay_synthetic(options, pool, pairs);
+        rows.insert(rows.end(), generated.begin(), generated.end());
+        frames += pairs;
+    }
+    for (const auto& path : options.recordings) {
+        shot_row row = replay_recording(path, options, pool);
+        frames += row.frames;
+        rows.push_back(row);
+    }
+    double seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+
+    for (const auto& r : rows) {
+        std::cout << r.source << ": " << r.found_top << "/" << r.found_bottom << " found in " << r.frames << " frames, ";
+        if (r.shot.valid) {
+            std::cout << r.shot.speed_mph << " mph " << r.shot.launch_angle_deg << " deg " << r.shot.carry_ft << " ft "
+                      << r.shot.spin_rpm << " rpm" << (r.shot.spin_measured ? "" : " (default)")
+                      << ", fit " << r.shot.fit_points << " points rms " << r.shot.fit_rms_px << " px";
+        } else {
+            std::cout << "no shot";
+        }
+        if (r.has_recorded && r.recorded.valid) {
+            std::cout << " (recorded " << r.recorded.speed_mph << " mph)";
+        }
+        if (r.has_truth) {
+            std::cout << " (true " << r.truth.speed_mph << " mph " << r.truth.launch_angle_deg << " deg "
+                      << r.truth.spin_rpm << " rpm)";
+        }
+        std::cout << std::endl;
+    }
+    if (options.synthetic > 0) {
+        print_accuracy(rows, options.synthetic);
+    }
+    std::cout << rows.size() << " shots, " << frames << " frame pairs in " << seconds << " s, "
+              << (seconds > 0 ? frames / seconds : 0) << " pairs/s" << std::endl;
+
+    if (!options.csv_path.empty()) {
+        write_csv(options.csv_path, rows);
+    }
+    if (!options.json_path.empty()) {
+        write_json(options.json_path, rows, frames, seconds);
+    }
+    return 0;
+}
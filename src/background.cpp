@@ -0,0 +1,231 @@
+#include "background.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BACKGROUND_X86 1
+#endif
+
+struct background_kernels {
+    const char* isa;
+    // fold n pixels of a frame into mean and variance, then refresh their floor
+    void (*update)(const uint8_t* src, float* mean, float* variance, uint8_t* floor, int n,
+                   float rate, float deviations, float min_variance);
+    // src where it is above floor, else 0
+    void (*subtract)(const uint8_t* src, const uint8_t* floor, uint8_t* dst, int n);
+};
+
+// scalar versions, also used for the tail of each simd row
+
+static void update_scalar_from(const uint8_t* src, float* mean, float* variance, uint8_t* floor, int x, int n,
+                               float rate, float deviations, float min_variance) {
+    for (; x < n; x++) {
+        float d = src[x] - mean[x];
+        mean[x] += rate * d;
+        variance[x] = (1.0f - rate) * (variance[x] + rate * d * d);
+        float level = mean[x] + deviations * std::sqrt(std::max(variance[x], min_variance));
+        floor[x] = (uint8_t)std::min(255.0f, std::nearbyint(level));
+    }
+}
+
+static void subtract_scalar_from(const uint8_t* src, const uint8_t* floor, uint8_t* dst, int x, int n) {
+    for (; x < n; x++) {
+        dst[x] = src[x] > floor[x] ? src[x] : 0;
+    }
+}
+
+static void update_scalar(const uint8_t* src, float* mean, float* variance, uint8_t* floor, int n,
+                          float rate, float deviations, float min_variance) {
+    update_scalar_from(src, mean, variance, floor, 0, n, rate, deviations, min_variance);
+}
+
+static void subtract_scalar(const uint8_t* src, const uint8_t* floor, uint8_t* dst, int n) {
+    subtract_scalar_from(src, floor, dst, 0, n);
+}
+
+#ifdef BACKGROUND_X86
+
+// four pixels of the model, as update_scalar_from; returns the floor as int32
+__attribute__((target("sse2")))
+static inline __m128i update4_sse2(__m128i pixels, float* mean, float* variance,
+                                   __m128 rate, __m128 keep, __m128 deviations, __m128 min_variance) {
+    __m128 m = _mm_loadu_ps(mean);
+    __m128 v = _mm_loadu_ps(variance);
+    __m128 d = _mm_sub_ps(_mm_cvtepi32_ps(pixels), m);
+    m = _mm_add_ps(m, _mm_mul_ps(rate, d));
+    v = _mm_mul_ps(keep, _mm_add_ps(v, _mm_mul_ps(rate, _mm_mul_ps(d, d))));
+    _mm_storeu_ps(mean, m);
+    _mm_storeu_ps(variance, v);
+    __m128 level = _mm_add_ps(m, _mm_mul_ps(deviations, _mm_sqrt_ps(_mm_max_ps(v, min_variance))));
+    return _mm_cvtps_epi32(level);
+}
+
+__attribute__((target("sse2")))
+static void update_sse2(const uint8_t* src, float* mean, float* variance, uint8_t* floor, int n,
+                        float rate, float deviations, float min_variance) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 r = _mm_set1_ps(rate);
+    const __m128 keep = _mm_set1_ps(1.0f - rate);
+    const __m128 k = _mm_set1_ps(deviations);
+    const __m128 lo = _mm_set1_ps(min_variance);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i p_lo = _mm_unpacklo_epi8(p, zero);
+        __m128i p_hi = _mm_unpackhi_epi8(p, zero);
+        __m128i f0 = update4_sse2(_mm_unpacklo_epi16(p_lo, zero), mean + x, variance + x, r, keep, k, lo);
+        __m128i f1 = update4_sse2(_mm_unpackhi_epi16(p_lo, zero), mean + x + 4, variance + x + 4, r, keep, k, lo);
+        __m128i f2 = update4_sse2(_mm_unpacklo_epi16(p_hi, zero), mean + x + 8, variance + x + 8, r, keep, k, lo);
+        __m128i f3 = update4_sse2(_mm_unpackhi_epi16(p_hi, zero), mean + x + 12, variance + x + 12, r, keep, k, lo);
+        // saturating packs clamp the floor to 0..255 on the way down
+        _mm_storeu_si128((__m128i*)(floor + x), _mm_packus_epi16(_mm_packs_epi32(f0, f1), _mm_packs_epi32(f2, f3)));
+    }
+    update_scalar_from(src, mean, variance, floor, x, n, rate, deviations, min_variance);
+}
+
+__attribute__((target("sse2")))
+static void subtract_sse2(const uint8_t* src, const uint8_t* floor, uint8_t* dst, int n) {
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i f = _mm_loadu_si128((const __m128i*)(floor + x));
+        // no unsigned compare in sse2: p <= f exactly where max(p, f) == f
+        __m128i below = _mm_cmpeq_epi8(_mm_max_epu8(p, f), f);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_andnot_si128(below, p));
+    }
+    subtract_scalar_from(src, floor, dst, x, n);
+}
+
+__attribute__((target("avx2")))
+static void update_avx2(const uint8_t* src, float* mean, float* variance, uint8_t* floor, int n,
+                        float rate, float deviations, float min_variance) {
+    const __m256 r = _mm256_set1_ps(rate);
+    const __m256 keep = _mm256_set1_ps(1.0f - rate);
+    const __m256 k = _mm256_set1_ps(deviations);
+    const __m256 lo = _mm256_set1_ps(min_variance);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)));
+        __m256 m = _mm256_loadu_ps(mean + x);
+        __m256 v = _mm256_loadu_ps(variance + x);
+        __m256 d = _mm256_sub_ps(_mm256_cvtepi32_ps(p), m);
+        m = _mm256_add_ps(m, _mm256_mul_ps(r, d));
+        v = _mm256_mul_ps(keep, _mm256_add_ps(v, _mm256_mul_ps(r, _mm256_mul_ps(d, d))));
+        _mm256_storeu_ps(mean + x, m);
+        _mm256_storeu_ps(variance + x, v);
+        __m256 level = _mm256_add_ps(m, _mm256_mul_ps(k, _mm256_sqrt_ps(_mm256_max_ps(v, lo))));
+        __m256i f = _mm256_cvtps_epi32(level);
+        // packing works per 128-bit lane, so take the halves apart first
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(f), _mm256_extracti128_si256(f, 1));
+        _mm_storel_epi64((__m128i*)(floor + x), _mm_packus_epi16(words, words));
+    }
+    update_scalar_from(src, mean, variance, floor, x, n, rate, deviations, min_variance);
+}
+
+__attribute__((target("avx2")))
+static void subtract_avx2(const uint8_t* src, const uint8_t* floor, uint8_t* dst, int n) {
+    int x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + x));
+        __m256i f = _mm256_loadu_si256((const __m256i*)(floor + x));
+        __m256i below = _mm256_cmpeq_epi8(_mm256_max_epu8(p, f), f);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_andnot_si256(below, p));
+    }
+    subtract_scalar_from(src, floor, dst, x, n);
+}
+
+#endif
+
+static const background_kernels scalar_kernels = { "scalar", update_scalar, subtract_scalar };
+
+#ifdef BACKGROUND_X86
+static const background_kernels sse2_kernels = { "sse2", update_sse2, subtract_sse2 };
+static const background_kernels avx2_kernels = { "avx2", update_avx2, subtract_avx2 };
+#endif
+
+static const background_kernels* select_kernels() {
+#ifdef BACKGROUND_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static const background_kernels* active_kernels = select_kernels();
+
+const char* background_kernel_isa() {
+    return active_kernels->isa;
+}
+
+bool force_background_kernel_isa(const std::string& isa) {
+    if (isa == "scalar") {
+        active_kernels = &scalar_kernels;
+        return true;
+    }
+#ifdef BACKGROUND_X86
+    if (isa == "sse2" && __builtin_cpu_supports("sse2")) {
+        active_kernels = &sse2_kernels;
+        return true;
+    }
+    if (isa == "avx2" && __builtin_cpu_supports("avx2")) {
+        active_kernels = &avx2_kernels;
+        return true;
+    }
+#endif
+    return false;
+}
+
+background_model::background_model(float rate, float deviations, float min_sigma, int warmup)
+    : width(0)
+    , height(0)
+    , learnt(0)
+    , rate(rate)
+    , deviations(deviations)
+    , min_sigma(min_sigma)
+    , warmup(warmup)
+{
+}
+
+void background_model::reset() {
+    learnt = 0;
+}
+
+void background_model::update(const cv::Mat& gray) {
+    CV_Assert(gray.type() == CV_8UC1);
+    if (!matches(gray)) {
+        width = gray.cols;
+        height = gray.rows;
+        size_t n = (size_t)width * height;
+        mean.assign(n, 0.0f);
+        variance.assign(n, 0.0f);
+        floor.assign(n, 255);
+        learnt = 0;
+    }
+    // the first frame is taken whole; after that the running mean starts
+    // fast and settles to `rate`, so a fresh model is usable within warmup
+    float weight = std::max(rate, 1.0f / (learnt + 1));
+    float min_variance = min_sigma * min_sigma;
+    for (int y = 0; y < height; y++) {
+        size_t row = (size_t)y * width;
+        active_kernels->update(gray.ptr<uint8_t>(y), &mean[row], &variance[row], &floor[row], width,
+                               weight, deviations, min_variance);
+    }
+    learnt++;
+}
+
+void background_model::subtract(const cv::Mat& gray, cv::Rect window, cv::Mat& foreground) const {
+    CV_Assert(gray.type() == CV_8UC1 && matches(gray));
+    window &= cv::Rect(0, 0, width, height);
+    foreground.create(window.size(), CV_8UC1);
+    for (int y = 0; y < window.height; y++) {
+        size_t row = (size_t)(window.y + y) * width + window.x;
+        active_kernels->subtract(gray.ptr<uint8_t>(window.y + y) + window.x, &floor[row],
+                                 foreground.ptr<uint8_t>(y), window.width);
+    }
+}
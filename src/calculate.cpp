@@ -1,13 +1,17 @@
 #include "calculate.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
-shot_calculator::shot_calculator() {
+shot_calculator::shot_calculator()
+    : default_spin_rpm(3000)
+{
     calibration = camera_calibration();
 }
 
 shot_calculator::shot_calculator(const camera_calibration& cal) 
     : calibration(cal) 
+    , default_spin_rpm(3000)
 {
 }
 
@@ -22,53 +26,201 @@ float shot_calculator::pixel_distance(const cv::Point2f& p1, const cv::Point2f&
     return sqrt(dx * dx + dy * dy);
 }
 
+static const double gravity_ips2 = 386.09;
+// a detection further than this off the fitted path loses weight in proportion
+static const double huber_px = 2.0;
+
+trajectory_fit fit_trajectory(const std::vector<trajectory_point>& points) {
+    trajectory_fit fit;
+    double s = 0, st = 0, stt = 0, sx = 0, stx = 0, sz = 0, stz = 0;
+    for (const auto& p : points) {
+        s += p.weight;
+        st += p.weight * p.t;
+        stt += p.weight * p.t * p.t;
+        sx += p.weight * p.x;
+        stx += p.weight * p.t * p.x;
+        sz += p.weight * p.z;
+        stz += p.weight * p.t * p.z;
+    }
+    // everything at one instant says nothing about velocity
+    double det = s * stt - st * st;
+    if (s <= 0 || det <= 1e-12 * s * s) {
+        return fit;
+    }
+    fit.vx = (s * stx - st * sx) / det;
+    fit.x0 = (sx - fit.vx * st) / s;
+    fit.vz = (s * stz - st * sz) / det;
+    fit.z0 = (sz - fit.vz * st) / s;
+    fit.ok = true;
+    return fit;
+}
+
+static float median_radius(const std::vector<ball_detection>& detections) {
+    std::vector<float> radii;
+    for (const auto& d : detections) {
+        if (d.found) radii.push_back(d.radius);
+    }
+    if (radii.empty()) {
+        return 0;
+    }
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    return radii[radii.size() / 2];
+}
+
+// round, and the same size as the camera's other sightings; a clipped ball at
+// the frame edge or a merged blob fails the second and its centre is suspect
+static double detection_weight(const ball_detection& d, float typical_radius) {
+    double weight = d.circularity > 0 ? std::min(1.0f, d.circularity) : 1.0;
+    if (typical_radius > 0 && d.radius > 0) {
+        weight *= std::min(d.radius, typical_radius) / std::max(d.radius, typical_radius);
+    }
+    return weight;
+}
+
+float shot_calculator::image_direction(const std::vector<ball_detection>& top_camera,
+                                       const std::vector<ball_detection>& bottom_camera) {
+    float travel = 0;
+    for (const auto* camera : { &top_camera, &bottom_camera }) {
+        const ball_detection* first = nullptr;
+        const ball_detection* last = nullptr;
+        for (const auto& d : *camera) {
+            if (!d.found) continue;
+            if (!first) first = &d;
+            last = &d;
+        }
+        if (first && last != first) {
+            travel += last->position.x - first->position.x;
+        }
+    }
+    // one sighting per camera can't tell, assume left to right
+    return travel < 0 ? -1.0f : 1.0f;
+}
+
+std::vector<trajectory_point> shot_calculator::to_rig(const std::vector<ball_detection>& top_camera,
+                                                      const std::vector<ball_detection>& bottom_camera,
+                                                      float direction, capture_clock::time_point origin) {
+    std::vector<trajectory_point> points;
+    const std::vector<ball_detection>* cameras[2] = { &bottom_camera, &top_camera };
+    const double plane_x[2] = { 0.0, calibration.distance_between_inches };
+    for (int c = 0; c < 2; c++) {
+        float typical = median_radius(*cameras[c]);
+        for (const auto& d : *cameras[c]) {
+            if (!d.found) {
+                continue;
+            }
+            trajectory_point p;
+            p.t = std::chrono::duration<double>(d.timestamp - origin).count();
+            p.x = plane_x[c] + direction * (d.position.x - calibration.tee_column) / calibration.pixels_per_inch;
+            p.z = -d.position.y / calibration.pixels_per_inch + 0.5 * gravity_ips2 * p.t * p.t;
+            p.weight = detection_weight(d, typical);
+            points.push_back(p);
+        }
+    }
+    return points;
+}
+
 shot_data shot_calculator::calculate_shot(
     const std::vector<ball_detection>& top_camera,
-    const std::vector<ball_detection>& bottom_camera
+    const std::vector<ball_detection>& bottom_camera,
+    const spin_estimate* spin
 ) {
     shot_data result;
 
-    if (top_camera.size() < 2 || bottom_camera.size() < 2) {
-        std::cout << "not enough detections (need 2+ per camera)" << std::endl;
+    int found_top = 0, found_bottom = 0;
+    capture_clock::time_point origin = capture_clock::time_point::max();
+    for (const auto& d : top_camera) {
+        if (!d.found) continue;
+        found_top++;
+        origin = std::min(origin, d.timestamp);
+    }
+    for (const auto& d : bottom_camera) {
+        if (!d.found) continue;
+        found_bottom++;
+        origin = std::min(origin, d.timestamp);
+    }
+    if (found_top < 1 || found_bottom < 1) {
+        std::cout << "not enough detections (need 1+ per camera)" << std::endl;
         return result;
     }
 
-    const ball_detection& first_det = bottom_camera.front();
-    const ball_detection& last_det = top_camera.back();
-
-    if (!first_det.found || !last_det.found) {
-        std::cout << "invalid detections" << std::endl;
-        return result;
+    std::vector<trajectory_point> points = to_rig(top_camera, bottom_camera,
+                                                  image_direction(top_camera, bottom_camera), origin);
+    std::vector<double> base_weights;
+    for (const auto& p : points) {
+        base_weights.push_back(p.weight);
     }
 
-    double time_seconds = time_between(first_det, last_det);
+    // fit, then refit with outliers down-weighted by how far off they sit
+    trajectory_fit fit = fit_trajectory(points);
+    std::vector<double> residual_px(points.size(), 0.0);
+    for (int pass = 0; pass < 3 && fit.ok; pass++) {
+        for (size_t i = 0; i < points.size(); i++) {
+            const trajectory_point& p = points[i];
+            double dx = p.x - (fit.x0 + fit.vx * p.t);
+            double dz = p.z - (fit.z0 + fit.vz * p.t);
+            residual_px[i] = std::sqrt(dx * dx + dz * dz) * calibration.pixels_per_inch;
+        }
+        if (pass == 2) {
+            break;
+        }
+        for (size_t i = 0; i < points.size(); i++) {
+            points[i].weight = base_weights[i] * (residual_px[i] > huber_px ? huber_px / residual_px[i] : 1.0);
+        }
+        fit = fit_trajectory(points);
+    }
 
-    if (time_seconds <= 0 || time_seconds > 1.0) {
-        std::cout << "invalid time: " << time_seconds << "s" << std::endl;
+    if (!fit.ok || fit.vx <= 0) {
+        std::cout << "invalid trajectory: " << points.size() << " points, "
+                  << (fit.ok ? "moving back up range" : "all at one instant") << std::endl;
         return result;
     }
 
-    float horizontal_distance_inches = calibration.distance_between_inches;
-    float horizontal_speed_ips = horizontal_distance_inches / time_seconds;
-    result.speed_mph = horizontal_speed_ips * 0.0568182;
-
-    float vertical_pixels = first_det.position.y - last_det.position.y;
-    float vertical_inches = vertical_pixels / calibration.pixels_per_inch;
-
-    result.launch_angle_deg = atan2(vertical_inches, horizontal_distance_inches) * 180.0 / CV_PI;
+    // the ball leaves the tee at x = 0 and is distance further on at the top camera
+    double t_launch = -fit.x0 / fit.vx;
+    double gate_seconds = calibration.distance_between_inches / fit.vx;
+    if (gate_seconds > 1.0) {
+        std::cout << "invalid time: " << gate_seconds << "s" << std::endl;
+        return result;
+    }
 
-    float speed_fps = result.speed_mph * 1.46667;
-    float angle_rad = result.launch_angle_deg * CV_PI / 180.0;
-    float gravity = 32.174;
+    double vz = fit.vz - gravity_ips2 * t_launch;
+    double speed_ips = std::sqrt(fit.vx * fit.vx + vz * vz);
+    result.speed_mph = speed_ips * 0.0568182;
+    result.launch_angle_deg = atan2(vz, fit.vx) * 180.0 / CV_PI;
 
-    result.carry_ft = (speed_fps * speed_fps * sin(2.0 * angle_rad)) / gravity;
-    result.distance_ft = result.carry_ft;
+    double sum_sq = 0, worst = 0;
+    for (double r : residual_px) {
+        sum_sq += r * r;
+        worst = std::max(worst, r);
+    }
+    result.fit_points = (int)points.size();
+    result.fit_rms_px = (float)std::sqrt(sum_sq / points.size());
+    result.fit_max_px = (float)worst;
+    result.gate_ms = (float)(gate_seconds * 1000.0);
+
+    result.spin_rpm = default_spin_rpm;
+    if (spin && spin->ok) {
+        result.spin_rpm = spin->rpm;
+        result.spin_measured = true;
+        result.spin_confidence = spin->confidence;
+    }
+    flight_result flight = carry
+        ? carry->lookup(result.speed_mph, result.launch_angle_deg, result.spin_rpm)
+        : simulate_flight(result.speed_mph, result.launch_angle_deg, result.spin_rpm, conditions);
+    result.carry_ft = flight.carry_ft;
+    result.distance_ft = flight.total_ft;
+    result.apex_ft = flight.apex_ft;
+    result.descent_deg = flight.descent_deg;
     result.valid = true;
     std::cout << "shot calculated:" << std::endl;
-    std::cout << "  time: " << time_seconds << "s" << std::endl;
+    std::cout << "  fit: " << found_bottom << " bottom + " << found_top << " top detections, rms "
+              << result.fit_rms_px << " px, max " << result.fit_max_px << " px" << std::endl;
+    std::cout << "  gate: " << result.gate_ms << " ms" << std::endl;
     std::cout << "  speed: " << result.speed_mph << " mph" << std::endl;
     std::cout << "  launch angle: " << result.launch_angle_deg << " deg" << std::endl;
-    std::cout << "  distance: " << result.distance_ft << " ft" << std::endl;
+    std::cout << "  spin: " << result.spin_rpm << " rpm" << (result.spin_measured ? "" : " (default)") << std::endl;
+    std::cout << "  carry: " << result.carry_ft << " ft, total " << result.distance_ft << " ft" << std::endl;
+    std::cout << "  apex: " << result.apex_ft << " ft, descent " << result.descent_deg << " deg" << std::endl;
     
     return result;
 }
@@ -81,6 +233,16 @@ void shot_calculator::set_pixels_per_inch(float ppi) {
     calibration.pixels_per_inch = ppi;
 }
 
+void shot_calculator::set_tee_column(float column) {
+    calibration.tee_column = column;
+}
+
 void shot_calculator::set_frame_rate(float fps) {
     calibration.frame_rate = fps;
-}
\ No newline at end of file
+}
+void shot_calculator::set_carry_table(std::shared_ptr<const carry_table> table) {
+    carry = table;
+    if (carry) {
+        conditions = carry->get_conditions();
+    }
+}
@@ -0,0 +1,233 @@
+#include "capture.h"
+#include "synthetic.h"
+#include <chrono>
+#include <iostream>
+
+opencv_source::opencv_source(int device, const capture_settings& settings)
+    : device(device)
+    , settings(settings)
+    , next_sequence(0)
+{
+}
+
+bool opencv_source::open() {
+    if (!cap.open(device, cv::CAP_V4L2)) {
+        std::cerr << "failed to open /dev/video" << device << std::endl;
+        return false;
+    }
+
+    cap.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M','J','P','G'));
+    cap.set(cv::CAP_PROP_FRAME_WIDTH, settings.width);
+    cap.set(cv::CAP_PROP_FRAME_HEIGHT, settings.height);
+    cap.set(cv::CAP_PROP_FPS, settings.fps);
+    cap.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.25);
+    cap.set(cv::CAP_PROP_EXPOSURE, -6);
+
+    // hand back the raw jpeg so it goes through the luma-only decoder
+    cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
+    return true;
+}
+
+capture_clock::time_point opencv_source::buffer_timestamp() {
+    capture_clock::time_point now = capture_clock::now();
+
+    // the v4l2 backend reports the driver buffer timestamp (CLOCK_MONOTONIC) as
+    // POS_MSEC. anything missing or not on the monotonic clock falls back to now
+    double msec = cap.get(cv::CAP_PROP_POS_MSEC);
+    if (msec <= 0) {
+        return now;
+    }
+    capture_clock::time_point stamp(std::chrono::duration_cast<capture_clock::duration>(
+        std::chrono::duration<double, std::milli>(msec)));
+    if (stamp > now || now - stamp > std::chrono::seconds(1)) {
+        return now;
+    }
+    return stamp;
+}
+
+bool opencv_source::read(frame_envelope& frame) {
+    if (!cap.read(frame.image) || frame.image.empty()) {
+        return false;
+    }
+    frame.timestamp = buffer_timestamp();
+    frame.sequence = next_sequence++;
+    if (frame.image.rows == 1) {
+        frame.format = frame_format::mjpeg;
+    } else {
+        frame.format = frame.image.channels() == 3 ? frame_format::bgr : frame_format::gray;
+    }
+    frame.lease.reset();
+    return true;
+}
+
+std::string opencv_source::describe() const {
+    return "opencv:" + std::to_string(device);
+}
+
+std::unique_ptr<capture_source> make_capture_source(const std::string& spec, const capture_settings& settings) {
+    if (spec.compare(0, 5, "/dev/") == 0) {
+        return std::unique_ptr<capture_source>(new v4l2_source(spec, settings));
+    }
+    if (spec.compare(0, 7, "opencv:") == 0) {
+        return std::unique_ptr<capture_source>(new opencv_source(std::stoi(spec.substr(7)), settings));
+    }
+    if (spec.compare(0, 10, "synthetic:") == 0) {
+        return make_synthetic_source(spec, settings);
+    }
+    return std::unique_ptr<capture_source>(new file_source(spec, settings));
+}
+
+bool convert_to_gray(frame_envelope& frame, mjpeg_decoder& decoder, frame_pool& pool) {
+    if (frame.image.empty()) {
+        return false;
+    }
+    if (frame.format == frame_format::gray && !frame.lease) {
+        return true;
+    }
+
+    cv::Mat gray = pool.acquire();
+    const uchar* target = gray.data;
+    switch (frame.format) {
+    case frame_format::gray:
+        frame.image.copyTo(gray);
+        break;
+    case frame_format::bgr:
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+        break;
+    case frame_format::yuyv:
+        cv::extractChannel(frame.image, gray, 0);
+        break;
+    case frame_format::mjpeg:
+        if (!decoder.decode(frame.image, gray)) {
+            return false;
+        }
+        break;
+    }
+    if (gray.empty()) {
+        return false;
+    }
+    if (gray.data != target) {
+        pool.count_miss();
+    }
+
+    // the converted image owns its memory, so any driver buffer can go back now
+    frame.image = gray;
+    frame.format = frame_format::gray;
+    frame.lease.reset();
+    return true;
+}
+
+camera_capture::camera_capture(const std::string& name, std::unique_ptr<capture_source> source, int pool_frames)
+    : name(name)
+    , source(std::move(source))
+    , pool_frames(pool_frames)
+    , running(false)
+    , frames_captured(0)
+    , frames_dropped(0)
+    , interval_time(nullptr)
+    , decode_time(nullptr)
+    , lost_count(nullptr)
+    , duplicate_count(nullptr)
+    , ring_full_count(nullptr)
+    , have_last(false)
+    , last_sequence(0)
+{
+}
+
+camera_capture::~camera_capture() {
+    stop();
+}
+
+bool camera_capture::open() {
+    if (!source || !source->open()) {
+        std::cerr << name << " failed to open " << (source ? source->describe() : "(none)") << std::endl;
+        return false;
+    }
+
+    frame_envelope test;
+    bool got = false;
+    for (int attempt = 0; attempt < 10 && !got; attempt++) {
+        got = source->read(test) && convert_to_gray(test, decoder, pool);
+    }
+    if (!got) {
+        std::cerr << name << " opened " << source->describe() << " but returned no frame" << std::endl;
+        return false;
+    }
+    pool.reserve(test.image.size(), CV_8UC1, pool_frames);
+    std::cout << name << " ok: " << source->describe() << " "
+              << test.image.cols << "x" << test.image.rows << std::endl;
+    return true;
+}
+
+void camera_capture::set_metrics(metrics_registry& registry) {
+    interval_time = &registry.histogram(name + ".capture_interval");
+    decode_time = &registry.histogram(name + ".decode");
+    lost_count = &registry.counter(name + ".lost");
+    duplicate_count = &registry.counter(name + ".duplicate");
+    ring_full_count = &registry.counter(name + ".ring_full");
+}
+
+void camera_capture::start() {
+    if (running.load() || !is_open()) {
+        return;
+    }
+    running = true;
+    worker = std::thread(&camera_capture::run, this);
+}
+
+void camera_capture::stop() {
+    running = false;
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool camera_capture::pop(frame_envelope& frame) {
+    return ring.pop(frame);
+}
+
+void camera_capture::run() {
+    while (running.load(std::memory_order_relaxed)) {
+        frame_envelope frame;
+        if (!source->read(frame)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        capture_clock::time_point begin = capture_clock::now();
+        if (!convert_to_gray(frame, decoder, pool)) {
+            continue;
+        }
+        if (decode_time) {
+            decode_time->record(capture_clock::now() - begin);
+        }
+        account(frame);
+        frames_captured++;
+
+        // the consumer is behind by a full ring, newest frame loses
+        if (!ring.push(std::move(frame))) {
+            frames_dropped++;
+            if (ring_full_count) ring_full_count->add();
+        }
+    }
+}
+
+// sequence gaps are frames lost before they reached us (driver, bus or
+// source), a repeat is the same frame handed over twice
+void camera_capture::account(const frame_envelope& frame) {
+    if (!interval_time) {
+        return;
+    }
+    if (have_last) {
+        if (frame.sequence <= last_sequence || frame.timestamp <= last_timestamp) {
+            duplicate_count->add();
+            return;
+        }
+        if (frame.sequence > last_sequence + 1) {
+            lost_count->add(frame.sequence - last_sequence - 1);
+        }
+        interval_time->record(frame.timestamp - last_timestamp);
+    }
+    have_last = true;
+    last_sequence = frame.sequence;
+    last_timestamp = frame.timestamp;
+}
@@ -0,0 +1,115 @@
+#include "decode.h"
+#include <iostream>
+
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+
+struct jpeg_error_trap {
+    jpeg_error_mgr mgr;
+    std::jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    jpeg_error_trap* trap = reinterpret_cast<jpeg_error_trap*>(cinfo->err);
+    std::longjmp(trap->jump, 1);
+}
+
+// corrupt mjpeg frames are common on usb cameras, don't spam stderr
+static void jpeg_output_message(j_common_ptr) {
+}
+
+struct mjpeg_decoder_state {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_trap error;
+
+    mjpeg_decoder_state() {
+        cinfo.err = jpeg_std_error(&error.mgr);
+        error.mgr.error_exit = jpeg_error_exit;
+        error.mgr.output_message = jpeg_output_message;
+        jpeg_create_decompress(&cinfo);
+    }
+    ~mjpeg_decoder_state() {
+        jpeg_destroy_decompress(&cinfo);
+    }
+};
+#else
+struct mjpeg_decoder_state {
+};
+#endif
+
+mjpeg_decoder::mjpeg_decoder(int scale_denom, bool fast_idct)
+    : state(new mjpeg_decoder_state())
+    , scale_denom(1)
+    , fast_idct(fast_idct)
+{
+    set_scale(scale_denom);
+}
+
+mjpeg_decoder::~mjpeg_decoder() {
+}
+
+void mjpeg_decoder::set_scale(int denom) {
+    if (denom == 1 || denom == 2 || denom == 4 || denom == 8) {
+        scale_denom = denom;
+    }
+}
+
+bool mjpeg_decoder::decode(const cv::Mat& encoded, cv::Mat& gray) {
+    if (encoded.empty() || !encoded.isContinuous()) {
+        return false;
+    }
+    return decode(encoded.data, encoded.total() * encoded.elemSize(), gray);
+}
+
+#ifdef HAVE_LIBJPEG
+bool mjpeg_decoder::decode(const uint8_t* data, size_t size, cv::Mat& gray) {
+    jpeg_decompress_struct& cinfo = state->cinfo;
+
+    if (setjmp(state->error.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), (unsigned long)size);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    // asking for grayscale out of a ycbcr stream makes libjpeg skip the chroma
+    // idct, upsampling and colour conversion entirely
+    cinfo.out_color_space = JCS_GRAYSCALE;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+    cinfo.dct_method = fast_idct ? JDCT_IFAST : JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.do_block_smoothing = FALSE;
+
+    jpeg_start_decompress(&cinfo);
+
+    // reuses the caller's buffer when it is already the right shape
+    gray.create(cinfo.output_height, cinfo.output_width, CV_8UC1);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = gray.ptr<uchar>(cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    return true;
+}
+#else
+bool mjpeg_decoder::decode(const uint8_t* data, size_t size, cv::Mat& gray) {
+    // without libjpeg fall back to opencv, which still decodes luma only when
+    // asked for grayscale but allocates and sets up a decoder per frame
+    int flags = cv::IMREAD_GRAYSCALE;
+    if (scale_denom == 2) flags = cv::IMREAD_REDUCED_GRAYSCALE_2;
+    else if (scale_denom == 4) flags = cv::IMREAD_REDUCED_GRAYSCALE_4;
+    else if (scale_denom == 8) flags = cv::IMREAD_REDUCED_GRAYSCALE_8;
+
+    cv::Mat buffer(1, (int)size, CV_8UC1, const_cast<uint8_t*>(data));
+    gray = cv::imdecode(buffer, flags);
+    return !gray.empty();
+}
+#endif
@@ -1,6 +1,14 @@
 #include  "detect.h"
+#include "mask.h"
+#include "blobs.h"
 #include <iostream>
 
+// row caches for the fused mask kernel and the labeller, and the background
+// subtracted window, one set per detecting thread
+static thread_local mask_builder fused_mask_builder;
+static thread_local blob_extractor blob_scratch;
+static thread_local cv::Mat foreground_scratch;
+
 ball_detector::ball_detector(int threshold, float min_circ)
     : brightness_threshold(threshold)
     , min_circularity(min_circ)
@@ -8,186 +16,245 @@ ball_detector::ball_detector(int threshold, float min_circ)
     , max_area(5000.0f)
     , roi(0, 0, 0, 0)
     , use_roi(false)
+    , fused_mask(true)
+    , engine(candidate_engine::contours)
+    , background(nullptr)
 {
 }
 
-ball_detection ball_detector::find_ball(const cv::Mat& frame) {
-    ball_detection result;
-    
-    if (frame.empty()) {
-        return result;
-    }
-    
-    cv::Mat gray;
-    if (frame.channels() == 3) {
-        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = frame.clone();
-    }
-
-    cv::Mat blurred;
-    cv::GaussianBlur(gray, blurred, cv::Size(9, 9), 2);
-
-    cv::Mat thresh;
-    cv::threshold(blurred, thresh, brightness_threshold, 255, cv::THRESH_BINARY);
-
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
-    cv::morphologyEx(thresh, thresh, cv::MORPH_OPEN, kernel);
-    cv::morphologyEx(thresh, thresh, cv::MORPH_CLOSE, kernel);
-    
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(thresh, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+ball_detection ball_detector::find_ball(const frame_envelope& frame) {
+    no_debug policy;
+    return detect(frame, cv::Rect(), policy);
+}
 
-    float best_score = 0;
-    cv::Point2f best_center;
-    float best_radius = 0;
-    
-    for (const auto& contour : contours) {
-        float area = cv::contourArea(contour);
-        if (area < min_area || area > max_area) {
-            continue;
-        }
-        cv::Point2f center;
-        float radius;
-        cv::minEnclosingCircle(contour, center, radius);
+ball_detection ball_detector::find_ball(const frame_envelope& frame, cv::Rect window) {
+    no_debug policy;
+    return detect(frame, window, policy);
+}
 
-        float perimeter = cv::arcLength(contour, true);
-        float circularity = (4.0 * CV_PI * area) / (perimeter * perimeter);
+ball_detection ball_detector::find_candidates(const frame_envelope& frame, candidate_list& candidates, cv::Rect window) {
+    no_debug policy;
+    return detect(frame, window, policy, &candidates);
+}
 
-        if (circularity > min_circularity) {
-            float score = circularity * area;
-            if (score > best_score) {
-                best_score = score;
-                best_center = center;
-                best_radius = radius;
-            }
-        }
+void candidate_list::offer(const ball_candidate& candidate) {
+    if (count == capacity && candidate.score <= items[capacity - 1].score) {
+        return;
     }
-    if (best_score > 0) {
-        result.position = best_center;
-        result.radius = best_radius;
-        result.timestamp = std::chrono::high_resolution_clock::now();
-        result.found = true;
+    int i = count < capacity ? count++ : capacity - 1;
+    while (i > 0 && items[i - 1].score < candidate.score) {
+        items[i] = items[i - 1];
+        i--;
     }
-    return result;
+    items[i] = candidate;
 }
 
-ball_detection ball_detector::find_ball_visual(cv::Mat& frame) {
-    ball_detection detection = find_ball(frame);
-
-    if (detection.found) {
-        cv::circle(frame, detection.position, (int)detection.radius,
-                  cv::Scalar(255), 2);
+ball_detection candidate_list::detection(int index) const {
+    ball_detection d;
+    if (index < 0 || index >= count) {
+        return d;
+    }
+    d.position = items[index].position;
+    d.radius = items[index].radius;
+    d.circularity = items[index].circularity;
+    d.timestamp = timestamp;
+    d.sequence = sequence;
+    d.found = true;
+    return d;
+}
 
-        cv::circle(frame, detection.position, 3,
-                  cv::Scalar(128), -1);
+ball_detection ball_detector::find_ball_debug(const frame_envelope& frame, detection_debug& debug) {
+    capture_debug policy(debug);
+    return detect(frame, cv::Rect(), policy);
+}
 
-        int cross_size = 10;
-        cv::line(frame,
-                cv::Point(detection.position.x - cross_size, detection.position.y),
-                cv::Point(detection.position.x + cross_size, detection.position.y),
-                cv::Scalar(255), 1);
-        cv::line(frame,
-                cv::Point(detection.position.x, detection.position.y - cross_size),
-                cv::Point(detection.position.x, detection.position.y + cross_size),
-                cv::Scalar(255), 1);
+bool ball_detector::find_ball_debug(const frame_envelope& frame, capture_debug& sampler, ball_detection* result) {
+    // between samples there is nothing to show, so skip the work entirely
+    if (!sampler.sample()) {
+        return false;
     }
-    return detection;
+    ball_detection detection = detect(frame, cv::Rect(), sampler);
+    if (result) {
+        *result = detection;
+    }
+    return true;
 }
-ball_detection ball_detector::find_ball_debug(const cv::Mat& frame, detection_debug& debug) {
-    ball_detection result;
-    debug.all_contours.clear();
 
+template <typename policy>
+ball_detection ball_detector::detect(const frame_envelope& frame, cv::Rect window, policy& instrument,
+                                     candidate_list* candidates) {
+    ball_detection result;
+    if (candidates) {
+        candidates->clear();
+        candidates->timestamp = frame.timestamp;
+        candidates->sequence = frame.sequence;
+    }
+    detection_debug* debug = nullptr;
+    if constexpr (policy::enabled) {
+        debug = instrument.debug;
+        debug->all_contours.clear();
+        debug->contours_found = 0;
+        debug->contours_passed_area = 0;
+        debug->contours_passed_circularity = 0;
+    }
+    
     if (frame.empty()) {
         return result;
     }
-
-    cv::Mat gray;
-    if (frame.channels() == 3) {
-        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = frame.clone();
+    
+    cv::Mat gray = frame.image;
+    if (gray.channels() == 3) {
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
     }
 
-    cv::Mat work_img = gray;
-    cv::Point2f offset(0, 0);
-
-    if (use_roi && roi.width > 0 && roi.height > 0) {
-        cv::Rect safe_roi = roi & cv::Rect(0, 0, gray.cols, gray.rows);
-        if (safe_roi.width > 0 && safe_roi.height > 0) {
-            work_img = gray(safe_roi).clone();
-            offset = cv::Point2f(safe_roi.x, safe_roi.y);
-        }
+    // an empty window means the whole search area: the roi if set, else the frame
+    cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    if (window.width <= 0 || window.height <= 0) {
+        window = (use_roi && roi.width > 0 && roi.height > 0) ? roi : bounds;
+    }
+    window &= bounds;
+    if (window.width <= 0 || window.height <= 0) {
+        return result;
+    }
+    cv::Mat work_img = gray(window);
+    cv::Point2f offset(window.x, window.y);
+    if (background && background->ready() && background->matches(gray)) {
+        background->subtract(gray, window, foreground_scratch);
+        work_img = foreground_scratch;
     }
 
-    double minVal, maxVal;
-    cv::minMaxLoc(work_img, &minVal, &maxVal);
-    debug.max_brightness = maxVal;
-
-    cv::Mat blurred;
-    cv::GaussianBlur(work_img, blurred, cv::Size(9, 9), 2);
-
-    cv::Mat thresh;
-    cv::threshold(blurred, thresh, brightness_threshold, 255, cv::THRESH_BINARY);
-    debug.threshold_img = thresh.clone();
-
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
-    cv::morphologyEx(thresh, thresh, cv::MORPH_OPEN, kernel);
-    cv::morphologyEx(thresh, thresh, cv::MORPH_CLOSE, kernel);
-    debug.morphed_img = thresh.clone();
+    if constexpr (policy::enabled) {
+        double min_val, max_val;
+        cv::minMaxLoc(work_img, &min_val, &max_val);
+        debug->max_brightness = max_val;
+    }
 
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(thresh, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-    debug.contours_found = contours.size();
+    // when capturing, the mask is built straight into the debug buffers
+    cv::Mat local_mask;
+    cv::Mat& thresh = policy::enabled ? debug->morphed_img : local_mask;
+    if (fused_mask) {
+        fused_mask_builder.build(work_img, brightness_threshold, thresh,
+                                 policy::enabled ? &debug->threshold_img : nullptr);
+    } else {
+        cv::Mat blurred;
+        cv::GaussianBlur(work_img, blurred, cv::Size(9, 9), 2);
+        cv::threshold(blurred, thresh, brightness_threshold, 255, cv::THRESH_BINARY);
+        if constexpr (policy::enabled) {
+            thresh.copyTo(debug->threshold_img);
+        }
 
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
+        cv::morphologyEx(thresh, thresh, cv::MORPH_OPEN, kernel);
+        cv::morphologyEx(thresh, thresh, cv::MORPH_CLOSE, kernel);
+    }
+    
     float best_score = 0;
     cv::Point2f best_center;
     float best_radius = 0;
+    float best_circularity = 0;
 
-    for (const auto& contour : contours) {
-        float area = cv::contourArea(contour);
-
-        contour_info info;
-        info.area = area;
-
-        cv::Point2f center;
-        float radius;
-        cv::minEnclosingCircle(contour, center, radius);
-        info.center = center + offset;
-        info.radius = radius;
-
-        float perimeter = cv::arcLength(contour, true);
-        info.circularity = (4.0 * CV_PI * area) / (perimeter * perimeter);
-
-        info.passed_area = (area >= min_area && area <= max_area);
-        info.passed_circularity = (info.circularity >= min_circularity);
-
-        debug.all_contours.push_back(info);
-
-        if (!info.passed_area) {
-            continue;
+    // every candidate goes through here; the debug build records all of them,
+    // the plain one never sees the ones that fail the area check
+    auto consider = [&](float area, cv::Point2f center, float radius, float circularity) {
+        bool passed_area = area >= min_area && area <= max_area;
+        bool passed_circularity = circularity > min_circularity;
+        if constexpr (policy::enabled) {
+            contour_info info;
+            info.area = area;
+            info.center = center + offset;
+            info.radius = radius;
+            info.circularity = circularity;
+            info.passed_area = passed_area;
+            info.passed_circularity = passed_circularity;
+            debug->all_contours.push_back(info);
+            debug->contours_found++;
+            debug->contours_passed_area += passed_area;
+            debug->contours_passed_circularity += passed_area && passed_circularity;
         }
-        debug.contours_passed_area++;
-
-        if (info.passed_circularity) {
-            debug.contours_passed_circularity++;
-            float score = info.circularity * area;
+        if (passed_area && passed_circularity) {
+            float score = circularity * area;
+            if (candidates) {
+                ball_candidate c;
+                c.position = center + offset;
+                c.radius = radius;
+                c.circularity = circularity;
+                c.area = area;
+                c.score = score;
+                candidates->offer(c);
+            }
             if (score > best_score) {
                 best_score = score;
-                best_center = center + offset;
+                best_center = center;
                 best_radius = radius;
+                best_circularity = circularity;
             }
         }
+    };
+
+    if (engine == candidate_engine::components) {
+        for (const auto& b : blob_scratch.extract(thresh, work_img)) {
+            consider((float)b.area, b.center, b.radius, b.circularity);
+        }
+    } else {
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(thresh, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+        for (const auto& contour : contours) {
+            float area = cv::contourArea(contour);
+            if (!policy::enabled && (area < min_area || area > max_area)) {
+                continue;
+            }
+            cv::Point2f center;
+            float radius;
+            cv::minEnclosingCircle(contour, center, radius);
+
+            float perimeter = cv::arcLength(contour, true);
+            float circularity = (4.0 * CV_PI * area) / (perimeter * perimeter);
+            consider(area, center, radius, circularity);
+        }
     }
     if (best_score > 0) {
-        result.position = best_center;
+        result.position = best_center + offset;
         result.radius = best_radius;
-        result.timestamp = std::chrono::high_resolution_clock::now();
+        result.circularity = best_circularity;
+        result.timestamp = frame.timestamp;
+        result.sequence = frame.sequence;
         result.found = true;
     }
     return result;
 }
 
+template ball_detection ball_detector::detect<no_debug>(const frame_envelope&, cv::Rect, no_debug&, candidate_list*);
+template ball_detection ball_detector::detect<capture_debug>(const frame_envelope&, cv::Rect, capture_debug&, candidate_list*);
+
+void draw_detection(cv::Mat& image, const ball_detection& detection, cv::Point2f offset) {
+    if (!detection.found) {
+        return;
+    }
+    cv::Point2f p = detection.position + offset;
+
+    cv::circle(image, p, (int)detection.radius,
+              cv::Scalar(255), 2);
+
+    cv::circle(image, p, 3,
+              cv::Scalar(128), -1);
+
+    int cross_size = 10;
+    cv::line(image,
+            cv::Point(p.x - cross_size, p.y),
+            cv::Point(p.x + cross_size, p.y),
+            cv::Scalar(255), 1);
+    cv::line(image,
+            cv::Point(p.x, p.y - cross_size),
+            cv::Point(p.x, p.y + cross_size),
+            cv::Scalar(255), 1);
+}
+
+ball_detection ball_detector::find_ball_visual(frame_envelope& frame) {
+    ball_detection detection = find_ball(frame);
+    draw_detection(frame.image, detection);
+    return detection;
+}
 void ball_detector::set_threshold(int threshold) {
     brightness_threshold = threshold;
 }
@@ -206,4 +273,13 @@ void ball_detector::set_roi(cv::Rect rect) {
 }
 void ball_detector::disable_roi() {
     use_roi = false;
+}
+void ball_detector::set_fused_mask(bool enabled) {
+    fused_mask = enabled;
+}
+void ball_detector::set_engine(candidate_engine e) {
+    engine = e;
+}
+void ball_detector::set_background(const background_model* model) {
+    background = model;
 }
\ No newline at end of file
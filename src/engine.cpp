@@ -0,0 +1,172 @@
+#include "engine.h"
+#include <algorithm>
+#include <iostream>
+
+void apply_detector_config(ball_detector& detector, const detector_config& config) {
+    detector.set_threshold(config.threshold);
+    detector.set_circularity(config.circularity);
+    detector.set_min_area(config.min_area);
+    detector.set_max_area(config.max_area);
+    if (config.use_roi) {
+        detector.set_roi(config.roi);
+    } else {
+        detector.disable_roi();
+    }
+}
+
+launch_engine::launch_engine(const app_config& config, bool preview)
+    : config(config)
+    , preview(preview)
+    , flip_top(config.flip_top)
+    , flip_bottom(config.flip_bottom)
+    , swap(config.swap)
+    , record_shots(config.record_shots)
+    , trigger_to_result(metrics.histogram("trigger_to_result"))
+    , spin_time(metrics.histogram("spin_estimate"))
+    , cam_top("top", make_capture_source(config.top_source))
+    , cam_bottom("bottom", make_capture_source(config.bottom_source))
+    , monitor_frames(16, drop_policy::block)
+    , preview_frames(2, drop_policy::drop_oldest)
+    , bursts(2, drop_policy::block)
+    , results(2, drop_policy::block)
+    , recordings(4, drop_policy::drop_newest)
+    , monitor(pool, [this](burst_capture&& burst) { bursts.push(std::move(burst)); })
+    , render(nullptr)
+    , present(nullptr)
+    , running(false)
+{
+    ball_detector top(200, 0.7);
+    ball_detector bottom(200, 0.7);
+    apply_detector_config(top, config.top_detector);
+    apply_detector_config(bottom, config.bottom_detector);
+    monitor.set_detectors(top, bottom);
+    monitor.set_background_model(config.background_model);
+    monitor.set_live_source(cam_top.is_live() && cam_bottom.is_live());
+    monitor.set_metrics(metrics);
+    cam_top.set_metrics(metrics);
+    cam_bottom.set_metrics(metrics);
+
+    flight_conditions conditions;
+    conditions.air_density = config.air_density;
+    calc.set_default_spin(config.default_spin_rpm);
+    calc.set_tee_column(config.tee_column);
+    calc.set_carry_table(load_carry_table(config.carry_table, conditions, &pool));
+
+    pipe.add_source("ingest", [this]() { return ingest(); });
+    pipe.add_stage<frame_pair>("monitor", monitor_frames, [this](frame_pair& pair) {
+        monitor.process(pair);
+    });
+    pipe.add_stage<burst_capture>("solve", bursts, [this](burst_capture& burst) { solve(burst); });
+    std::string dir = config.recording_dir;
+    pipe.add_stage<shot_record>("record", recordings, [dir](shot_record& record) {
+        std::string path = next_recording_path(dir);
+        if (write_recording(path, record)) {
+            std::cout << "shot recorded to " << path << std::endl;
+        }
+    });
+    if (preview) {
+        render = &pipe.add_sink("render", preview_frames);
+    }
+    present = &pipe.add_sink("present", results);
+}
+
+launch_engine::~launch_engine() {
+    stop();
+}
+
+bool launch_engine::open() {
+    bool top_ok = cam_top.open();
+    bool bottom_ok = cam_bottom.open();
+    return top_ok && bottom_ok;
+}
+
+void launch_engine::start() {
+    if (running) {
+        return;
+    }
+    cam_top.start();
+    cam_bottom.start();
+    pipe.start();
+    running = true;
+}
+
+void launch_engine::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    pipe.stop();
+    cam_top.stop();
+    cam_bottom.stop();
+}
+
+bool launch_engine::ingest() {
+    if (cam_top.pending() == 0 || cam_bottom.pending() == 0) {
+        return false;
+    }
+    frame_pair pair;
+    cam_top.pop(pair.top);
+    cam_bottom.pop(pair.bottom);
+
+    if (flip_top.load()) cv::flip(pair.top.image, pair.top.image, -1);
+    if (flip_bottom.load()) cv::flip(pair.bottom.image, pair.bottom.image, -1);
+
+    if (pair.top.image.channels() == 3) {
+        cv::cvtColor(pair.top.image, pair.top.image, cv::COLOR_BGR2GRAY);
+    }
+    if (pair.bottom.image.channels() == 3) {
+        cv::cvtColor(pair.bottom.image, pair.bottom.image, cv::COLOR_BGR2GRAY);
+    }
+
+    if (preview) {
+        preview_frames.push(pair);
+    }
+    monitor_frames.push(std::move(pair));
+    return true;
+}
+
+void launch_engine::solve(burst_capture& burst) {
+    shot_result result;
+    capture_clock::time_point spin_start = capture_clock::now();
+    spin_estimate spin = spinner.estimate(burst);
+    spin_time.record(capture_clock::now() - spin_start);
+    if (swap.load()) {
+        result.shot = calc.calculate_shot(burst.dets_bottom, burst.dets_top, &spin);
+    } else {
+        result.shot = calc.calculate_shot(burst.dets_top, burst.dets_bottom, &spin);
+    }
+    result.burst = std::make_shared<burst_capture>(std::move(burst));
+    // from the capture of the pair that fired to a solved shot, burst included;
+    // only live frames are stamped on the clock now() reads
+    const burst_capture& b = *result.burst;
+    if (!b.test && cam_top.is_live() && cam_bottom.is_live() && b.pre_trigger_frames > 0 && b.pre_trigger_frames <= b.frames.size()) {
+        const burst_frame& fired = b.frames[b.pre_trigger_frames - 1];
+        trigger_to_result.record(capture_clock::now() - std::max(fired.top.timestamp, fired.bottom.timestamp));
+    }
+    if (record_shots.load() && !result.burst->test) {
+        shot_record record;
+        record.burst = result.burst;
+        record.shot = result.shot;
+        record.calibration = calc.get_calibration();
+        recordings.push(std::move(record));
+    }
+    results.push(std::move(result));
+}
+
+bool launch_engine::latest_preview(frame_pair& pair) {
+    bool any = false;
+    frame_pair next;
+    while (preview_frames.try_pop(next)) {
+        pair = std::move(next);
+        any = true;
+    }
+    return any;
+}
+
+bool launch_engine::poll_result(shot_result& result) {
+    return results.try_pop(result);
+}
+
+bool launch_engine::wait_result(shot_result& result, std::chrono::milliseconds timeout) {
+    return results.pop_for(result, timeout);
+}
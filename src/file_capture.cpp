@@ -0,0 +1,145 @@
+#include "capture.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static std::string extension(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return "";
+    }
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static bool is_image_file(const std::string& name) {
+    std::string ext = extension(name);
+    return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" || ext == "pgm" || ext == "tif" || ext == "tiff";
+}
+
+static bool is_jpeg_file(const std::string& name) {
+    std::string ext = extension(name);
+    return ext == "jpg" || ext == "jpeg";
+}
+
+static cv::Mat read_file_bytes(const std::string& name) {
+    std::ifstream file(name, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return cv::Mat();
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0);
+    cv::Mat bytes(1, (int)size, CV_8UC1);
+    if (!file.read(reinterpret_cast<char*>(bytes.data), size)) {
+        return cv::Mat();
+    }
+    return bytes;
+}
+
+file_source::file_source(const std::string& path, const capture_settings& settings, bool loop)
+    : path(path)
+    , settings(settings)
+    , loop(loop)
+    , opened(false)
+    , index(0)
+    , next_sequence(0)
+{
+}
+
+bool file_source::open() {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        std::cerr << "no such file or directory: " << path << std::endl;
+        return false;
+    }
+
+    files.clear();
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            std::cerr << "failed to read directory " << path << std::endl;
+            return false;
+        }
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (is_image_file(name)) {
+                files.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        if (files.empty()) {
+            std::cerr << "no images in " << path << std::endl;
+            return false;
+        }
+    } else if (!video.open(path)) {
+        std::cerr << "failed to open video " << path << std::endl;
+        return false;
+    }
+
+    index = 0;
+    next_sequence = 0;
+    start_time = capture_clock::now();
+    opened = true;
+    return true;
+}
+
+size_t file_source::frame_count() const {
+    if (!files.empty()) {
+        return files.size();
+    }
+    return (size_t)video.get(cv::CAP_PROP_FRAME_COUNT);
+}
+
+bool file_source::read(frame_envelope& frame) {
+    if (!opened) {
+        return false;
+    }
+
+    if (!files.empty()) {
+        if (index >= files.size()) {
+            if (!loop) {
+                return false;
+            }
+            index = 0;
+        }
+        // jpegs stay encoded so recorded mjpeg goes through the same decoder as a camera
+        const std::string& name = files[index++];
+        if (is_jpeg_file(name)) {
+            frame.image = read_file_bytes(name);
+            frame.format = frame_format::mjpeg;
+        } else {
+            frame.image = cv::imread(name, cv::IMREAD_UNCHANGED);
+            frame.format = frame.image.channels() == 3 ? frame_format::bgr : frame_format::gray;
+        }
+    } else {
+        if (!video.read(frame.image)) {
+            if (!loop) {
+                return false;
+            }
+            video.set(cv::CAP_PROP_POS_FRAMES, 0);
+            if (!video.read(frame.image)) {
+                return false;
+            }
+        }
+        frame.format = frame.image.channels() == 3 ? frame_format::bgr : frame_format::gray;
+    }
+    if (frame.image.empty()) {
+        return false;
+    }
+
+    // frames are stamped as if captured at exactly the configured rate
+    capture_clock::duration period = std::chrono::duration_cast<capture_clock::duration>(
+        std::chrono::duration<double>(1.0 / settings.fps));
+    frame.timestamp = start_time + period * next_sequence;
+    frame.sequence = next_sequence++;
+    frame.lease.reset();
+
+    if (settings.realtime) {
+        std::this_thread::sleep_until(frame.timestamp);
+    }
+    return true;
+}
@@ -0,0 +1,294 @@
+#include "flight.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+
+static const double ball_mass_kg = 0.04593;
+static const double ball_radius_m = 0.021335;
+static const double gravity_mps2 = 9.80665;
+static const double metres_per_second_per_mph = 0.44704;
+static const double feet_per_metre = 3.28084;
+// backspin fades over a flight, roughly by this share each second
+static const double spin_decay_per_s = 0.04;
+// the share of the landing speed along the ground that a flat landing keeps,
+// less the steeper it comes in
+static const double bounce_retention = 0.5;
+static const double time_step_s = 0.01;
+static const double max_flight_s = 20.0;
+
+static const char carry_magic[8] = { 'L', 'M', 'C', 'A', 'R', 'R', 'Y', 0 };
+static const uint32_t carry_version = 1;
+
+// drag and lift coefficients against spin factor s = r w / v; drag rises
+// gently with spin, lift climbs and levels off above s = 0.3
+static double drag_coefficient(double s) {
+    return 0.21 + 0.25 * s;
+}
+
+static double lift_coefficient(double s) {
+    if (s >= 0.3) {
+        return 0.305;
+    }
+    return 1.99 * s - 3.25 * s * s;
+}
+
+struct flight_state {
+    double x, y, vx, vy;
+};
+
+static flight_state derivative(const flight_state& s, double spin_rad_s, double k) {
+    flight_state d;
+    d.x = s.vx;
+    d.y = s.vy;
+    double v = std::sqrt(s.vx * s.vx + s.vy * s.vy);
+    if (v < 1e-6) {
+        d.vx = 0;
+        d.vy = -gravity_mps2;
+        return d;
+    }
+    double spin_factor = ball_radius_m * spin_rad_s / v;
+    double drag = k * drag_coefficient(spin_factor) * v;
+    double lift = k * lift_coefficient(spin_factor) * v;
+    // drag against the velocity, lift square to it and upward for backspin
+    d.vx = -drag * s.vx - lift * s.vy;
+    d.vy = -drag * s.vy + lift * s.vx - gravity_mps2;
+    return d;
+}
+
+static flight_state advance(const flight_state& s, const flight_state& d, double h) {
+    flight_state r;
+    r.x = s.x + d.x * h;
+    r.y = s.y + d.y * h;
+    r.vx = s.vx + d.vx * h;
+    r.vy = s.vy + d.vy * h;
+    return r;
+}
+
+flight_result simulate_flight(float speed_mph, float launch_angle_deg, float spin_rpm,
+                              const flight_conditions& conditions) {
+    flight_result result;
+    double speed = speed_mph * metres_per_second_per_mph;
+    // a ball measured leaving slightly downhill flies like a flat one, as
+    // carry_table's 0 deg row has it, rather than carrying nothing
+    double angle = std::max(0.0f, launch_angle_deg) * M_PI / 180.0;
+    double spin0 = std::max(0.0f, spin_rpm) * 2.0 * M_PI / 60.0;
+    if (speed <= 0) {
+        return result;
+    }
+    // force per unit mass per v^2, before the coefficient
+    double k = 0.5 * conditions.air_density * M_PI * ball_radius_m * ball_radius_m / ball_mass_kg;
+
+    flight_state s = { 0, 0, speed * std::cos(angle), speed * std::sin(angle) };
+    double t = 0, apex = 0;
+    const double h = time_step_s;
+    while (t < max_flight_s) {
+        double spin_start = spin0 * std::exp(-spin_decay_per_s * t);
+        double spin_mid = spin0 * std::exp(-spin_decay_per_s * (t + 0.5 * h));
+        double spin_end = spin0 * std::exp(-spin_decay_per_s * (t + h));
+
+        flight_state k1 = derivative(s, spin_start, k);
+        flight_state k2 = derivative(advance(s, k1, 0.5 * h), spin_mid, k);
+        flight_state k3 = derivative(advance(s, k2, 0.5 * h), spin_mid, k);
+        flight_state k4 = derivative(advance(s, k3, h), spin_end, k);
+        flight_state next;
+        next.x = s.x + h / 6.0 * (k1.x + 2 * k2.x + 2 * k3.x + k4.x);
+        next.y = s.y + h / 6.0 * (k1.y + 2 * k2.y + 2 * k3.y + k4.y);
+        next.vx = s.vx + h / 6.0 * (k1.vx + 2 * k2.vx + 2 * k3.vx + k4.vx);
+        next.vy = s.vy + h / 6.0 * (k1.vy + 2 * k2.vy + 2 * k3.vy + k4.vy);
+
+        if (next.y < 0 && next.vy < 0) {
+            if (t == 0) {
+                // never got off the ground
+                return result;
+            }
+            // land between the two steps, linear in height
+            double f = s.y / (s.y - next.y);
+            s.x += f * (next.x - s.x);
+            s.vx += f * (next.vx - s.vx);
+            s.vy += f * (next.vy - s.vy);
+            t += f * h;
+            break;
+        }
+        s = next;
+        t += h;
+        apex = std::max(apex, s.y);
+    }
+
+    double descent = std::atan2(-s.vy, std::max(1e-6, s.vx));
+    double rolling = std::max(0.0, s.vx) * bounce_retention * std::max(0.0, 1.0 - descent / (0.5 * M_PI));
+    double roll = conditions.rolling_friction > 0
+        ? rolling * rolling / (2.0 * conditions.rolling_friction * gravity_mps2)
+        : 0.0;
+
+    result.carry_ft = (float)(s.x * feet_per_metre);
+    result.total_ft = (float)((s.x + roll) * feet_per_metre);
+    result.apex_ft = (float)(apex * feet_per_metre);
+    result.descent_deg = (float)(descent * 180.0 / M_PI);
+    result.flight_s = (float)t;
+    return result;
+}
+
+carry_table::carry_table() {
+    // every ball a camera pair will see: chips to long drives, topped to
+    // sky-high, knuckled to wedge spin
+    speed.first = 10;
+    speed.step = 5;
+    speed.count = 39;
+    angle.first = 0;
+    angle.step = 2;
+    angle.count = 31;
+    spin.first = 0;
+    spin.step = 500;
+    spin.count = 25;
+}
+
+void carry_table::build(const flight_conditions& conditions, worker_pool* pool) {
+    this->conditions = conditions;
+    entries.assign((size_t)speed.count * angle.count * spin.count, flight_result());
+    auto slice = [this, conditions](int s) {
+        for (int a = 0; a < angle.count; a++) {
+            for (int r = 0; r < spin.count; r++) {
+                entries[index(s, a, r)] = simulate_flight(speed.first + s * speed.step, angle.first + a * angle.step,
+                                                          spin.first + r * spin.step, conditions);
+            }
+        }
+    };
+    if (!pool) {
+        for (int s = 0; s < speed.count; s++) {
+            slice(s);
+        }
+        return;
+    }
+    std::vector<std::future<void>> pending;
+    for (int s = 0; s < speed.count; s++) {
+        pending.push_back(pool->submit([slice, s]() { slice(s); }));
+    }
+    for (auto& p : pending) {
+        p.get();
+    }
+}
+
+struct carry_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    carry_table::axis axes[3];
+    float air_density;
+    float rolling_friction;
+};
+
+bool carry_table::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "failed to write carry table to " << path << std::endl;
+        return false;
+    }
+    carry_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, carry_magic, sizeof(carry_magic));
+    header.version = carry_version;
+    header.entry_size = sizeof(flight_result);
+    header.axes[0] = speed;
+    header.axes[1] = angle;
+    header.axes[2] = spin;
+    header.air_density = conditions.air_density;
+    header.rolling_friction = conditions.rolling_friction;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)entries.data(), entries.size() * sizeof(flight_result));
+    return file.good();
+}
+
+static bool same_axis(const carry_table::axis& a, const carry_table::axis& b) {
+    return a.first == b.first && a.step == b.step && a.count == b.count;
+}
+
+bool carry_table::load(const std::string& path, const flight_conditions& conditions) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    carry_header header;
+    if (!file.read((char*)&header, sizeof(header)) ||
+        std::memcmp(header.magic, carry_magic, sizeof(carry_magic)) != 0 ||
+        header.version != carry_version || header.entry_size != sizeof(flight_result)) {
+        std::cerr << path << " is not a carry table this build can read" << std::endl;
+        return false;
+    }
+    // a table for another grid or other air is stale, not wrong to have
+    if (!same_axis(header.axes[0], speed) || !same_axis(header.axes[1], angle) || !same_axis(header.axes[2], spin) ||
+        header.air_density != conditions.air_density || header.rolling_friction != conditions.rolling_friction) {
+        return false;
+    }
+    std::vector<flight_result> loaded((size_t)speed.count * angle.count * spin.count);
+    if (!file.read((char*)loaded.data(), loaded.size() * sizeof(flight_result))) {
+        std::cerr << path << " is truncated" << std::endl;
+        return false;
+    }
+    entries.swap(loaded);
+    this->conditions = conditions;
+    return true;
+}
+
+// cell and weight of value along an axis, clamped to its ends
+static int locate(const carry_table::axis& axis, float value, float& within) {
+    float position = (value - axis.first) / axis.step;
+    if (position <= 0) {
+        within = 0;
+        return 0;
+    }
+    if (position >= axis.count - 1) {
+        within = 1;
+        return axis.count - 2;
+    }
+    int cell = (int)position;
+    within = position - cell;
+    return cell;
+}
+
+static flight_result blend(const flight_result& a, const flight_result& b, float w) {
+    flight_result r;
+    r.carry_ft = a.carry_ft + (b.carry_ft - a.carry_ft) * w;
+    r.total_ft = a.total_ft + (b.total_ft - a.total_ft) * w;
+    r.apex_ft = a.apex_ft + (b.apex_ft - a.apex_ft) * w;
+    r.descent_deg = a.descent_deg + (b.descent_deg - a.descent_deg) * w;
+    r.flight_s = a.flight_s + (b.flight_s - a.flight_s) * w;
+    return r;
+}
+
+flight_result carry_table::lookup(float speed_mph, float launch_angle_deg, float spin_rpm) const {
+    if (entries.empty()) {
+        return flight_result();
+    }
+    float ws, wa, wr;
+    int s = locate(speed, speed_mph, ws);
+    int a = locate(angle, launch_angle_deg, wa);
+    int r = locate(spin, spin_rpm, wr);
+
+    flight_result low_speed = blend(blend(entries[index(s, a, r)], entries[index(s, a, r + 1)], wr),
+                                    blend(entries[index(s, a + 1, r)], entries[index(s, a + 1, r + 1)], wr), wa);
+    flight_result high_speed = blend(blend(entries[index(s + 1, a, r)], entries[index(s + 1, a, r + 1)], wr),
+                                     blend(entries[index(s + 1, a + 1, r)], entries[index(s + 1, a + 1, r + 1)], wr), wa);
+    return blend(low_speed, high_speed, ws);
+}
+
+std::shared_ptr<const carry_table> load_carry_table(const std::string& path, const flight_conditions& conditions,
+                                                    worker_pool* pool) {
+    std::shared_ptr<carry_table> table = std::make_shared<carry_table>();
+    if (!path.empty() && table->load(path, conditions)) {
+        std::cout << "carry table loaded from " << path << std::endl;
+        return table;
+    }
+    auto start = std::chrono::steady_clock::now();
+    table->build(conditions, pool);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "carry table built in " << seconds << "s" << std::endl;
+    if (!path.empty() && table->save(path)) {
+        std::cout << "carry table cached to " << path << std::endl;
+    }
+    return table;
+}
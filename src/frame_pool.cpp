@@ -0,0 +1,59 @@
+#include "frame_pool.h"
+#include <iostream>
+
+frame_pool::frame_pool()
+    : next(0)
+    , frame_size(0, 0)
+    , frame_type(CV_8UC1)
+    , acquired(0)
+    , misses(0)
+{
+}
+
+bool frame_pool::is_free(const cv::Mat& slot) {
+    // refcount is only ever touched atomically by opencv, pair with its release
+    return __atomic_load_n(&slot.u->refcount, __ATOMIC_ACQUIRE) == 1;
+}
+
+void frame_pool::reserve(cv::Size size, int type, size_t capacity) {
+    slots.clear();
+    slots.reserve(capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        slots.push_back(cv::Mat(size, type));
+    }
+    frame_size = size;
+    frame_type = type;
+    next = 0;
+    acquired = 0;
+    misses = 0;
+    std::cout << "frame pool: " << capacity << " x " << size.width << "x" << size.height
+              << " (" << (capacity * size.area() * CV_ELEM_SIZE(type)) / (1024 * 1024) << " MB)" << std::endl;
+}
+
+cv::Mat frame_pool::acquire() {
+    acquired++;
+    for (size_t i = 0; i < slots.size(); i++) {
+        size_t index = (next + i) % slots.size();
+        if (is_free(slots[index])) {
+            next = (index + 1) % slots.size();
+            return slots[index];
+        }
+    }
+
+    // every slot is still referenced downstream
+    misses++;
+    if (frame_size.area() == 0) {
+        return cv::Mat();
+    }
+    return cv::Mat(frame_size, frame_type);
+}
+
+size_t frame_pool::in_use() const {
+    size_t used = 0;
+    for (const auto& slot : slots) {
+        if (!is_free(slot)) {
+            used++;
+        }
+    }
+    return used;
+}
@@ -4,56 +4,159 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <opencv2/opencv.hpp>
-#include <deque>
 #include "detect.h"
-#include "calculate.h"
-#include "config.h"
-
-class image_texture {
-private:
-    int width, height;
-    GLuint texture_id;
-public:
-    image_texture() : width(0), height(0), texture_id(0) {}
-
-    ~image_texture() {
-        if (texture_id != 0) {
-            glDeleteTextures(1, &texture_id);
-        }
+#include "engine.h"
+#include "mask.h"
+#include "texture.h"
+#include <cfloat>
+#include <ctime>
+
+static cv::Mat compose_burst_frame(const burst_frame& frame, bool viz) {
+    cv::Mat combined;
+    cv::vconcat(frame.top.image, frame.bottom.image, combined);
+    if (viz) {
+        draw_detection(combined, frame.det_top);
+        draw_detection(combined, frame.det_bottom, cv::Point2f(0, (float)frame.top.image.rows));
     }
-    void update(cv::Mat& frame) {
-        if (frame.empty()) return;
+    return combined;
+}
 
-        width = frame.cols;
-        height = frame.rows;
+// a recorded pair stacked like compose_burst_frame. stored planes may be roi
+// crops of different widths, and detections are still in frame coordinates
+static cv::Mat compose_recorded_frame(const recording_reader& reader, size_t index, bool viz) {
+    frame_envelope top = reader.frame(0, index);
+    frame_envelope bottom = reader.frame(1, index);
+    cv::Mat combined(top.image.rows + bottom.image.rows, std::max(top.image.cols, bottom.image.cols), CV_8UC1, cv::Scalar(0));
+    top.image.copyTo(combined(cv::Rect(0, 0, top.image.cols, top.image.rows)));
+    bottom.image.copyTo(combined(cv::Rect(0, top.image.rows, bottom.image.cols, bottom.image.rows)));
+    if (viz) {
+        cv::Rect crop_top = reader.crop(0);
+        cv::Rect crop_bottom = reader.crop(1);
+        draw_detection(combined, reader.detection(0, index), cv::Point2f((float)-crop_top.x, (float)-crop_top.y));
+        draw_detection(combined, reader.detection(1, index),
+                       cv::Point2f((float)-crop_bottom.x, (float)(top.image.rows - crop_bottom.y)));
+    }
+    return combined;
+}
 
-        cv::Mat rgb;
-        if (frame.channels() == 1) {
-            cv::cvtColor(frame, rgb, cv::COLOR_GRAY2RGB);
-        } else {
-            cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+// every detected position of the burst drawn over one frame, top camera above
+// bottom. detections are in frame coordinates, the bottom ones just move down
+// by the height of the top image
+static cv::Mat render_streak(const burst_capture& burst, bool viz) {
+    const float min_movement = 10.0f;
+
+    // background is the first frame the ball has clearly left its start position
+    int first_ball_frame = -1;
+    cv::Point2f start(-1, -1);
+    for (size_t i = 0; i < burst.frames.size(); i++) {
+        const ball_detection& det = burst.frames[i].det_top;
+        if (!det.found) continue;
+        if (start.x < 0) {
+            start = det.position;
+        } else if (cv::norm(det.position - start) > min_movement) {
+            first_ball_frame = (int)i;
+            break;
         }
+    }
+    int bg_frame = (first_ball_frame > 0) ? first_ball_frame : (int)burst.pre_trigger_frames;
+    if (bg_frame >= (int)burst.frames.size()) bg_frame = (int)burst.frames.size() - 1;
 
-        if (texture_id == 0) {
-            glGenTextures(1, &texture_id);
-        }
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, rgb.data);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    cv::Mat streak_img = compose_burst_frame(burst.frames[bg_frame], viz);
+    if (streak_img.channels() == 1) {
+        cv::cvtColor(streak_img, streak_img, cv::COLOR_GRAY2BGR);
     }
-    void* get_id() {
-        return (void*)(intptr_t)texture_id;
+    int split = burst.frames[bg_frame].top.image.rows;
+
+    std::cout << "using frame " << bg_frame << "/" << burst.frames.size() << " as background" << std::endl;
+
+    cv::line(streak_img, cv::Point(0, split), cv::Point(streak_img.cols, split), cv::Scalar(255, 0, 255), 3);
+    cv::putText(streak_img, "BALL FLIGHT", cv::Point(20, 30),
+                cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 255, 255), 2);
+
+    std::vector<cv::Point2f> ball_positions;
+    int frame_num = 0;
+    auto mark = [&](const ball_detection& det, float y_offset) {
+        cv::Point2f pos(det.position.x, det.position.y + y_offset);
+
+        bool should_draw = ball_positions.empty();
+        if (!ball_positions.empty() && cv::norm(ball_positions.back() - pos) > min_movement) {
+            should_draw = true;
+            cv::line(streak_img, ball_positions.back(), pos, cv::Scalar(0, 150, 255), 2);
+        }
+        if (should_draw) {
+            ball_positions.push_back(pos);
+            cv::circle(streak_img, pos, (int)det.radius + 5, cv::Scalar(0, 255, 0), 4);
+            cv::circle(streak_img, pos, 10, cv::Scalar(0, 255, 255), -1);
+            cv::putText(streak_img, std::to_string(frame_num), cv::Point(pos.x + 20, pos.y - 20),
+                        cv::FONT_HERSHEY_SIMPLEX, 1.2, cv::Scalar(255, 255, 0), 3);
+            frame_num++;
+        }
+    };
+    for (const auto& det : burst.dets_top) {
+        mark(det, 0);
     }
-    ImVec2 size() {
-        return ImVec2((float)width, (float)height);
+    for (const auto& det : burst.dets_bottom) {
+        mark(det, (float)split);
     }
+
+    std::cout << "streak view created with " << frame_num << " ball positions" << std::endl;
+    return streak_img;
+}
+
+// everything the ui shows about a finished burst. built on the worker pool
+// so neither the ui nor the capture path waits on vconcat and drawing
+struct shot_views {
+    std::vector<cv::Mat> thumbnails;
+    cv::Mat streak;
+    std::vector<cv::Mat> playback;      // half size, one per burst frame
 };
 
-static void overlay(float fps, bool cam0, bool cam1) {
+static shot_views render_shot_views(const burst_capture& burst, bool viz) {
+    shot_views views;
+    for (size_t i = burst.test ? 0 : burst.pre_trigger_frames; i < burst.frames.size() && views.thumbnails.size() < 3; i++) {
+        views.thumbnails.push_back(compose_burst_frame(burst.frames[i], viz));
+    }
+    if (burst.test) {
+        return views;
+    }
+
+    if (!burst.frames.empty() && (!burst.dets_top.empty() || !burst.dets_bottom.empty())) {
+        std::cout << "generating streak view with " << burst.dets_top.size() << " top + "
+                  << burst.dets_bottom.size() << " bottom detections..." << std::endl;
+        views.streak = render_streak(burst, viz);
+    }
+
+    // the playback panel is well under full size, so half resolution is plenty
+    // and lets the pool frames go back as soon as this is done
+    views.playback.reserve(burst.frames.size());
+    for (const auto& f : burst.frames) {
+        cv::Mat composed = compose_burst_frame(f, viz);
+        cv::Mat half;
+        cv::resize(composed, half, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+        views.playback.push_back(half);
+    }
+    return views;
+}
+
+// process cpu time over wall time, refreshed about once a second
+static float process_cpu_percent() {
+    static std::clock_t last_cpu = std::clock();
+    static capture_clock::time_point last_wall = capture_clock::now();
+    static float percent = 0;
+
+    capture_clock::time_point now = capture_clock::now();
+    double wall = std::chrono::duration<double>(now - last_wall).count();
+    if (wall >= 1.0) {
+        std::clock_t cpu = std::clock();
+        percent = (float)(100.0 * (double)(cpu - last_cpu) / CLOCKS_PER_SEC / wall);
+        last_cpu = cpu;
+        last_wall = now;
+    }
+    return percent;
+}
+
+static void overlay(float fps, const camera_capture& top, const camera_capture& bottom,
+                    const monitor_status& status, const std::vector<stage_stats>& stages) {
     ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
                              ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
                              ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
@@ -72,34 +175,137 @@ static void overlay(float fps, bool cam0, bool cam1) {
 
     if (ImGui::Begin("overlay", nullptr, flags)) {
         ImGui::Text("fps: %.1f", fps);
-        ImGui::Text("top: %s", cam0 ? "ok" : "x");
-        ImGui::Text("bottom: %s", cam1 ? "ok" : "x");
+        ImGui::Text("top: %s", top.is_open() ? "ok" : "x");
+        ImGui::Text("bottom: %s", bottom.is_open() ? "ok" : "x");
+        ImGui::Text("dropped: %llu / %llu",
+            (unsigned long long)top.dropped(), (unsigned long long)bottom.dropped());
+        ImGui::Text("pool: %zu/%zu  misses: %llu / %llu",
+            top.frames().in_use() + bottom.frames().in_use(),
+            top.frames().capacity() + bottom.frames().capacity(),
+            (unsigned long long)top.frames().pool_misses(),
+            (unsigned long long)bottom.frames().pool_misses());
+        ImGui::Text("searched: %.0f%% / %.0f%%  burst: %.0f%% / %.0f%%",
+            status.searched_top * 100.0, status.searched_bottom * 100.0,
+            status.burst_searched_top * 100.0, status.burst_searched_bottom * 100.0);
+        ImGui::Text("trigger: %.0f / %.0f us  fired: %llu / %llu  latency: %.1f / %.1f ms",
+            status.trigger_us_top, status.trigger_us_bottom,
+            (unsigned long long)status.fired_top, (unsigned long long)status.fired_bottom,
+            status.latency_top, status.latency_bottom);
+        ImGui::Text("tracks: %d / %d  dropped bursts: %llu  background: %s (%d frames)",
+            status.tracks_top, status.tracks_bottom, (unsigned long long)status.dropped_bursts,
+            status.background ? "on" : "off", status.background_frames);
+        for (const auto& s : stages) {
+            if (s.has_input) {
+                ImGui::Text("%s: %llu  q %zu/%zu max %zu  drop %llu  wait %.0f us  run %.0f/%.0f us",
+                    s.name.c_str(), (unsigned long long)s.processed,
+                    s.input.depth, s.input.capacity, s.input.high_water,
+                    (unsigned long long)s.input.dropped, s.input.average_wait_us,
+                    s.average_service_us, s.max_service_us);
+            } else {
+                ImGui::Text("%s: %llu  run %.0f/%.0f us",
+                    s.name.c_str(), (unsigned long long)s.processed, s.average_service_us, s.max_service_us);
+            }
+        }
+        ImGui::Text("cpu: %.0f%%", process_cpu_percent());
     }
     ImGui::End();
 }
 
-int main() {
+// where each frame's time goes: every histogram against the camera frame
+// period, the frame counters, and one histogram's buckets drawn out
+static void metrics_panel(metrics_registry& metrics, bool* open) {
+    ImGui::SetNextWindowSize(ImVec2(640, 420), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("metrics", open)) {
+        ImGui::End();
+        return;
+    }
+    static int selected = 0;
+    metrics_snapshot s = metrics.snapshot();
+    const double budget_us = 1e6 / capture_settings().fps;
+
+    ImGui::Text("frame budget: %.2f ms at %d fps", budget_us / 1000.0, capture_settings().fps);
+    ImGui::SameLine();
+    if (ImGui::Button("reset")) {
+        metrics.reset();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("dump")) {
+        metrics.dump("launch_monitor_metrics.txt");
+    }
+
+    ImGuiTableFlags table_flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp;
+    if (ImGui::BeginTable("histograms", 8, table_flags)) {
+        ImGui::TableSetupColumn("us");
+        ImGui::TableSetupColumn("count");
+        ImGui::TableSetupColumn("mean");
+        ImGui::TableSetupColumn("p50");
+        ImGui::TableSetupColumn("p90");
+        ImGui::TableSetupColumn("p99");
+        ImGui::TableSetupColumn("max");
+        ImGui::TableSetupColumn("of budget");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < (int)s.histograms.size(); i++) {
+            const histogram_snapshot& h = s.histograms[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (ImGui::Selectable(h.name.c_str(), selected == i, ImGuiSelectableFlags_SpanAllColumns)) {
+                selected = i;
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)h.count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", h.mean_us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", h.p50_us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", h.p90_us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", h.p99_us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", h.max_us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f%%", 100.0 * h.mean_us / budget_us);
+        }
+        ImGui::EndTable();
+    }
+
+    if (selected < (int)s.histograms.size()) {
+        const histogram_snapshot& h = s.histograms[selected];
+        std::vector<float> counts(h.buckets.begin(), h.buckets.end());
+        ImGui::PlotHistogram("##buckets", counts.data(), (int)counts.size(), 0, h.name.c_str(), 0.0f, FLT_MAX,
+                             ImVec2(ImGui::GetContentRegionAvail().x, 80));
+        ImGui::TextDisabled("1 us .. 1 s in 1-2-5 steps, last bucket over 1 s");
+    }
+
+    ImGui::Separator();
+    for (const auto& c : s.counters) {
+        ImGui::Text("%s: %llu", c.first.c_str(), (unsigned long long)c.second);
+    }
+    ImGui::End();
+}
+
+int main(int argc, char** argv) {
     bool show_overlay = true;
+    bool show_metrics = false;
     bool flip_top = true;
     bool flip_bottom = false;
     bool monitoring = false;
     bool swap = false;
+    bool record_shots = true;
     bool show_viz = true;
+    bool fused_mask = true;
+    bool blob_moments = false;
+    bool background_model = true;
     bool debug_mode = true;
-    bool test_mode = false;
 
     app_config config;
     std::string config_file = "launch_monitor.conf";
 
-    cv::Mat prev_top, prev_bottom;
-    std::deque<ball_detection> dets_top, dets_bottom;
     std::vector<cv::Mat> saved_frames;
-    std::vector<cv::Mat> all_captured_frames;
+    std::vector<cv::Mat> playback_frames;
+    std::future<shot_views> pending_views;
+    recording_reader playback_recording;
 
-    
-    const int pre_trigger_buffer_size = 15; 
-    std::deque<cv::Mat> frame_buffer_top;
-    std::deque<cv::Mat> frame_buffer_bottom;
     image_texture frame_tex[3];
     image_texture debug_tex_top;
     image_texture debug_tex_bottom;
@@ -109,22 +315,16 @@ int main() {
     bool show_playback = false;
     bool show_streak = false;
 
-    bool motion = false;
-    int cooldown = 0;
-    const int burst_frames = 40; 
-    const int motion_thresh = 30;
-
-    ball_detection prev_ball_top, prev_ball_bottom;
-    bool have_prev_ball = false;
-    const float ball_motion_threshold = 50.0f; 
-    int frames_since_prev = 0;
-
+    // the ui's copies; the monitor gets its own each frame so sliders never
+    // touch a detector while the pipeline is running it
     ball_detector detector_top(200, 0.7);
     ball_detector detector_bottom(200, 0.7);
-    shot_calculator calc;
     shot_data shot;
 
     detection_debug debug_top, debug_bottom;
+    int debug_every = 4;
+    capture_debug debug_sampler_top(debug_top, debug_every);
+    capture_debug debug_sampler_bottom(debug_bottom, debug_every);
 
     bool use_roi_top = false;
     bool use_roi_bottom = false;
@@ -160,46 +360,28 @@ int main() {
     image_texture tex_top;
     image_texture tex_bottom;
 
-    std::cout << "init cameras..." << std::endl;
-    cv::VideoCapture cap_top(0, cv::CAP_V4L2);
-    cv::VideoCapture cap_bottom(2, cv::CAP_V4L2);
-
-    bool ready = false;
-    bool top_ok = false;
-    bool bottom_ok = false;
-    
-    if (cap_top.isOpened()) {
-        cap_top.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M','J','P','G'));
-        cap_top.set(cv::CAP_PROP_FRAME_WIDTH, 1280);
-        cap_top.set(cv::CAP_PROP_FRAME_HEIGHT, 720);
-        cap_top.set(cv::CAP_PROP_FPS, 120);
-        cap_top.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.25); 
-        cap_top.set(cv::CAP_PROP_EXPOSURE, -6); 
-
-        cv::Mat test;
-        if (cap_top.read(test) && !test.empty()) {
-            top_ok = true;
-            std::cout << "top ok: " << test.cols << "x" << test.rows << std::endl;
-        }
+    // sources default to the two v4l2 devices; a directory or video file can
+    // stand in for either camera: launch_monitor [top_source bottom_source]
+    if (argc >= 3) {
+        config.top_source = argv[1];
+        config.bottom_source = argv[2];
     }
 
-    if (cap_bottom.isOpened()) {
-        cap_bottom.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M','J','P','G'));
-        cap_bottom.set(cv::CAP_PROP_FRAME_WIDTH, 1280);
-        cap_bottom.set(cv::CAP_PROP_FRAME_HEIGHT, 720);
-        cap_bottom.set(cv::CAP_PROP_FPS, 120);
-        cap_bottom.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.25); 
-        cap_bottom.set(cv::CAP_PROP_EXPOSURE, -6); 
-
-        cv::Mat test;
-        if (cap_bottom.read(test) && !test.empty()) {
-            bottom_ok = true;
-            std::cout << "bottom ok: " << test.cols << "x" << test.rows << std::endl;
-        }
+    std::cout << "init cameras..." << std::endl;
+    launch_engine engine(config);
+    shot_monitor& monitor = engine.get_monitor();
+    worker_pool& pool = engine.get_pool();
+    bool ready = engine.open();
+    if (ready) {
+        engine.start();
     }
-    
-    ready = top_ok && bottom_ok;
+    latency_histogram& upload_time = engine.get_metrics().histogram("ui.texture_upload");
+    latency_histogram& frame_time = engine.get_metrics().histogram("ui.frame_time");
+    capture_clock::time_point last_frame = capture_clock::now();
     while (!glfwWindowShouldClose(win)) {
+        capture_clock::time_point frame_start = capture_clock::now();
+        frame_time.record(frame_start - last_frame);
+        last_frame = frame_start;
         glfwPollEvents();
 
         ImGui_ImplOpenGL3_NewFrame();
@@ -221,6 +403,8 @@ int main() {
                     config.flip_top = flip_top;
                     config.flip_bottom = flip_bottom;
                     config.swap = swap;
+                    config.record_shots = record_shots;
+                    config.background_model = background_model;
                     config.top_detector.threshold = detector_top.get_threshold();
                     config.top_detector.circularity = detector_top.get_circularity();
                     config.top_detector.min_area = detector_top.get_min_area();
@@ -240,6 +424,9 @@ int main() {
                         flip_top = config.flip_top;
                         flip_bottom = config.flip_bottom;
                         swap = config.swap;
+                        record_shots = config.record_shots;
+                        background_model = config.background_model;
+                        monitor.set_background_model(background_model);
                         detector_top.set_threshold(config.top_detector.threshold);
                         detector_top.set_circularity(config.top_detector.circularity);
                         detector_top.set_min_area(config.top_detector.min_area);
@@ -260,12 +447,45 @@ int main() {
                         roi_h_bottom = config.bottom_detector.roi.height;
                     }
                 }
+                ImGui::Separator();
+                ImGui::Checkbox("record shots", &record_shots);
+                if (ImGui::MenuItem("open last shot")) {
+                    std::string path = latest_recording(engine.recording_dir());
+                    if (!path.empty() && playback_recording.open(path)) {
+                        std::cout << "playing back " << path << std::endl;
+                        shot = playback_recording.shot();
+                        playback_frames.clear();
+                        pending_views = std::future<shot_views>();
+                        playback_frame = 0;
+                        show_playback = true;
+                        playback_tex.update(compose_recorded_frame(playback_recording, 0, show_viz));
+                    }
+                }
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("view")) {
                 ImGui::Checkbox("overlay", &show_overlay);
+                ImGui::Checkbox("metrics", &show_metrics);
                 ImGui::Checkbox("detection viz", &show_viz);
                 ImGui::Checkbox("debug mode", &debug_mode);
+                if (ImGui::SliderInt("debug every n frames", &debug_every, 1, 30)) {
+                    debug_sampler_top.every = debug_every;
+                    debug_sampler_bottom.every = debug_every;
+                }
+                std::string fused_label = std::string("fused mask (") + mask_kernel_isa() + ")";
+                if (ImGui::Checkbox(fused_label.c_str(), &fused_mask)) {
+                    detector_top.set_fused_mask(fused_mask);
+                    detector_bottom.set_fused_mask(fused_mask);
+                }
+                if (ImGui::Checkbox("blob moments", &blob_moments)) {
+                    candidate_engine e = blob_moments ? candidate_engine::components : candidate_engine::contours;
+                    detector_top.set_engine(e);
+                    detector_bottom.set_engine(e);
+                }
+                std::string background_label = std::string("background model (") + background_kernel_isa() + ")";
+                if (ImGui::Checkbox(background_label.c_str(), &background_model)) {
+                    monitor.set_background_model(background_model);
+                }
                 ImGui::Separator();
                 ImGui::Checkbox("flip top", &flip_top);
                 ImGui::Checkbox("flip bottom", &flip_bottom);
@@ -490,13 +710,20 @@ int main() {
         if (shot.valid) {
             ImGui::Text("speed: %.1f mph", shot.speed_mph);
             ImGui::Text("angle: %.1f deg", shot.launch_angle_deg);
+            ImGui::Text("spin: %.0f rpm%s", shot.spin_rpm, shot.spin_measured ? "" : " (default)");
             ImGui::Text("carry: %.0f ft", shot.carry_ft);
             ImGui::Text("total: %.0f ft", shot.distance_ft);
+            ImGui::Text("apex: %.0f ft", shot.apex_ft);
+            ImGui::Text("descent: %.0f deg", shot.descent_deg);
+            ImGui::TextDisabled("fit: %d points, rms %.2f px", shot.fit_points, shot.fit_rms_px);
         } else {
             ImGui::Text("speed: --");
             ImGui::Text("angle: --");
+            ImGui::Text("spin: --");
             ImGui::Text("carry: --");
             ImGui::Text("total: --");
+            ImGui::Text("apex: --");
+            ImGui::Text("descent: --");
         }
 
         ImGui::Spacing();
@@ -507,51 +734,53 @@ int main() {
             monitoring = !monitoring;
             if (monitoring) {
                 shot = shot_data();
-                motion = false;
-                cooldown = 0;
-                test_mode = false;
-                have_prev_ball = false;
+                monitor.start();
+            } else {
+                monitor.stop();
             }
         }
 
         ImGui::Spacing();
         if (ImGui::Button("test capture", ImVec2(right_w - 20, 30))) {
-            test_mode = true;
-            dets_top.clear();
-            dets_bottom.clear();
+            monitor.test_capture();
             saved_frames.clear();
-            all_captured_frames.clear();
+            playback_frames.clear();
+            playback_recording.close();
+            pending_views = std::future<shot_views>();
             shot = shot_data();
             playback_frame = 0;
             show_playback = false;
-            std::cout << "manual test capture triggered" << std::endl;
         }
 
+        monitor_status status = monitor.get_status();
         ImGui::Spacing();
         if (monitoring) {
             ImGui::Text("status: active");
-            if (motion) {
-                ImGui::Text("capturing %d/%d", (int)dets_top.size(), burst_frames);
-            } else if (cooldown > 0) {
-                ImGui::Text("cooldown %d", cooldown);
+            if (status.state == monitor_state::capturing) {
+                ImGui::Text("capturing %d/%d", status.captured, status.burst_frames);
+            } else if (status.state == monitor_state::cooldown) {
+                ImGui::Text("cooldown %d", status.cooldown);
             } else {
                 ImGui::Text("waiting...");
             }
-        } else if (test_mode) {
+        } else if (status.testing) {
             ImGui::Text("status: test mode");
-            ImGui::Text("captured: top %d, bottom %d", (int)dets_top.size(), (int)dets_bottom.size());
+            ImGui::Text("captured: top %d, bottom %d", status.test_top, status.test_bottom);
         } else {
             ImGui::Text("status: idle");
         }
         
         if (shot.valid && ImGui::Button("reset", ImVec2(right_w - 20, 30))) {
             shot = shot_data();
-            all_captured_frames.clear();
+            playback_frames.clear();
+            playback_recording.close();
             show_playback = false;
         }
 
+        // a recording scrubs straight off the mapped file, a live shot off its prepared frames
+        int playback_count = playback_recording.is_open() ? (int)playback_recording.frame_count() : (int)playback_frames.size();
         ImGui::Spacing();
-        if (!all_captured_frames.empty()) {
+        if (playback_count > 0) {
             if (ImGui::Button(show_playback ? "hide playback" : "show playback", ImVec2((right_w - 30) / 2, 30))) {
                 show_playback = !show_playback;
             }
@@ -561,10 +790,16 @@ int main() {
             }
 
             if (show_playback) {
-                ImGui::Text("frame %d / %d", playback_frame + 1, (int)all_captured_frames.size());
-                if (ImGui::SliderInt("##playback", &playback_frame, 0, all_captured_frames.size() - 1)) {
-                    if (playback_frame >= 0 && playback_frame < all_captured_frames.size()) {
-                        playback_tex.update(all_captured_frames[playback_frame]);
+                ImGui::Text("frame %d / %d", playback_frame + 1, playback_count);
+                if (ImGui::SliderInt("##playback", &playback_frame, 0, playback_count - 1)) {
+                    if (playback_frame >= 0 && playback_frame < playback_count) {
+                        if (playback_recording.is_open()) {
+                            float playback_w = right_w - 40;
+                            cv::Size playback_px((int)playback_w, (int)(playback_w * 0.5625f));
+                            playback_tex.update(compose_recorded_frame(playback_recording, playback_frame, show_viz), playback_px);
+                        } else {
+                            playback_tex.update(playback_frames[playback_frame]);
+                        }
                     }
                 }
 
@@ -608,399 +843,76 @@ int main() {
         ImGui::End();
 
         if (show_overlay) {
-            overlay(io.Framerate, top_ok, bottom_ok);
+            overlay(io.Framerate, engine.top_camera(), engine.bottom_camera(), status, engine.stats());
+        }
+        if (show_metrics) {
+            metrics_panel(engine.get_metrics(), &show_metrics);
         }
         
+        engine.set_flip(flip_top, flip_bottom);
+        engine.set_swap(swap);
+        engine.set_record_shots(record_shots);
+        monitor.set_detectors(detector_top, detector_bottom);
+
         if (ready) {
-            cv::Mat f_top, f_bottom;
-            bool got_top = cap_top.read(f_top);
-            bool got_bottom = cap_bottom.read(f_bottom);
-            if (got_top && got_bottom) {
-                if (flip_top) cv::flip(f_top, f_top, -1);
-                if (flip_bottom) cv::flip(f_bottom, f_bottom, -1);
-
-                cv::Mat g_top, g_bottom;
-                if (f_top.channels() == 3) {
-                    cv::cvtColor(f_top, g_top, cv::COLOR_BGR2GRAY);
-                } else {
-                    g_top = f_top;
-                }
+            // the numbers show straight away, the pictures follow when the pool has them
+            shot_result result;
+            while (engine.poll_result(result)) {
+                shot = result.shot;
+                std::shared_ptr<const burst_capture> burst = result.burst;
+                bool viz = show_viz;
+                playback_recording.close();
+                pending_views = pool.submit([burst, viz]() { return render_shot_views(*burst, viz); });
+            }
 
-                if (f_bottom.channels() == 3) {
-                    cv::cvtColor(f_bottom, g_bottom, cv::COLOR_BGR2GRAY);
-                } else {
-                    g_bottom = f_bottom;
-                }
+            if (pending_views.valid() && pending_views.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                capture_clock::time_point begin = capture_clock::now();
+                shot_views views = pending_views.get();
 
-                if (debug_mode) {
-                    detector_top.find_ball_debug(g_top, debug_top);
-                    detector_bottom.find_ball_debug(g_bottom, debug_bottom);
-                    if (!debug_top.morphed_img.empty()) {
-                        debug_tex_top.update(debug_top.morphed_img);
-                    }
-                    if (!debug_bottom.morphed_img.empty()) {
-                        debug_tex_bottom.update(debug_bottom.morphed_img);
-                    }
+                saved_frames = std::move(views.thumbnails);
+                for (int i = 0; i < saved_frames.size() && i < 3; i++) {
+                    frame_tex[i].update(saved_frames[i]);
                 }
-
-                if (!monitoring) {
-                    if (swap) {
-                        tex_top.update(g_bottom);
-                        tex_bottom.update(g_top);
-                    } else {
-                        tex_top.update(g_top);
-                        tex_bottom.update(g_bottom);
-                    }
+                if (!views.streak.empty()) {
+                    streak_tex.update(views.streak);
                 }
-
-                if (test_mode && dets_top.size() < burst_frames) {
-                    ball_detection d_top, d_bottom;
-
-                    if (show_viz) {
-                        cv::Mat viz_top = g_top.clone();
-                        cv::Mat viz_bottom = g_bottom.clone();
-                        d_top = detector_top.find_ball_visual(viz_top);
-                        d_bottom = detector_bottom.find_ball_visual(viz_bottom);
-                        if (saved_frames.size() < 3) {
-                            cv::Mat combined;
-                            cv::vconcat(viz_top, viz_bottom, combined);
-                            saved_frames.push_back(combined);
-                        }
-                    } else {
-                        d_top = detector_top.find_ball(g_top);
-                        d_bottom = detector_bottom.find_ball(g_bottom);
-                        if (saved_frames.size() < 3) {
-                            cv::Mat combined;
-                            cv::vconcat(g_top, g_bottom, combined);
-                            saved_frames.push_back(combined);
-                        }
-                    }
-
-                    if (d_top.found) {
-                        dets_top.push_back(d_top);
-                        std::cout << "top: ball at (" << d_top.position.x << ", " << d_top.position.y
-                                  << ") r=" << d_top.radius << std::endl;
-                    }
-                    if (d_bottom.found) {
-                        dets_bottom.push_back(d_bottom);
-                        std::cout << "bottom: ball at (" << d_bottom.position.x << ", " << d_bottom.position.y
-                                  << ") r=" << d_bottom.radius << std::endl;
-                    }
-
-                    if (dets_top.size() >= burst_frames || dets_bottom.size() >= burst_frames) {
-                        test_mode = false;
-
-                        std::vector<ball_detection> v_top(dets_top.begin(), dets_top.end());
-                        std::vector<ball_detection> v_bottom(dets_bottom.begin(), dets_bottom.end());
-
-                        if (swap) {
-                            shot = calc.calculate_shot(v_bottom, v_top);
-                        } else {
-                            shot = calc.calculate_shot(v_top, v_bottom);
-                        }
-
-                        for (int i = 0; i < saved_frames.size() && i < 3; i++) {
-                            frame_tex[i].update(saved_frames[i]);
-                        }
-
-                        std::cout << "test capture complete! top: " << v_top.size()
-                                  << " bottom: " << v_bottom.size() << std::endl;
-                    }
+                if (!views.playback.empty()) {
+                    playback_frames = std::move(views.playback);
+                    playback_frame = 0;
+                    playback_tex.update(playback_frames[0]);
                 }
+                engine.present_stage().record(capture_clock::now() - begin);
             }
-        }
-
-        if (monitoring && ready) {
-            cv::Mat f_top, f_bottom;
-            bool got_top = cap_top.read(f_top);
-            bool got_bottom = cap_bottom.read(f_bottom);
-            if (got_top && got_bottom) {
-                if (flip_top) cv::flip(f_top, f_top, -1);
-                if (flip_bottom) cv::flip(f_bottom, f_bottom, -1);
-
-                cv::Mat g_top, g_bottom;
-                if (f_top.channels() == 3) {
-                    cv::cvtColor(f_top, g_top, cv::COLOR_BGR2GRAY);
-                } else {
-                    g_top = f_top;
-                }
 
-                if (f_bottom.channels() == 3) {
-                    cv::cvtColor(f_bottom, g_bottom, cv::COLOR_BGR2GRAY);
-                } else {
-                    g_bottom = f_bottom;
-                }
-                
-                
-                frame_buffer_top.push_back(g_top.clone());
-                frame_buffer_bottom.push_back(g_bottom.clone());
-                if (frame_buffer_top.size() > pre_trigger_buffer_size) {
-                    frame_buffer_top.pop_front();
-                    frame_buffer_bottom.pop_front();
-                }
-
-                if (!motion && cooldown == 0) {
-                    
-                    ball_detection curr_ball_top = detector_top.find_ball(g_top);
-                    ball_detection curr_ball_bottom = detector_bottom.find_ball(g_bottom);
-
-                    frames_since_prev++;
-
-                    
-                    if (have_prev_ball && frames_since_prev <= 3 && (curr_ball_top.found || curr_ball_bottom.found)) {
-                        float ball_movement = 0;
-
-                        if (curr_ball_top.found && prev_ball_top.found) {
-                            float dx = curr_ball_top.position.x - prev_ball_top.position.x;
-                            float dy = curr_ball_top.position.y - prev_ball_top.position.y;
-                            ball_movement = sqrt(dx * dx + dy * dy);
-                        }
-
-                        if (curr_ball_bottom.found && prev_ball_bottom.found) {
-                            float dx = curr_ball_bottom.position.x - prev_ball_bottom.position.x;
-                            float dy = curr_ball_bottom.position.y - prev_ball_bottom.position.y;
-                            float bottom_movement = sqrt(dx * dx + dy * dy);
-                            ball_movement = std::max(ball_movement, bottom_movement);
-                        }
-
-                        if (ball_movement > ball_motion_threshold) {
-                            motion = true;
-                            dets_top.clear();
-                            dets_bottom.clear();
-                            saved_frames.clear();
-                            all_captured_frames.clear();
-
-                            
-                            std::cout << "ball motion detected: " << ball_movement << " pixels in "
-                                      << frames_since_prev << " frames" << std::endl;
-                            std::cout << "adding " << frame_buffer_top.size() << " pre-trigger frames" << std::endl;
-
-                            
-                            for (size_t i = 0; i < frame_buffer_top.size(); i++) {
-                                cv::Mat buffered_top = frame_buffer_top[i];
-                                cv::Mat buffered_bottom = frame_buffer_bottom[i];
-
-                                if (show_viz) {
-                                    cv::Mat viz_top = buffered_top.clone();
-                                    cv::Mat viz_bottom = buffered_bottom.clone();
-                                    ball_detection d_top = detector_top.find_ball_visual(viz_top);
-                                    ball_detection d_bottom = detector_bottom.find_ball_visual(viz_bottom);
-
-                                    if (d_top.found) dets_top.push_back(d_top);
-                                    if (d_bottom.found) dets_bottom.push_back(d_bottom);
-
-                                    cv::Mat combined;
-                                    cv::vconcat(viz_top, viz_bottom, combined);
-                                    all_captured_frames.push_back(combined);
-                                } else {
-                                    ball_detection d_top = detector_top.find_ball(buffered_top);
-                                    ball_detection d_bottom = detector_bottom.find_ball(buffered_bottom);
-
-                                    if (d_top.found) dets_top.push_back(d_top);
-                                    if (d_bottom.found) dets_bottom.push_back(d_bottom);
-
-                                    cv::Mat combined;
-                                    cv::vconcat(buffered_top, buffered_bottom, combined);
-                                    all_captured_frames.push_back(combined);
-                                }
-                            }
-
-                            
-                            frame_buffer_top.clear();
-                            frame_buffer_bottom.clear();
-                        }
+            // only the newest pair is worth drawing
+            frame_pair latest;
+            if (engine.latest_preview(latest)) {
+                capture_clock::time_point begin = capture_clock::now();
+                // upload no more pixels than the widgets will draw
+                ImVec2 fb_scale = io.DisplayFramebufferScale;
+                cv::Size preview_px((int)(cam_sz * fb_scale.x), (int)(cam_sz * 0.5625f * fb_scale.y));
+                cv::Size debug_px((int)(((right_w - 20) * 0.45f - 10) * fb_scale.x), (int)(270 * fb_scale.y));
+                if (debug_mode) {
+                    if (detector_top.find_ball_debug(latest.top, debug_sampler_top) && !debug_top.morphed_img.empty()) {
+                        debug_tex_top.update(debug_top.morphed_img, debug_px);
                     }
-
-                    
-                    if (frames_since_prev >= 3) {
-                        prev_ball_top = curr_ball_top;
-                        prev_ball_bottom = curr_ball_bottom;
-                        frames_since_prev = 0;
-                        if (curr_ball_top.found || curr_ball_bottom.found) {
-                            have_prev_ball = true;
-                        }
+                    if (detector_bottom.find_ball_debug(latest.bottom, debug_sampler_bottom) && !debug_bottom.morphed_img.empty()) {
+                        debug_tex_bottom.update(debug_bottom.morphed_img, debug_px);
                     }
                 }
-                
-                if (motion && all_captured_frames.size() < burst_frames) {
-                    ball_detection d_top, d_bottom;
-
-                    if (show_viz) {
-                        cv::Mat viz_top = g_top.clone();
-                        cv::Mat viz_bottom = g_bottom.clone();
-                        d_top = detector_top.find_ball_visual(viz_top);
-                        d_bottom = detector_bottom.find_ball_visual(viz_bottom);
-
-                        
-                        if (saved_frames.size() < 3) {
-                            cv::Mat combined;
-                            cv::vconcat(viz_top, viz_bottom, combined);
-                            saved_frames.push_back(combined);
-                        }
-
-                        
-                        cv::Mat playback_combined;
-                        cv::vconcat(viz_top, viz_bottom, playback_combined);
-                        all_captured_frames.push_back(playback_combined);
-                    } else {
-                        d_top = detector_top.find_ball(g_top);
-                        d_bottom = detector_bottom.find_ball(g_bottom);
-
-                        if (saved_frames.size() < 3) {
-                            cv::Mat combined;
-                            cv::vconcat(g_top, g_bottom, combined);
-                            saved_frames.push_back(combined);
-                        }
 
-                        cv::Mat playback_combined;
-                        cv::vconcat(g_top, g_bottom, playback_combined);
-                        all_captured_frames.push_back(playback_combined);
-                    }
-
-                    if (d_top.found) dets_top.push_back(d_top);
-                    if (d_bottom.found) dets_bottom.push_back(d_bottom);
-
-                    if (all_captured_frames.size() >= burst_frames) {
-                        motion = false;
-                        cooldown = 90;
-                        have_prev_ball = false;
-
-                        std::vector<ball_detection> v_top(dets_top.begin(), dets_top.end());
-                        std::vector<ball_detection> v_bottom(dets_bottom.begin(), dets_bottom.end());
-
-                        if (swap) {
-                            shot = calc.calculate_shot(v_bottom, v_top);
-                        } else {
-                            shot = calc.calculate_shot(v_top, v_bottom);
-                        }
-
-                        for (int i = 0; i < saved_frames.size() && i < 3; i++) {
-                            frame_tex[i].update(saved_frames[i]);
-                        }
-
-                        
-                        if (!all_captured_frames.empty() && (!v_top.empty() || !v_bottom.empty())) {
-                            std::cout << "generating streak view with " << v_top.size() << " top + "
-                                     << v_bottom.size() << " bottom detections..." << std::endl;
-
-                            
-                            int first_ball_frame = -1;
-                            cv::Point2f prev_ball_pos(-1, -1);
-
-                            for (size_t i = 0; i < v_top.size(); i++) {
-                                if (v_top[i].found) {
-                                    if (prev_ball_pos.x < 0) {
-                                        prev_ball_pos = v_top[i].position;
-                                    } else {
-                                        float dist = cv::norm(v_top[i].position - prev_ball_pos);
-                                        if (dist > 10.0f) {
-                                            first_ball_frame = i;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-
-                            
-                            int bg_frame = (first_ball_frame > 0) ? first_ball_frame : 15;
-                            if (bg_frame >= (int)all_captured_frames.size()) bg_frame = all_captured_frames.size() - 1;
-
-                            cv::Mat streak_img = all_captured_frames[bg_frame].clone();
-
-                            std::cout << "using frame " << bg_frame << "/" << all_captured_frames.size()
-                                     << " as background" << std::endl;
-
-                            
-                            cv::line(streak_img, cv::Point(0, 720), cv::Point(1280, 720),
-                                    cv::Scalar(255, 0, 255), 3);
-                            cv::putText(streak_img, "BALL FLIGHT", cv::Point(20, 30),
-                                       cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 255, 255), 2);
-
-                            
-                            std::vector<cv::Point2f> ball_positions;
-                            int frame_num = 0;
-                            const float MIN_MOVEMENT = 10.0f; 
-
-                            
-                            for (const auto& det : v_top) {
-                                if (det.found) {
-                                    
-                                    cv::Point2f pos(det.position.x + (use_roi_top ? roi_x_top : 0),
-                                                   det.position.y + (use_roi_top ? roi_y_top : 0));
-
-                                    
-                                    bool should_draw = ball_positions.empty();
-                                    if (!ball_positions.empty()) {
-                                        float dist = cv::norm(ball_positions.back() - pos);
-                                        if (dist > MIN_MOVEMENT) {
-                                            should_draw = true;
-                                            cv::line(streak_img, ball_positions.back(), pos,
-                                                    cv::Scalar(0, 150, 255), 2);
-                                        }
-                                    }
-
-                                    if (should_draw) {
-                                        ball_positions.push_back(pos);
-                                        cv::circle(streak_img, pos, (int)det.radius + 5, cv::Scalar(0, 255, 0), 4);
-                                        cv::circle(streak_img, pos, 10, cv::Scalar(0, 255, 255), -1);
-                                        cv::putText(streak_img, std::to_string(frame_num),
-                                                   cv::Point(pos.x + 20, pos.y - 20),
-                                                   cv::FONT_HERSHEY_SIMPLEX, 1.2, cv::Scalar(255, 255, 0), 3);
-                                        frame_num++;
-                                    }
-                                }
-                            }
-
-                            
-                            for (const auto& det : v_bottom) {
-                                if (det.found) {
-                                    
-                                    cv::Point2f pos(det.position.x + (use_roi_bottom ? roi_x_bottom : 0),
-                                                   det.position.y + (use_roi_bottom ? roi_y_bottom : 0) + 720);
-
-                                    
-                                    bool should_draw = ball_positions.empty();
-                                    if (!ball_positions.empty()) {
-                                        float dist = cv::norm(ball_positions.back() - pos);
-                                        if (dist > MIN_MOVEMENT) {
-                                            should_draw = true;
-                                            cv::line(streak_img, ball_positions.back(), pos,
-                                                    cv::Scalar(0, 150, 255), 2);
-                                        }
-                                    }
-
-                                    if (should_draw) {
-                                        ball_positions.push_back(pos);
-                                        cv::circle(streak_img, pos, (int)det.radius + 5, cv::Scalar(0, 255, 0), 4);
-                                        cv::circle(streak_img, pos, 10, cv::Scalar(0, 255, 255), -1);
-                                        cv::putText(streak_img, std::to_string(frame_num),
-                                                   cv::Point(pos.x + 20, pos.y - 20),
-                                                   cv::FONT_HERSHEY_SIMPLEX, 1.2, cv::Scalar(255, 255, 0), 3);
-                                        frame_num++;
-                                    }
-                                }
-                            }
-
-                            streak_tex.update(streak_img);
-                            std::cout << "streak view created with " << frame_num << " ball positions" << std::endl;
-                        }
-                    }
-                }
-                
+                capture_clock::time_point upload_begin = capture_clock::now();
                 if (swap) {
-                    tex_top.update(g_bottom);
-                    tex_bottom.update(g_top);
+                    tex_top.update(latest.bottom.image, preview_px);
+                    tex_bottom.update(latest.top.image, preview_px);
                 } else {
-                    tex_top.update(g_top);
-                    tex_bottom.update(g_bottom);
+                    tex_top.update(latest.top.image, preview_px);
+                    tex_bottom.update(latest.bottom.image, preview_px);
                 }
-                
-                prev_top = g_top;
-                prev_bottom = g_bottom;
+                upload_time.record(capture_clock::now() - upload_begin);
+                engine.render_stage().record(capture_clock::now() - begin);
             }
         }
-        
-        if (cooldown > 0) cooldown--;
 
         ImGui::Render();
         int dw, dh;
@@ -1013,6 +925,8 @@ int main() {
         glfwSwapBuffers(win);
     }
 
+    engine.stop();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
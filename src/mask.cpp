@@ -0,0 +1,480 @@
+#include "mask.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MASK_X86 1
+#endif
+
+// 9 tap gaussian, sigma 2, in 8-bit fixed point (sums to 256)
+static const uint16_t gaussian_9[9] = {7, 17, 32, 46, 52, 46, 32, 17, 7};
+
+struct mask_kernels {
+    const char* isa;
+    // padded source row (w + 8) -> horizontal blur, 8.8 fixed point
+    void (*hblur)(const uint8_t* src, uint16_t* dst, int w, const uint16_t* c);
+    // 9 horizontally blurred rows -> 255 where the rounded blur is above the threshold
+    void (*vblur_threshold)(const uint16_t* const* rows, uint8_t* dst, int w, const uint16_t* c, int32_t limit);
+    // padded row (w + 4) -> min/max over 5 columns
+    void (*hmin5)(const uint8_t* src, uint8_t* dst, int w);
+    void (*hmax5)(const uint8_t* src, uint8_t* dst, int w);
+    // min/max of five rows, element-wise
+    void (*vmin5)(const uint8_t* const* rows, uint8_t* dst, int w);
+    void (*vmax5)(const uint8_t* const* rows, uint8_t* dst, int w);
+};
+
+// scalar versions, also used for the tail of each simd row
+
+static void hblur_scalar(const uint8_t* src, uint16_t* dst, int w, const uint16_t* c) {
+    for (int x = 0; x < w; x++) {
+        uint32_t acc = 0;
+        for (int j = 0; j < 9; j++) {
+            acc += c[j] * src[x + j];
+        }
+        dst[x] = (uint16_t)acc;
+    }
+}
+
+static void vblur_threshold_scalar_from(const uint16_t* const* rows, uint8_t* dst, int x, int w, const uint16_t* c, int32_t limit) {
+    for (; x < w; x++) {
+        int32_t acc = 0;
+        for (int k = 0; k < 9; k++) {
+            acc += (int32_t)c[k] * rows[k][x];
+        }
+        dst[x] = acc >= limit ? 255 : 0;
+    }
+}
+
+static void vblur_threshold_scalar(const uint16_t* const* rows, uint8_t* dst, int w, const uint16_t* c, int32_t limit) {
+    vblur_threshold_scalar_from(rows, dst, 0, w, c, limit);
+}
+
+static void hmin5_scalar_from(const uint8_t* src, uint8_t* dst, int x, int w) {
+    for (; x < w; x++) {
+        dst[x] = std::min(std::min(std::min(src[x], src[x + 1]), std::min(src[x + 2], src[x + 3])), src[x + 4]);
+    }
+}
+
+static void hmax5_scalar_from(const uint8_t* src, uint8_t* dst, int x, int w) {
+    for (; x < w; x++) {
+        dst[x] = std::max(std::max(std::max(src[x], src[x + 1]), std::max(src[x + 2], src[x + 3])), src[x + 4]);
+    }
+}
+
+static void vmin5_scalar_from(const uint8_t* const* r, uint8_t* dst, int x, int w) {
+    for (; x < w; x++) {
+        dst[x] = std::min(std::min(std::min(r[0][x], r[1][x]), std::min(r[2][x], r[3][x])), r[4][x]);
+    }
+}
+
+static void vmax5_scalar_from(const uint8_t* const* r, uint8_t* dst, int x, int w) {
+    for (; x < w; x++) {
+        dst[x] = std::max(std::max(std::max(r[0][x], r[1][x]), std::max(r[2][x], r[3][x])), r[4][x]);
+    }
+}
+
+static void hmin5_scalar(const uint8_t* src, uint8_t* dst, int w) { hmin5_scalar_from(src, dst, 0, w); }
+static void hmax5_scalar(const uint8_t* src, uint8_t* dst, int w) { hmax5_scalar_from(src, dst, 0, w); }
+static void vmin5_scalar(const uint8_t* const* r, uint8_t* dst, int w) { vmin5_scalar_from(r, dst, 0, w); }
+static void vmax5_scalar(const uint8_t* const* r, uint8_t* dst, int w) { vmax5_scalar_from(r, dst, 0, w); }
+
+#ifdef MASK_X86
+
+// sse2 is part of x86-64, so these need no dispatch check there
+
+__attribute__((target("sse2")))
+static void hblur_sse2(const uint8_t* src, uint16_t* dst, int w, const uint16_t* c) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i acc = _mm_setzero_si128();
+        for (int j = 0; j < 9; j++) {
+            __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + x + j)), zero);
+            acc = _mm_add_epi16(acc, _mm_mullo_epi16(p, _mm_set1_epi16((short)c[j])));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), acc);
+    }
+    for (; x < w; x++) {
+        uint32_t acc = 0;
+        for (int j = 0; j < 9; j++) {
+            acc += c[j] * src[x + j];
+        }
+        dst[x] = (uint16_t)acc;
+    }
+}
+
+__attribute__((target("sse2")))
+static void vblur_threshold_sse2(const uint16_t* const* rows, uint8_t* dst, int w, const uint16_t* c, int32_t limit) {
+    const __m128i below = _mm_set1_epi32(limit - 1);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i acc_lo = _mm_setzero_si128();
+        __m128i acc_hi = _mm_setzero_si128();
+        for (int k = 0; k < 9; k++) {
+            // full 16x16 -> 32 bit products from the low and high halves
+            __m128i h = _mm_loadu_si128((const __m128i*)(rows[k] + x));
+            __m128i ck = _mm_set1_epi16((short)c[k]);
+            __m128i lo = _mm_mullo_epi16(h, ck);
+            __m128i hi = _mm_mulhi_epu16(h, ck);
+            acc_lo = _mm_add_epi32(acc_lo, _mm_unpacklo_epi16(lo, hi));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_unpackhi_epi16(lo, hi));
+        }
+        __m128i m = _mm_packs_epi32(_mm_cmpgt_epi32(acc_lo, below), _mm_cmpgt_epi32(acc_hi, below));
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packs_epi16(m, m));
+    }
+    vblur_threshold_scalar_from(rows, dst, x, w, c, limit);
+}
+
+__attribute__((target("sse2")))
+static void hmin5_sse2(const uint8_t* src, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(src + x));
+        for (int j = 1; j < 5; j++) {
+            m = _mm_min_epu8(m, _mm_loadu_si128((const __m128i*)(src + x + j)));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), m);
+    }
+    hmin5_scalar_from(src, dst, x, w);
+}
+
+__attribute__((target("sse2")))
+static void hmax5_sse2(const uint8_t* src, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(src + x));
+        for (int j = 1; j < 5; j++) {
+            m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i*)(src + x + j)));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), m);
+    }
+    hmax5_scalar_from(src, dst, x, w);
+}
+
+__attribute__((target("sse2")))
+static void vmin5_sse2(const uint8_t* const* r, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(r[0] + x));
+        for (int k = 1; k < 5; k++) {
+            m = _mm_min_epu8(m, _mm_loadu_si128((const __m128i*)(r[k] + x)));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), m);
+    }
+    vmin5_scalar_from(r, dst, x, w);
+}
+
+__attribute__((target("sse2")))
+static void vmax5_sse2(const uint8_t* const* r, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(r[0] + x));
+        for (int k = 1; k < 5; k++) {
+            m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i*)(r[k] + x)));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), m);
+    }
+    vmax5_scalar_from(r, dst, x, w);
+}
+
+__attribute__((target("avx2")))
+static void hblur_avx2(const uint8_t* src, uint16_t* dst, int w, const uint16_t* c) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int j = 0; j < 9; j++) {
+            __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x + j)));
+            acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(p, _mm256_set1_epi16((short)c[j])));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), acc);
+    }
+    for (; x < w; x++) {
+        uint32_t acc = 0;
+        for (int j = 0; j < 9; j++) {
+            acc += c[j] * src[x + j];
+        }
+        dst[x] = (uint16_t)acc;
+    }
+}
+
+__attribute__((target("avx2")))
+static void vblur_threshold_avx2(const uint16_t* const* rows, uint8_t* dst, int w, const uint16_t* c, int32_t limit) {
+    const __m256i below = _mm256_set1_epi32(limit - 1);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i acc_lo = _mm256_setzero_si256();
+        __m256i acc_hi = _mm256_setzero_si256();
+        for (int k = 0; k < 9; k++) {
+            __m256i h = _mm256_loadu_si256((const __m256i*)(rows[k] + x));
+            __m256i ck = _mm256_set1_epi16((short)c[k]);
+            __m256i lo = _mm256_mullo_epi16(h, ck);
+            __m256i hi = _mm256_mulhi_epu16(h, ck);
+            acc_lo = _mm256_add_epi32(acc_lo, _mm256_unpacklo_epi16(lo, hi));
+            acc_hi = _mm256_add_epi32(acc_hi, _mm256_unpackhi_epi16(lo, hi));
+        }
+        // unpack and pack both work per 128-bit lane, so the order comes back
+        // out right after packing; only the final byte halves need gathering
+        __m256i m = _mm256_packs_epi32(_mm256_cmpgt_epi32(acc_lo, below), _mm256_cmpgt_epi32(acc_hi, below));
+        __m256i b = _mm256_permute4x64_epi64(_mm256_packs_epi16(m, m), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(b));
+    }
+    vblur_threshold_scalar_from(rows, dst, x, w, c, limit);
+}
+
+__attribute__((target("avx2")))
+static void hmin5_avx2(const uint8_t* src, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(src + x));
+        for (int j = 1; j < 5; j++) {
+            m = _mm256_min_epu8(m, _mm256_loadu_si256((const __m256i*)(src + x + j)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), m);
+    }
+    hmin5_scalar_from(src, dst, x, w);
+}
+
+__attribute__((target("avx2")))
+static void hmax5_avx2(const uint8_t* src, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(src + x));
+        for (int j = 1; j < 5; j++) {
+            m = _mm256_max_epu8(m, _mm256_loadu_si256((const __m256i*)(src + x + j)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), m);
+    }
+    hmax5_scalar_from(src, dst, x, w);
+}
+
+__attribute__((target("avx2")))
+static void vmin5_avx2(const uint8_t* const* r, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(r[0] + x));
+        for (int k = 1; k < 5; k++) {
+            m = _mm256_min_epu8(m, _mm256_loadu_si256((const __m256i*)(r[k] + x)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), m);
+    }
+    vmin5_scalar_from(r, dst, x, w);
+}
+
+__attribute__((target("avx2")))
+static void vmax5_avx2(const uint8_t* const* r, uint8_t* dst, int w) {
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(r[0] + x));
+        for (int k = 1; k < 5; k++) {
+            m = _mm256_max_epu8(m, _mm256_loadu_si256((const __m256i*)(r[k] + x)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), m);
+    }
+    vmax5_scalar_from(r, dst, x, w);
+}
+
+#endif
+
+static const mask_kernels scalar_kernels = {
+    "scalar", hblur_scalar, vblur_threshold_scalar, hmin5_scalar, hmax5_scalar, vmin5_scalar, vmax5_scalar
+};
+
+#ifdef MASK_X86
+static const mask_kernels sse2_kernels = {
+    "sse2", hblur_sse2, vblur_threshold_sse2, hmin5_sse2, hmax5_sse2, vmin5_sse2, vmax5_sse2
+};
+static const mask_kernels avx2_kernels = {
+    "avx2", hblur_avx2, vblur_threshold_avx2, hmin5_avx2, hmax5_avx2, vmin5_avx2, vmax5_avx2
+};
+#endif
+
+static const mask_kernels* select_kernels() {
+#ifdef MASK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+#endif
+    // elsewhere (jetson, pi) the scalar loops are left to the auto-vectoriser
+    return &scalar_kernels;
+}
+
+static const mask_kernels* active_kernels = select_kernels();
+
+const char* mask_kernel_isa() {
+    return active_kernels->isa;
+}
+
+bool force_mask_kernel_isa(const std::string& isa) {
+    if (isa == "scalar") {
+        active_kernels = &scalar_kernels;
+        return true;
+    }
+#ifdef MASK_X86
+    if (isa == "sse2" && __builtin_cpu_supports("sse2")) {
+        active_kernels = &sse2_kernels;
+        return true;
+    }
+    if (isa == "avx2" && __builtin_cpu_supports("avx2")) {
+        active_kernels = &avx2_kernels;
+        return true;
+    }
+#endif
+    return false;
+}
+
+mask_builder::mask_builder()
+    : width(0)
+    , height(0)
+{
+    std::copy(gaussian_9, gaussian_9 + 9, coeffs);
+    // open = erode then dilate, close = dilate then erode
+    stages[0].erode = true;
+    stages[1].erode = false;
+    stages[2].erode = false;
+    stages[3].erode = true;
+}
+
+void mask_builder::resize(int w, int h) {
+    height = h;
+    if (w == width) {
+        return;
+    }
+    width = w;
+    padded.assign(w + 8, 0);
+    hblur.assign(16 * (size_t)w, 0);
+    binary.assign(w, 0);
+    border_hi.assign(w + 4, 255);
+    border_lo.assign(w + 4, 0);
+    for (auto& stage : stages) {
+        stage.raw.assign(8 * (size_t)(w + 4), stage.erode ? 255 : 0);
+        stage.hop.assign(8 * (size_t)w, 0);
+        stage.out.assign(w, 0);
+    }
+}
+
+const uint8_t* mask_builder::morph_row(int stage, int row, bool hop) const {
+    const morph_stage& s = stages[stage];
+    if (row < 0 || row >= height) {
+        // outside the image erode sees 255 and dilate sees 0, as in opencv
+        return (s.erode ? border_hi.data() : border_lo.data()) + 2;
+    }
+    if (hop) {
+        return s.hop.data() + (size_t)(row & 7) * width;
+    }
+    return s.raw.data() + (size_t)(row & 7) * (width + 4) + 2;
+}
+
+void mask_builder::emit_morph(int stage, int row, uint8_t* dst, size_t dst_step) {
+    morph_stage& s = stages[stage];
+
+    // 5x5 ellipse: the middle three rows span all five columns, the outer two
+    // only the centre column
+    const uint8_t* rows[5] = {
+        morph_row(stage, row - 1, true),
+        morph_row(stage, row, true),
+        morph_row(stage, row + 1, true),
+        morph_row(stage, row - 2, false),
+        morph_row(stage, row + 2, false),
+    };
+    uint8_t* out = stage == 3 ? dst + row * dst_step : s.out.data();
+    if (s.erode) {
+        active_kernels->vmin5(rows, out, width);
+    } else {
+        active_kernels->vmax5(rows, out, width);
+    }
+
+    if (stage < 3) {
+        push_morph(stage + 1, row, out, dst, dst_step);
+    }
+}
+
+void mask_builder::push_morph(int stage, int row, const uint8_t* data, uint8_t* dst, size_t dst_step) {
+    morph_stage& s = stages[stage];
+    uint8_t* raw = s.raw.data() + (size_t)(row & 7) * (width + 4);
+    memcpy(raw + 2, data, width);
+    // the padding keeps the border value it was filled with in resize()
+
+    uint8_t* hop = s.hop.data() + (size_t)(row & 7) * width;
+    if (s.erode) {
+        active_kernels->hmin5(raw, hop, width);
+    } else {
+        active_kernels->hmax5(raw, hop, width);
+    }
+
+    if (row >= 2) {
+        emit_morph(stage, row - 2, dst, dst_step);
+    }
+    if (row == height - 1) {
+        emit_morph(stage, row - 1, dst, dst_step);
+        emit_morph(stage, row, dst, dst_step);
+    }
+}
+
+void mask_builder::build(const uint8_t* src, size_t src_step, int w, int h, int threshold,
+                         uint8_t* dst, size_t dst_step, uint8_t* thresh_dst, size_t thresh_step) {
+    resize(w, h);
+
+    // blur > threshold with round-half-up of the 16.16 result, as an integer compare
+    threshold = std::max(-1, std::min(255, threshold));
+    int32_t limit = (threshold + 1) * 65536 - 32768;
+
+    for (int y = 0; y < h + 4; y++) {
+        if (y < h) {
+            // reflect101 columns into the padded row then blur it horizontally
+            const uint8_t* row = src + y * src_step;
+            memcpy(padded.data() + 4, row, w);
+            for (int j = 1; j <= 4; j++) {
+                padded[4 - j] = row[j];
+                padded[4 + w - 1 + j] = row[w - 1 - j];
+            }
+            active_kernels->hblur(padded.data(), hblur.data() + (size_t)(y & 15) * w, w, coeffs);
+        }
+
+        int out = y - 4;
+        if (out < 0) {
+            continue;
+        }
+        const uint16_t* rows[9];
+        for (int k = 0; k < 9; k++) {
+            int r = out + k - 4;
+            r = r < 0 ? -r : (r >= h ? 2 * h - 2 - r : r);
+            rows[k] = hblur.data() + (size_t)(r & 15) * w;
+        }
+        active_kernels->vblur_threshold(rows, binary.data(), w, coeffs, limit);
+        if (thresh_dst) {
+            memcpy(thresh_dst + out * thresh_step, binary.data(), w);
+        }
+        push_morph(0, out, binary.data(), dst, dst_step);
+    }
+}
+
+void mask_builder::build(const cv::Mat& gray, int threshold, cv::Mat& mask, cv::Mat* thresholded) {
+    CV_Assert(gray.type() == CV_8UC1);
+
+    mask.create(gray.size(), CV_8UC1);
+    if (thresholded) {
+        thresholded->create(gray.size(), CV_8UC1);
+    }
+
+    // the row caches need a full kernel's worth of image to stream through
+    if (gray.cols < 9 || gray.rows < 9) {
+        cv::Mat blurred;
+        cv::GaussianBlur(gray, blurred, cv::Size(9, 9), 2);
+        cv::threshold(blurred, mask, threshold, 255, cv::THRESH_BINARY);
+        if (thresholded) {
+            mask.copyTo(*thresholded);
+        }
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
+        cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel);
+        cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
+        return;
+    }
+
+    build(gray.data, gray.step, gray.cols, gray.rows, threshold, mask.data, mask.step,
+          thresholded ? thresholded->data : nullptr, thresholded ? thresholded->step : 0);
+}
@@ -0,0 +1,179 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+const uint64_t latency_histogram::bounds_ns[latency_histogram::bucket_count - 1] = {
+    1000, 2000, 5000,
+    10000, 20000, 50000,
+    100000, 200000, 500000,
+    1000000, 2000000, 5000000,
+    10000000, 20000000, 50000000,
+    100000000, 200000000, 500000000,
+    1000000000,
+};
+
+latency_histogram::latency_histogram()
+    : samples(0)
+    , total_ns(0)
+    , longest_ns(0)
+{
+    for (auto& b : buckets) {
+        b.store(0, std::memory_order_relaxed);
+    }
+}
+
+void latency_histogram::record(std::chrono::nanoseconds elapsed) {
+    uint64_t ns = elapsed.count() > 0 ? (uint64_t)elapsed.count() : 0;
+    int bucket = 0;
+    while (bucket < bucket_count - 1 && ns > bounds_ns[bucket]) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    samples.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t longest = longest_ns.load(std::memory_order_relaxed);
+    while (ns > longest && !longest_ns.compare_exchange_weak(longest, ns, std::memory_order_relaxed)) {
+    }
+}
+
+// the q quantile, linear within the bucket it falls in; the open top bucket
+// reports the longest sample
+static double quantile_us(const std::vector<uint64_t>& buckets, uint64_t count, double max_us, double q) {
+    if (count == 0) {
+        return 0;
+    }
+    double target = q * count;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        if (buckets[i] == 0 || seen + buckets[i] < target) {
+            seen += buckets[i];
+            continue;
+        }
+        if (i == buckets.size() - 1) {
+            return max_us;
+        }
+        double low = i == 0 ? 0 : latency_histogram::bounds_ns[i - 1] / 1000.0;
+        double high = latency_histogram::bounds_ns[i] / 1000.0;
+        double within = (target - seen) / buckets[i];
+        return std::min(max_us, low + (high - low) * within);
+    }
+    return max_us;
+}
+
+histogram_snapshot latency_histogram::snapshot() const {
+    histogram_snapshot s;
+    s.buckets.resize(bucket_count);
+    uint64_t total = 0;
+    for (int i = 0; i < bucket_count; i++) {
+        s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        total += s.buckets[i];
+    }
+    // count from the buckets so the quantiles add up even mid-update
+    s.count = total;
+    s.max_us = longest_ns.load(std::memory_order_relaxed) / 1000.0;
+    uint64_t n = samples.load(std::memory_order_relaxed);
+    s.mean_us = n ? total_ns.load(std::memory_order_relaxed) / 1000.0 / n : 0;
+    s.p50_us = quantile_us(s.buckets, total, s.max_us, 0.50);
+    s.p90_us = quantile_us(s.buckets, total, s.max_us, 0.90);
+    s.p99_us = quantile_us(s.buckets, total, s.max_us, 0.99);
+    return s;
+}
+
+void latency_histogram::reset() {
+    for (auto& b : buckets) {
+        b.store(0, std::memory_order_relaxed);
+    }
+    samples.store(0, std::memory_order_relaxed);
+    total_ns.store(0, std::memory_order_relaxed);
+    longest_ns.store(0, std::memory_order_relaxed);
+}
+
+latency_histogram& metrics_registry::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<latency_histogram>& h = histograms[name];
+    if (!h) {
+        h.reset(new latency_histogram());
+    }
+    return *h;
+}
+
+metric_counter& metrics_registry::counter(const std::string& name) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<metric_counter>& c = counters[name];
+    if (!c) {
+        c.reset(new metric_counter());
+    }
+    return *c;
+}
+
+metrics_snapshot metrics_registry::snapshot() const {
+    std::lock_guard<std::mutex> guard(lock);
+    metrics_snapshot s;
+    for (const auto& h : histograms) {
+        s.histograms.push_back(h.second->snapshot());
+        s.histograms.back().name = h.first;
+    }
+    for (const auto& c : counters) {
+        s.counters.push_back(std::make_pair(c.first, c.second->get()));
+    }
+    return s;
+}
+
+void metrics_registry::reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto& h : histograms) {
+        h.second->reset();
+    }
+    for (auto& c : counters) {
+        c.second->reset();
+    }
+}
+
+bool metrics_registry::dump(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "failed to write metrics to " << path << std::endl;
+        return false;
+    }
+    metrics_snapshot s = snapshot();
+    std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    file << "# launch monitor metrics, " << stamp << "\n";
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-28s %10s %10s %10s %10s %10s %10s\n",
+                  "histogram (us)", "count", "mean", "p50", "p90", "p99", "max");
+    file << line;
+    for (const auto& h : s.histograms) {
+        std::snprintf(line, sizeof(line), "%-28s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                      h.name.c_str(), (unsigned long long)h.count, h.mean_us, h.p50_us, h.p90_us, h.p99_us, h.max_us);
+        file << line;
+    }
+
+    file << "\n";
+    for (const auto& c : s.counters) {
+        std::snprintf(line, sizeof(line), "%-28s %10llu\n", c.first.c_str(), (unsigned long long)c.second);
+        file << line;
+    }
+
+    // raw buckets, so two dumps can be diffed or plotted
+    file << "\nbuckets (upper bound us):";
+    for (int i = 0; i < latency_histogram::bucket_count - 1; i++) {
+        file << " " << latency_histogram::bounds_ns[i] / 1000;
+    }
+    file << " inf\n";
+    for (const auto& h : s.histograms) {
+        file << h.name;
+        for (uint64_t b : h.buckets) {
+            file << " " << b;
+        }
+        file << "\n";
+    }
+    std::cout << "metrics written to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,118 @@
+#include "pipeline.h"
+#include <algorithm>
+
+pipeline_stage::pipeline_stage(const std::string& name, std::function<bool()> step, int parallelism,
+                               std::function<queue_stats()> input_stats)
+    : name(name)
+    , parallelism(step ? std::max(parallelism, 1) : 0)
+    , step(step)
+    , input_stats(input_stats)
+    , running(false)
+    , processed(0)
+    , service_ns(0)
+    , max_service_ns(0)
+{
+}
+
+pipeline_stage::~pipeline_stage() {
+    stop();
+}
+
+void pipeline_stage::start() {
+    if (!step || !workers.empty()) {
+        return;
+    }
+    running = true;
+    workers.reserve(parallelism);
+    for (int i = 0; i < parallelism; i++) {
+        workers.emplace_back(&pipeline_stage::run, this);
+    }
+}
+
+void pipeline_stage::stop() {
+    running = false;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void pipeline_stage::run() {
+    while (running.load()) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if (step()) {
+            record(std::chrono::steady_clock::now() - begin);
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+}
+
+void pipeline_stage::record(std::chrono::steady_clock::duration service) {
+    uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(service).count();
+    processed.fetch_add(1, std::memory_order_relaxed);
+    service_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t seen = max_service_ns.load(std::memory_order_relaxed);
+    while (ns > seen && !max_service_ns.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+stage_stats pipeline_stage::stats() const {
+    stage_stats s;
+    s.name = name;
+    s.parallelism = parallelism;
+    s.processed = processed.load(std::memory_order_relaxed);
+    s.average_service_us = s.processed ? service_ns.load(std::memory_order_relaxed) / 1000.0 / s.processed : 0;
+    s.max_service_us = max_service_ns.load(std::memory_order_relaxed) / 1000.0;
+    if (input_stats) {
+        s.has_input = true;
+        s.input = input_stats();
+    }
+    return s;
+}
+
+pipeline::pipeline()
+    : started(false)
+{
+}
+
+pipeline::~pipeline() {
+    stop();
+}
+
+pipeline_stage& pipeline::add_source(const std::string& name, std::function<bool()> step) {
+    stages.push_back(std::unique_ptr<pipeline_stage>(new pipeline_stage(name, step, 1)));
+    return *stages.back();
+}
+
+void pipeline::start() {
+    if (started) {
+        return;
+    }
+    started = true;
+    for (auto& stage : stages) {
+        stage->start();
+    }
+}
+
+void pipeline::stop() {
+    if (!started) {
+        return;
+    }
+    started = false;
+    for (auto& close : closers) {
+        close();
+    }
+    for (auto& stage : stages) {
+        stage->stop();
+    }
+}
+
+std::vector<stage_stats> pipeline::stats() const {
+    std::vector<stage_stats> all;
+    all.reserve(stages.size());
+    for (const auto& stage : stages) {
+        all.push_back(stage->stats());
+    }
+    return all;
+}
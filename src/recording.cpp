@@ -0,0 +1,342 @@
+#include "recording.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t plane_align = 64;
+
+static uint64_t align_up(uint64_t n) {
+    return (n + plane_align - 1) & ~(uint64_t)(plane_align - 1);
+}
+
+static recording_detector pack_detector(const ball_detector& d) {
+    recording_detector r;
+    r.threshold = d.get_threshold();
+    r.circularity = d.get_circularity();
+    r.min_area = d.get_min_area();
+    r.max_area = d.get_max_area();
+    r.use_roi = d.is_using_roi() ? 1 : 0;
+    cv::Rect roi = d.get_roi();
+    r.roi[0] = roi.x;
+    r.roi[1] = roi.y;
+    r.roi[2] = roi.width;
+    r.roi[3] = roi.height;
+    return r;
+}
+
+static recording_detection pack_detection(const ball_detection& d) {
+    recording_detection r;
+    r.x = d.position.x;
+    r.y = d.position.y;
+    r.radius = d.radius;
+    r.circularity = d.circularity;
+    r.found = d.found ? 1 : 0;
+    return r;
+}
+
+static bool write_plane(FILE* file, const cv::Mat& image, cv::Rect crop, uint64_t padded) {
+    cv::Mat plane = image(crop);
+    for (int y = 0; y < plane.rows; y++) {
+        if (fwrite(plane.ptr(y), 1, plane.cols, file) != (size_t)plane.cols) {
+            return false;
+        }
+    }
+    static const uint8_t zeros[plane_align] = { 0 };
+    size_t pad = (size_t)(padded - (uint64_t)plane.total());
+    return pad == 0 || fwrite(zeros, 1, pad, file) == pad;
+}
+
+bool write_recording(const std::string& path, const shot_record& record) {
+    const burst_capture& burst = *record.burst;
+    if (burst.frames.empty()) {
+        return false;
+    }
+
+    const burst_frame& first = burst.frames.front();
+    const ball_detector* detectors[2] = { &burst.detector_top, &burst.detector_bottom };
+    cv::Size sizes[2] = { first.top.image.size(), first.bottom.image.size() };
+    for (const auto& f : burst.frames) {
+        if (f.top.image.size() != sizes[0] || f.bottom.image.size() != sizes[1] ||
+            f.top.image.type() != CV_8UC1 || f.bottom.image.type() != CV_8UC1) {
+            std::cerr << "recording: burst frames must be gray and all one size" << std::endl;
+            return false;
+        }
+    }
+
+    recording_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, recording_magic, sizeof(header.magic));
+    header.version = recording_version;
+    header.header_size = sizeof(recording_header);
+    header.frame_count = (uint32_t)burst.frames.size();
+    header.pre_trigger_frames = (uint32_t)burst.pre_trigger_frames;
+    header.recorded_unix = (int64_t)std::time(nullptr);
+    header.distance_between_inches = record.calibration.distance_between_inches;
+    header.pixels_per_inch = record.calibration.pixels_per_inch;
+    header.frame_rate = record.calibration.frame_rate;
+    header.tee_column = record.calibration.tee_column;
+    header.speed_mph = record.shot.speed_mph;
+    header.launch_angle_deg = record.shot.launch_angle_deg;
+    header.carry_ft = record.shot.carry_ft;
+    header.distance_ft = record.shot.distance_ft;
+    header.valid = record.shot.valid ? 1 : 0;
+
+    cv::Rect crops[2];
+    uint64_t padded[2];
+    uint64_t pair_stride = 0;
+    for (int c = 0; c < 2; c++) {
+        cv::Rect full(0, 0, sizes[c].width, sizes[c].height);
+        crops[c] = full;
+        if (record.crop_to_roi && detectors[c]->is_using_roi()) {
+            crops[c] = detectors[c]->get_roi() & full;
+            if (crops[c].area() == 0) {
+                crops[c] = full;
+            }
+        }
+        padded[c] = align_up((uint64_t)crops[c].area());
+
+        recording_camera& cam = header.cameras[c];
+        cam.width = sizes[c].width;
+        cam.height = sizes[c].height;
+        cam.crop[0] = crops[c].x;
+        cam.crop[1] = crops[c].y;
+        cam.crop[2] = crops[c].width;
+        cam.crop[3] = crops[c].height;
+        cam.plane_offset = pair_stride;
+        cam.detector = pack_detector(*detectors[c]);
+        pair_stride += padded[c];
+    }
+    header.pair_stride = pair_stride;
+    header.frames_offset = align_up(sizeof(recording_header));
+    header.planes_offset = align_up(header.frames_offset + header.frame_count * sizeof(recording_frame));
+
+    std::vector<recording_frame> table(burst.frames.size());
+    for (size_t i = 0; i < burst.frames.size(); i++) {
+        const burst_frame& f = burst.frames[i];
+        recording_frame& r = table[i];
+        std::memset(&r, 0, sizeof(r));
+        r.timestamp_ns[0] = std::chrono::duration_cast<std::chrono::nanoseconds>(f.top.timestamp.time_since_epoch()).count();
+        r.timestamp_ns[1] = std::chrono::duration_cast<std::chrono::nanoseconds>(f.bottom.timestamp.time_since_epoch()).count();
+        r.sequence[0] = f.top.sequence;
+        r.sequence[1] = f.bottom.sequence;
+        r.detection[0] = pack_detection(f.det_top);
+        r.detection[1] = pack_detection(f.det_bottom);
+    }
+
+    std::string part = path + ".part";
+    FILE* file = fopen(part.c_str(), "wb");
+    if (!file) {
+        std::cerr << "recording: cannot write " << part << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> gap(plane_align, 0);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(gap.data(), 1, header.frames_offset - sizeof(header), file) == header.frames_offset - sizeof(header);
+    ok = ok && fwrite(table.data(), sizeof(recording_frame), table.size(), file) == table.size();
+    uint64_t table_end = header.frames_offset + table.size() * sizeof(recording_frame);
+    ok = ok && fwrite(gap.data(), 1, header.planes_offset - table_end, file) == header.planes_offset - table_end;
+    for (size_t i = 0; ok && i < burst.frames.size(); i++) {
+        ok = write_plane(file, burst.frames[i].top.image, crops[0], padded[0]) &&
+             write_plane(file, burst.frames[i].bottom.image, crops[1], padded[1]);
+    }
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(part.c_str(), path.c_str()) != 0) {
+        std::cerr << "recording: failed writing " << path << std::endl;
+        unlink(part.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string next_recording_path(const std::string& dir) {
+    mkdir(dir.c_str(), 0755);
+
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_r(&now, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+    std::string base = dir + "/shot_" + stamp;
+    std::string path = base + ".lmshot";
+    struct stat st;
+    for (int n = 1; stat(path.c_str(), &st) == 0; n++) {
+        path = base + "_" + std::to_string(n) + ".lmshot";
+    }
+    return path;
+}
+
+std::string latest_recording(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return "";
+    }
+    std::string latest;
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > 7 && name.compare(name.size() - 7, 7, ".lmshot") == 0 && name > latest) {
+            latest = name;
+        }
+    }
+    closedir(d);
+    return latest.empty() ? "" : dir + "/" + latest;
+}
+
+recording_reader::recording_reader()
+    : base(nullptr)
+    , length(0)
+    , header(nullptr)
+    , frames(nullptr)
+{
+}
+
+void recording_reader::close() {
+    mapping.reset();
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+    frames = nullptr;
+}
+
+bool recording_reader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "recording: cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(recording_header)) {
+        ::close(fd);
+        std::cerr << "recording: " << path << " is too short" << std::endl;
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "recording: mmap failed for " << path << std::endl;
+        return false;
+    }
+
+    const recording_header* h = (const recording_header*)data;
+    if (std::memcmp(h->magic, recording_magic, sizeof(h->magic)) == 0 && h->version != recording_version) {
+        munmap(data, size);
+        std::cerr << "recording: " << path << " is version " << h->version << ", this build reads version "
+                  << recording_version << " only" << std::endl;
+        return false;
+    }
+    bool valid = std::memcmp(h->magic, recording_magic, sizeof(h->magic)) == 0 &&
+                 h->version == recording_version &&
+                 h->header_size == sizeof(recording_header) &&
+                 h->frames_offset + (uint64_t)h->frame_count * sizeof(recording_frame) <= size &&
+                 h->planes_offset + (uint64_t)h->frame_count * h->pair_stride <= size;
+    for (int c = 0; valid && c < 2; c++) {
+        const recording_camera& cam = h->cameras[c];
+        valid = cam.crop[2] > 0 && cam.crop[3] > 0 &&
+                cam.plane_offset + (uint64_t)cam.crop[2] * cam.crop[3] <= h->pair_stride;
+    }
+    if (!valid) {
+        munmap(data, size);
+        std::cerr << "recording: " << path << " is not a shot recording" << std::endl;
+        return false;
+    }
+
+    mapping = std::shared_ptr<void>(data, [size](void* p) { munmap(p, size); });
+    base = (const uint8_t*)data;
+    length = size;
+    header = h;
+    frames = (const recording_frame*)(base + h->frames_offset);
+    return true;
+}
+
+frame_envelope recording_reader::frame(int camera, size_t index) const {
+    frame_envelope envelope;
+    if (!header || index >= header->frame_count || camera < 0 || camera > 1) {
+        return envelope;
+    }
+    const recording_camera& cam = header->cameras[camera];
+    const uint8_t* plane = base + header->planes_offset + index * header->pair_stride + cam.plane_offset;
+    // read-only mapping; nothing downstream writes through a recorded frame
+    envelope.image = cv::Mat(cam.crop[3], cam.crop[2], CV_8UC1, const_cast<uint8_t*>(plane));
+    envelope.timestamp = capture_clock::time_point(std::chrono::duration_cast<capture_clock::duration>(
+        std::chrono::nanoseconds(frames[index].timestamp_ns[camera])));
+    envelope.sequence = frames[index].sequence[camera];
+    envelope.format = frame_format::gray;
+    envelope.lease = mapping;
+    return envelope;
+}
+
+ball_detection recording_reader::detection(int camera, size_t index) const {
+    ball_detection d;
+    if (!header || index >= header->frame_count || camera < 0 || camera > 1) {
+        return d;
+    }
+    const recording_detection& r = frames[index].detection[camera];
+    d.position = cv::Point2f(r.x, r.y);
+    d.radius = r.radius;
+    d.circularity = r.circularity;
+    d.found = r.found != 0;
+    d.sequence = frames[index].sequence[camera];
+    d.timestamp = capture_clock::time_point(std::chrono::duration_cast<capture_clock::duration>(
+        std::chrono::nanoseconds(frames[index].timestamp_ns[camera])));
+    return d;
+}
+
+cv::Rect recording_reader::crop(int camera) const {
+    if (!header || camera < 0 || camera > 1) {
+        return cv::Rect();
+    }
+    const int32_t* c = header->cameras[camera].crop;
+    return cv::Rect(c[0], c[1], c[2], c[3]);
+}
+
+ball_detector recording_reader::detector(int camera) const {
+    ball_detector d;
+    if (!header || camera < 0 || camera > 1) {
+        return d;
+    }
+    const recording_detector& r = header->cameras[camera].detector;
+    d.set_threshold(r.threshold);
+    d.set_circularity(r.circularity);
+    d.set_min_area(r.min_area);
+    d.set_max_area(r.max_area);
+    if (r.use_roi) {
+        d.set_roi(cv::Rect(r.roi[0], r.roi[1], r.roi[2], r.roi[3]));
+    }
+    return d;
+}
+
+camera_calibration recording_reader::calibration() const {
+    camera_calibration cal;
+    if (header) {
+        cal.distance_between_inches = header->distance_between_inches;
+        cal.pixels_per_inch = header->pixels_per_inch;
+        cal.frame_rate = header->frame_rate;
+        cal.tee_column = header->tee_column;
+    }
+    return cal;
+}
+
+shot_data recording_reader::shot() const {
+    shot_data s;
+    if (header) {
+        s.speed_mph = header->speed_mph;
+        s.launch_angle_deg = header->launch_angle_deg;
+        s.carry_ft = header->carry_ft;
+        s.distance_ft = header->distance_ft;
+        s.valid = header->valid != 0;
+    }
+    return s;
+}
@@ -0,0 +1,517 @@
+#include "shot_monitor.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// runs one detection and files its time under `time`, if there is one
+template <typename detect_fn>
+static ball_detection timed(latency_histogram* time, detect_fn detect) {
+    capture_clock::time_point begin = capture_clock::now();
+    ball_detection d = detect();
+    if (time) {
+        time->record(capture_clock::now() - begin);
+    }
+    return d;
+}
+
+// both cameras' trackers at once, the bottom one on the calling thread
+static void track_pair(worker_pool& pool, ball_tracker& tracker_top, ball_tracker& tracker_bottom,
+                       const frame_envelope& top, const frame_envelope& bottom,
+                       ball_detection& det_top, ball_detection& det_bottom,
+                       latency_histogram* time_top, latency_histogram* time_bottom) {
+    std::future<ball_detection> top_result = pool.submit([&]() {
+        return timed(time_top, [&]() { return tracker_top.track(top); });
+    });
+    det_bottom = timed(time_bottom, [&]() { return tracker_bottom.track(bottom); });
+    det_top = top_result.get();
+}
+
+// every candidate in both cameras' whole frames at once, the bottom one on
+// the calling thread
+static void candidates_pair(worker_pool& pool, ball_detector& detector_top, ball_detector& detector_bottom,
+                            const frame_envelope& top, const frame_envelope& bottom,
+                            candidate_list& candidates_top, candidate_list& candidates_bottom,
+                            ball_detection& det_top, ball_detection& det_bottom,
+                            latency_histogram* time_top, latency_histogram* time_bottom) {
+    std::future<ball_detection> top_result = pool.submit([&]() {
+        return timed(time_top, [&]() { return detector_top.find_candidates(top, candidates_top); });
+    });
+    det_bottom = timed(time_bottom, [&]() { return detector_bottom.find_candidates(bottom, candidates_bottom); });
+    det_top = top_result.get();
+}
+
+// the patch of frame the trigger watches around a ball at rest
+static cv::Rect tee_region(const ball_detection& ball) {
+    float half = std::max(64.0f, ball.radius * 6.0f);
+    return cv::Rect((int)(ball.position.x - half), (int)(ball.position.y - half), (int)(2 * half), (int)(2 * half));
+}
+
+static float movement(const ball_detection& from, const ball_detection& to) {
+    if (!from.found || !to.found) {
+        return 0;
+    }
+    float dx = to.position.x - from.position.x;
+    float dy = to.position.y - from.position.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// a candidate the same size as the ball, within half its radius of it
+static bool still_there(const ball_detection& ball, const candidate_list& candidates) {
+    for (int i = 0; i < candidates.count; i++) {
+        const ball_candidate& c = candidates.items[i];
+        float ratio = c.radius / std::max(1.0f, ball.radius);
+        if (cv::norm(c.position - ball.position) < 0.5f * ball.radius && ratio > 0.7f && ratio < 1.4f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// one camera's detections replaced by what track_manager::choose picked
+static void follow_track(const std::vector<ball_detection>& chosen, std::vector<burst_frame>& frames, bool top,
+                         std::vector<ball_detection>& dets) {
+    dets.clear();
+    for (size_t i = 0; i < frames.size(); i++) {
+        ball_detection& d = top ? frames[i].det_top : frames[i].det_bottom;
+        d = chosen[i];
+        if (d.found) {
+            dets.push_back(d);
+        }
+    }
+}
+
+// sized up front so the capture path never grows them
+static void reserve_burst(burst_capture& burst, int burst_frames, int pre_trigger) {
+    burst.frames.reserve(burst_frames + pre_trigger);
+    burst.dets_top.reserve(2 * burst_frames);
+    burst.dets_bottom.reserve(2 * burst_frames);
+}
+
+shot_monitor::shot_monitor(worker_pool& pool, std::function<void(burst_capture&&)> on_burst,
+                           int burst_frames, int cooldown_frames, float motion_threshold)
+    : pool(pool)
+    , on_burst(on_burst)
+    , burst_frames(burst_frames)
+    , cooldown_frames(cooldown_frames)
+    , motion_threshold(motion_threshold)
+    , detector_top(200, 0.7)
+    , detector_bottom(200, 0.7)
+    , tracker_top(detector_top)
+    , tracker_bottom(detector_bottom)
+    , tracks_top(burst_frames + pre_trigger_size)
+    , tracks_bottom(burst_frames + pre_trigger_size)
+    , frame_candidates_top(burst_frames + pre_trigger_size)
+    , frame_candidates_bottom(burst_frames + pre_trigger_size)
+    , burst_searched_top(0)
+    , burst_searched_bottom(0)
+    , burst_pixels_top(0)
+    , burst_pixels_bottom(0)
+    , dropped_bursts(0)
+    , use_background(true)
+    , background_interval(4)
+    , frames_since_background(0)
+    , background_time(nullptr)
+    , monitoring(false)
+    , testing(false)
+    , motion(false)
+    , cooldown(0)
+    , have_prev_ball(false)
+    , frames_since_prev(0)
+    , detect_time_top(nullptr)
+    , detect_time_bottom(nullptr)
+    , pending_top(200, 0.7)
+    , pending_bottom(200, 0.7)
+    , detectors_dirty(false)
+    , start_requested(false)
+    , stop_requested(false)
+    , test_requested(false)
+    , pending_background(true)
+{
+    reserve_burst(burst, burst_frames, pre_trigger_size);
+    chosen.reserve(burst_frames + pre_trigger_size);
+    status.burst_frames = burst_frames;
+}
+
+void shot_monitor::start() {
+    std::lock_guard<std::mutex> guard(control_lock);
+    start_requested = true;
+    stop_requested = false;
+}
+
+void shot_monitor::stop() {
+    std::lock_guard<std::mutex> guard(control_lock);
+    stop_requested = true;
+    start_requested = false;
+}
+
+void shot_monitor::test_capture() {
+    std::lock_guard<std::mutex> guard(control_lock);
+    test_requested = true;
+}
+
+void shot_monitor::set_detectors(const ball_detector& top, const ball_detector& bottom) {
+    std::lock_guard<std::mutex> guard(control_lock);
+    pending_top = top;
+    pending_bottom = bottom;
+    detectors_dirty = true;
+}
+
+void shot_monitor::set_background_model(bool enabled) {
+    std::lock_guard<std::mutex> guard(control_lock);
+    pending_background = enabled;
+}
+
+void shot_monitor::set_live_source(bool live) {
+    trigger_top.set_live(live);
+    trigger_bottom.set_live(live);
+}
+
+void shot_monitor::set_metrics(metrics_registry& registry) {
+    detect_time_top = &registry.histogram("top.detect");
+    detect_time_bottom = &registry.histogram("bottom.detect");
+    background_time = &registry.histogram("background.update");
+}
+
+monitor_status shot_monitor::get_status() const {
+    std::lock_guard<std::mutex> guard(control_lock);
+    return status;
+}
+
+void shot_monitor::apply_requests() {
+    std::lock_guard<std::mutex> guard(control_lock);
+    if (detectors_dirty) {
+        // assigned in place, the trackers hold references to these
+        detector_top = pending_top;
+        detector_bottom = pending_bottom;
+        detectors_dirty = false;
+        // the ui's copies don't know about the models
+        subtract_background(motion);
+    }
+    if (pending_background != use_background) {
+        use_background = pending_background;
+        subtract_background(motion);
+    }
+    if (start_requested) {
+        monitoring = true;
+        motion = false;
+        cooldown = 0;
+        testing = false;
+        have_prev_ball = false;
+        frames_since_prev = 0;
+        trigger_top.disarm();
+        trigger_bottom.disarm();
+        tracker_top.reset();
+        tracker_bottom.reset();
+        background_top.reset();
+        background_bottom.reset();
+        frames_since_background = 0;
+        subtract_background(false);
+        burst_frame stale;
+        while (frame_buffer.pop(stale)) {
+        }
+        start_requested = false;
+    }
+    if (stop_requested) {
+        monitoring = false;
+        motion = false;
+        subtract_background(false);
+        stop_requested = false;
+    }
+    if (test_requested) {
+        testing = true;
+        test_burst = burst_capture();
+        test_burst.test = true;
+        reserve_burst(test_burst, burst_frames, 0);
+        test_requested = false;
+        std::cout << "manual test capture triggered" << std::endl;
+    }
+}
+
+void shot_monitor::process(const frame_pair& pair) {
+    apply_requests();
+
+    if (testing) {
+        test_frame(pair);
+    }
+
+    if (monitoring) {
+        // frames are pool buffers, keeping them is just a reference
+        burst_frame buffered;
+        if (frame_buffer.size() >= pre_trigger_size) {
+            frame_buffer.pop(buffered);
+        }
+        buffered.top = pair.top;
+        buffered.bottom = pair.bottom;
+        buffered.det_top = ball_detection();
+        buffered.det_bottom = ball_detection();
+        frame_buffer.push(std::move(buffered));
+
+        // the pair that fires is already in the buffer, so capture starts on the next one
+        if (motion) {
+            capture(pair);
+        } else if (cooldown == 0) {
+            watch(pair);
+        }
+    }
+
+    if (cooldown > 0) cooldown--;
+
+    publish();
+}
+
+// while armed only the binned trigger runs; full detection is for finding the
+// ball on the tee and for checking a firing
+void shot_monitor::watch(const frame_pair& pair) {
+    bool fired = trigger_top.update(pair.top);
+    fired = trigger_bottom.update(pair.bottom) || fired;
+
+    // only quiet frames, so a waggle or a ball being teed up doesn't go in
+    if (!fired && use_background && ++frames_since_background >= background_interval) {
+        frames_since_background = 0;
+        learn_background(pair);
+    }
+
+    frames_since_prev++;
+    if (!fired && (have_prev_ball || frames_since_prev < 3)) {
+        return;
+    }
+
+    ball_detection curr_ball_top, curr_ball_bottom;
+    track_pair(pool, tracker_top, tracker_bottom, pair.top, pair.bottom, curr_ball_top, curr_ball_bottom,
+               detect_time_top, detect_time_bottom);
+
+    if (have_prev_ball && (curr_ball_top.found || curr_ball_bottom.found)) {
+        float ball_movement = std::max(movement(prev_ball_top, curr_ball_top),
+                                       movement(prev_ball_bottom, curr_ball_bottom));
+
+        if (ball_movement > motion_threshold && ball_at_rest(pair)) {
+            // the gate picked up the club or a reflection beside a ball that
+            // never left; stay on the ball and start the trigger afresh
+            std::cout << "false trigger: ball still at rest" << std::endl;
+            tracker_top.reset();
+            tracker_bottom.reset();
+            tracker_top.observe(prev_ball_top);
+            tracker_bottom.observe(prev_ball_bottom);
+            frames_since_prev = 0;
+            if (prev_ball_top.found) trigger_top.arm(tee_region(prev_ball_top));
+            if (prev_ball_bottom.found) trigger_bottom.arm(tee_region(prev_ball_bottom));
+            return;
+        }
+
+        if (ball_movement > motion_threshold) {
+            motion = true;
+            trigger_top.mark_triggered(pair.top);
+            trigger_bottom.mark_triggered(pair.bottom);
+            trigger_top.disarm();
+            trigger_bottom.disarm();
+
+            std::cout << "ball motion detected: " << ball_movement << " pixels";
+            if (trigger_top.is_live()) {
+                std::cout << ", " << trigger_top.latency_ms() << " ms after capture";
+            }
+            std::cout << std::endl;
+            std::cout << "adding " << frame_buffer.size() << " pre-trigger frames" << std::endl;
+
+            burst.frames.clear();
+            burst.dets_top.clear();
+            burst.dets_bottom.clear();
+            burst_frame buffered;
+            while (frame_buffer.pop(buffered)) {
+                burst.frames.push_back(std::move(buffered));
+            }
+            burst.pre_trigger_frames = burst.frames.size();
+
+            subtract_background(true);
+
+            // catch up on the buffered frames in capture order: each frame's
+            // gates come from the tracks the frames before it built, which
+            // is what keeps most of them to a fraction of the frame
+            tracker_top.reset();
+            tracker_bottom.reset();
+            tracks_top.reset();
+            tracks_bottom.reset();
+            for (size_t i = 0; i < burst.frames.size(); i++) {
+                search_burst_frame(i);
+            }
+            return;
+        }
+    }
+
+    // a false alarm (club waggle, ball nudged) or a fresh ball: settle on
+    // where it is now and take a new trigger baseline
+    prev_ball_top = curr_ball_top;
+    prev_ball_bottom = curr_ball_bottom;
+    frames_since_prev = 0;
+    have_prev_ball = curr_ball_top.found || curr_ball_bottom.found;
+    if (curr_ball_top.found) trigger_top.arm(tee_region(curr_ball_top));
+    else trigger_top.disarm();
+    if (curr_ball_bottom.found) trigger_bottom.arm(tee_region(curr_ball_bottom));
+    else trigger_bottom.disarm();
+}
+
+void shot_monitor::capture(const frame_pair& pair) {
+    if ((int)burst.frames.size() >= burst_frames) {
+        return;
+    }
+
+    burst_frame captured;
+    captured.top = pair.top;
+    captured.bottom = pair.bottom;
+    burst.frames.push_back(std::move(captured));
+    search_burst_frame(burst.frames.size() - 1);
+
+    if ((int)burst.frames.size() >= burst_frames) {
+        motion = false;
+        cooldown = cooldown_frames;
+        have_prev_ball = false;
+        tracker_top.reset();
+        tracker_bottom.reset();
+        subtract_background(false);
+
+        if (!adopt_tracks()) {
+            // nothing flew: the trigger saw the club, a hand or a reflection.
+            // a cooldown would only miss the real shot that follows
+            dropped_bursts++;
+            std::cout << "no ball in flight in either camera, burst dropped" << std::endl;
+            cooldown = 0;
+            burst.frames.clear();
+            burst.dets_top.clear();
+            burst.dets_bottom.clear();
+            return;
+        }
+
+        burst.test = false;
+        burst.detector_top = detector_top;
+        burst.detector_bottom = detector_bottom;
+        on_burst(std::move(burst));
+        burst = burst_capture();
+        reserve_burst(burst, burst_frames, pre_trigger_size);
+    }
+}
+
+void shot_monitor::search_burst_frame(size_t index) {
+    // every live track's gate, not just the last winner's: the winner may be
+    // the club, and the ball has to stay in view of its own track
+    burst_frame& f = burst.frames[index];
+    burst_pixels_top += (uint64_t)f.top.image.total();
+    burst_pixels_bottom += (uint64_t)f.bottom.image.total();
+    std::future<ball_detection> top = pool.submit([&]() {
+        return timed(detect_time_top, [&]() {
+            return tracks_top.search(detector_top, f.top, index, frame_candidates_top[index], burst_searched_top);
+        });
+    });
+    f.det_bottom = timed(detect_time_bottom, [&]() {
+        return tracks_bottom.search(detector_bottom, f.bottom, index, frame_candidates_bottom[index], burst_searched_bottom);
+    });
+    f.det_top = top.get();
+    tracks_top.update(frame_candidates_top[index]);
+    tracks_bottom.update(frame_candidates_bottom[index]);
+
+    if (f.det_top.found) burst.dets_top.push_back(f.det_top);
+    if (f.det_bottom.found) burst.dets_bottom.push_back(f.det_bottom);
+}
+
+bool shot_monitor::ball_at_rest(const frame_pair& pair) {
+    ball_detection top, bottom;
+    candidates_pair(pool, detector_top, detector_bottom, pair.top, pair.bottom, candidates_top, candidates_bottom,
+                    top, bottom, detect_time_top, detect_time_bottom);
+    return (!prev_ball_top.found || still_there(prev_ball_top, candidates_top)) &&
+           (!prev_ball_bottom.found || still_there(prev_ball_bottom, candidates_bottom));
+}
+
+bool shot_monitor::adopt_tracks() {
+    // a camera with no plausible track keeps its per-frame winners, which is
+    // no worse than before there were tracks
+    size_t count = burst.frames.size();
+    bool top = tracks_top.choose(frame_candidates_top, count, chosen);
+    if (top) {
+        follow_track(chosen, burst.frames, true, burst.dets_top);
+    }
+    bool bottom = tracks_bottom.choose(frame_candidates_bottom, count, chosen);
+    if (bottom) {
+        follow_track(chosen, burst.frames, false, burst.dets_bottom);
+    }
+    return top || bottom;
+}
+
+void shot_monitor::learn_background(const frame_pair& pair) {
+    capture_clock::time_point begin = capture_clock::now();
+    std::future<void> top = pool.submit([&]() {
+        if (!pair.top.empty()) background_top.update(pair.top.image);
+    });
+    if (!pair.bottom.empty()) background_bottom.update(pair.bottom.image);
+    top.get();
+    if (background_time) {
+        background_time->record(capture_clock::now() - begin);
+    }
+}
+
+void shot_monitor::subtract_background(bool enabled) {
+    enabled = enabled && use_background;
+    detector_top.set_background(enabled ? &background_top : nullptr);
+    detector_bottom.set_background(enabled ? &background_bottom : nullptr);
+}
+
+void shot_monitor::test_frame(const frame_pair& pair) {
+    burst_frame f;
+    f.top = pair.top;
+    f.bottom = pair.bottom;
+    f.det_top = timed(detect_time_top, [&]() { return detector_top.find_ball(pair.top); });
+    f.det_bottom = timed(detect_time_bottom, [&]() { return detector_bottom.find_ball(pair.bottom); });
+
+    if (f.det_top.found) {
+        test_burst.dets_top.push_back(f.det_top);
+        std::cout << "top: ball at (" << f.det_top.position.x << ", " << f.det_top.position.y
+                  << ") r=" << f.det_top.radius << std::endl;
+    }
+    if (f.det_bottom.found) {
+        test_burst.dets_bottom.push_back(f.det_bottom);
+        std::cout << "bottom: ball at (" << f.det_bottom.position.x << ", " << f.det_bottom.position.y
+                  << ") r=" << f.det_bottom.radius << std::endl;
+    }
+    // only the first few frames are kept, as thumbnails
+    if (test_burst.frames.size() < 3) {
+        test_burst.frames.push_back(std::move(f));
+    }
+
+    if ((int)test_burst.dets_top.size() >= burst_frames || (int)test_burst.dets_bottom.size() >= burst_frames) {
+        testing = false;
+        std::cout << "test capture complete! top: " << test_burst.dets_top.size()
+                  << " bottom: " << test_burst.dets_bottom.size() << std::endl;
+        test_burst.detector_top = detector_top;
+        test_burst.detector_bottom = detector_bottom;
+        // the models keep learning after the burst is handed on
+        test_burst.detector_top.set_background(nullptr);
+        test_burst.detector_bottom.set_background(nullptr);
+        on_burst(std::move(test_burst));
+        test_burst = burst_capture();
+    }
+}
+
+void shot_monitor::publish() {
+    std::lock_guard<std::mutex> guard(control_lock);
+    if (!monitoring) status.state = monitor_state::idle;
+    else if (motion) status.state = monitor_state::capturing;
+    else if (cooldown > 0) status.state = monitor_state::cooldown;
+    else status.state = monitor_state::waiting;
+    status.testing = testing;
+    status.captured = motion ? (int)burst.frames.size() : 0;
+    status.cooldown = cooldown;
+    status.test_top = (int)test_burst.dets_top.size();
+    status.test_bottom = (int)test_burst.dets_bottom.size();
+    status.searched_top = tracker_top.searched_fraction();
+    status.searched_bottom = tracker_bottom.searched_fraction();
+    status.burst_searched_top = burst_pixels_top ? (double)burst_searched_top / burst_pixels_top : 1.0;
+    status.burst_searched_bottom = burst_pixels_bottom ? (double)burst_searched_bottom / burst_pixels_bottom : 1.0;
+    status.trigger_us_top = trigger_top.average_us();
+    status.trigger_us_bottom = trigger_bottom.average_us();
+    status.fired_top = trigger_top.fire_count();
+    status.fired_bottom = trigger_bottom.fire_count();
+    status.latency_top = trigger_top.latency_ms();
+    status.latency_bottom = trigger_bottom.latency_ms();
+    status.tracks_top = motion ? tracks_top.live_tracks() : 0;
+    status.tracks_bottom = motion ? tracks_bottom.live_tracks() : 0;
+    status.dropped_bursts = dropped_bursts;
+    status.background = use_background && background_top.ready() && background_bottom.ready();
+    status.background_frames = std::min(background_top.frames_learnt(), background_bottom.frames_learnt());
+}
@@ -0,0 +1,265 @@
+#include "spin.h"
+#include "shot_monitor.h"
+#include <algorithm>
+#include <cmath>
+
+// markings closer to the centre than this barely move, and the rim is
+// shaded and smeared by the edge of the blob
+static const float inner_radius = 0.3f;
+static const float outer_radius = 0.8f;
+
+struct angle_table {
+    float cosine[spin_estimator::angles];
+    float sine[spin_estimator::angles];
+
+    angle_table() {
+        for (int a = 0; a < spin_estimator::angles; a++) {
+            double theta = 2.0 * CV_PI * a / spin_estimator::angles;
+            cosine[a] = (float)std::cos(theta);
+            sine[a] = (float)std::sin(theta);
+        }
+    }
+};
+
+static const angle_table& unit_circle() {
+    static const angle_table table;
+    return table;
+}
+
+spin_estimator::spin_estimator()
+    : max_gap_s(0.03f)
+    , min_texture(2.0f)
+    , min_peak(0.3f)
+    , min_rpm(-4000.0f)
+    , max_rpm(12000.0f)
+{
+}
+
+bool spin_estimator::unwrap(const spin_view& view, std::vector<float>& polar) const {
+    const cv::Mat& image = view.image;
+    float inner = inner_radius * view.radius;
+    float outer = outer_radius * view.radius;
+    if (image.empty() || view.radius < 4 ||
+        view.center.x - outer < 1 || view.center.y - outer < 1 ||
+        view.center.x + outer > image.cols - 2 || view.center.y + outer > image.rows - 2) {
+        return false;
+    }
+
+    const angle_table& circle = unit_circle();
+    polar.resize(rings * angles);
+    double energy = 0;
+    for (int r = 0; r < rings; r++) {
+        float rho = inner * std::pow(outer / inner, (float)r / (rings - 1));
+        float* row = &polar[r * angles];
+        float mean = 0;
+        for (int a = 0; a < angles; a++) {
+            float x = view.center.x + rho * circle.cosine[a];
+            float y = view.center.y + rho * circle.sine[a];
+            int x0 = (int)x;
+            int y0 = (int)y;
+            float fx = x - x0;
+            float fy = y - y0;
+            const uchar* top = image.ptr<uchar>(y0) + x0;
+            const uchar* bottom = image.ptr<uchar>(y0 + 1) + x0;
+            row[a] = (top[0] * (1 - fx) + top[1] * fx) * (1 - fy) + (bottom[0] * (1 - fx) + bottom[1] * fx) * fy;
+            mean += row[a];
+        }
+        // a ring's mean is shading from the lights, not something that turns
+        mean /= angles;
+        for (int a = 0; a < angles; a++) {
+            row[a] -= mean;
+            energy += row[a] * row[a];
+        }
+    }
+    return std::sqrt(energy / (rings * angles)) >= min_texture;
+}
+
+float register_rotation(const std::vector<float>& a, const std::vector<float>& b, float& peak) {
+    const int n = spin_estimator::angles;
+    float correlation[n] = {};
+    float twice[2 * n];
+    double norm_a = 0, norm_b = 0;
+    for (int r = 0; r < spin_estimator::rings; r++) {
+        const float* ring_a = &a[r * n];
+        const float* ring_b = &b[r * n];
+        // b twice over, so every shift reads one contiguous run
+        std::copy(ring_b, ring_b + n, twice);
+        std::copy(ring_b, ring_b + n, twice + n);
+        // one scaled row added per sample rather than one dot product per
+        // shift, which keeps the inner loop free of reductions and lets it
+        // vectorise without relaxed float maths
+        for (int i = 0; i < n; i++) {
+            float weight = ring_a[i];
+            const float* shifted = twice + i;
+            for (int s = 0; s < n; s++) {
+                correlation[s] += weight * shifted[s];
+            }
+            norm_a += ring_a[i] * ring_a[i];
+            norm_b += ring_b[i] * ring_b[i];
+        }
+    }
+
+    int best = (int)(std::max_element(correlation, correlation + n) - correlation);
+    float left = correlation[(best + n - 1) % n];
+    float centre = correlation[best];
+    float right = correlation[(best + 1) % n];
+    float curvature = left - 2 * centre + right;
+    float offset = curvature < 0 ? 0.5f * (left - right) / curvature : 0.0f;
+
+    peak = norm_a > 0 && norm_b > 0 ? (float)(centre / std::sqrt(norm_a * norm_b)) : 0.0f;
+    float degrees = (best + offset) * 360.0f / n;
+    return degrees > 180.0f ? degrees - 360.0f : degrees;
+}
+
+struct sighting {
+    std::vector<float> polar;
+    double t;
+};
+
+struct registered_pair {
+    double dt;
+    double turn;                // radians, wrapped
+    double weight;
+};
+
+spin_estimate spin_estimator::estimate(const std::vector<spin_view>& top, const std::vector<spin_view>& bottom) const {
+    spin_estimate result;
+    const std::vector<spin_view>* cameras[2] = { &top, &bottom };
+
+    capture_clock::time_point origin = capture_clock::time_point::max();
+    float travel = 0;
+    for (const auto* views : cameras) {
+        for (const auto& v : *views) {
+            origin = std::min(origin, v.timestamp);
+        }
+        if (views->size() > 1) {
+            travel += views->back().center.x - views->front().center.x;
+        }
+    }
+    // backspin on a ball heading right turns its markings counter-clockwise,
+    // which is decreasing angle with y down
+    double direction = travel < 0 ? -1.0 : 1.0;
+
+    std::vector<sighting> sightings;
+    for (const auto* views : cameras) {
+        size_t first = sightings.size();
+        for (const auto& v : *views) {
+            sighting s;
+            if (!unwrap(v, s.polar)) {
+                continue;
+            }
+            s.t = std::chrono::duration<double>(v.timestamp - origin).count();
+            sightings.push_back(s);
+        }
+        // what every sighting of a camera has in common is glint and shading
+        // fixed to the camera; the markings turn and average away. a ball that
+        // hardly turns goes with them and reads as unmeasured
+        size_t count = sightings.size() - first;
+        if (count >= 3) {
+            std::vector<float> mean(rings * angles, 0.0f);
+            for (size_t i = first; i < sightings.size(); i++) {
+                for (size_t k = 0; k < mean.size(); k++) {
+                    mean[k] += sightings[i].polar[k] / count;
+                }
+            }
+            for (size_t i = first; i < sightings.size(); i++) {
+                for (size_t k = 0; k < mean.size(); k++) {
+                    sightings[i].polar[k] -= mean[k];
+                }
+            }
+        }
+    }
+    std::sort(sightings.begin(), sightings.end(), [](const sighting& a, const sighting& b) { return a.t < b.t; });
+
+    std::vector<registered_pair> pairs;
+    for (size_t i = 0; i < sightings.size(); i++) {
+        for (size_t j = i + 1; j < sightings.size(); j++) {
+            double dt = sightings[j].t - sightings[i].t;
+            if (dt > max_gap_s) {
+                break;
+            }
+            if (dt < 1e-5) {
+                continue;
+            }
+            float peak;
+            float degrees = register_rotation(sightings[i].polar, sightings[j].polar, peak);
+            if (peak < min_peak) {
+                continue;
+            }
+            registered_pair p;
+            p.dt = dt;
+            p.turn = degrees * CV_PI / 180.0;
+            p.weight = peak;
+            pairs.push_back(p);
+        }
+    }
+    result.pairs = (int)pairs.size();
+    if (pairs.size() < 2) {
+        return result;
+    }
+
+    double total_weight = 0;
+    for (const auto& p : pairs) {
+        total_weight += p.weight;
+    }
+    auto cost = [&](double rpm) {
+        double rate = -direction * rpm * 2.0 * CV_PI / 60.0;
+        double sum = 0;
+        for (const auto& p : pairs) {
+            sum += p.weight * (1.0 - std::cos(rate * p.dt - p.turn));
+        }
+        return sum;
+    };
+
+    // every rate on a coarse grid, since the aliases are all local minima
+    const double step = 10.0;
+    int steps = (int)((max_rpm - min_rpm) / step) + 1;
+    std::vector<double> costs(steps);
+    int best = 0;
+    for (int i = 0; i < steps; i++) {
+        costs[i] = cost(min_rpm + i * step);
+        if (costs[i] < costs[best]) {
+            best = i;
+        }
+    }
+    double best_rpm = min_rpm + best * step;
+    double best_cost = costs[best];
+    for (double rpm = best_rpm - step; rpm <= best_rpm + step; rpm += 0.5) {
+        double c = cost(rpm);
+        if (c < best_cost) {
+            best_cost = c;
+            best_rpm = rpm;
+        }
+    }
+
+    // the best rate well away from this one; close to as good means the
+    // pairs can't tell the aliases apart
+    double runner_up = 2.0 * total_weight;
+    for (int i = 0; i < steps; i++) {
+        if (std::fabs(min_rpm + i * step - best_rpm) > 400.0) {
+            runner_up = std::min(runner_up, costs[i]);
+        }
+    }
+    double fit = 1.0 - best_cost / total_weight;
+    double separation = (runner_up - best_cost) / total_weight;
+
+    result.rpm = (float)best_rpm;
+    result.confidence = (float)(std::max(0.0, fit) * std::min(1.0, separation / 0.2));
+    result.ok = fit > 0.8 && separation > 0.05;
+    return result;
+}
+
+spin_estimate spin_estimator::estimate(const burst_capture& burst) const {
+    std::vector<spin_view> top, bottom;
+    for (const auto& f : burst.frames) {
+        if (f.det_top.found) {
+            spin_view v = { f.top.image, f.det_top.position, f.det_top.radius, f.top.timestamp };
+            top.push_back(v);
+        }
+        if (f.det_bottom.found) {
+            spin_view v = { f.bottom.image, f.det_bottom.position, f.det_bottom.radius, f.bottom.timestamp };
+            bottom.push_back(v);
+        }
+    }
+    return estimate(top, bottom);
+}
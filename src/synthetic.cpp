@@ -0,0 +1,290 @@
+#include "synthetic.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+static const double inches_per_second_per_mph = 17.6;
+static const double gravity_ips2 = 386.09;
+
+// a fixed pseudo-random value per (seed, camera, frame), so noise and drops
+// don't depend on which thread renders what or in which order
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t frame_hash(uint64_t seed, int camera, uint64_t frame_index) {
+    return mix(seed ^ mix(((uint64_t)camera << 56) ^ frame_index));
+}
+
+// how bright the ball's surface is at offset (dx, dy) from its centre, with
+// its markings turned by `turn`: two dark dots of different sizes, so no turn
+// looks like another
+static float surface(float dx, float dy, float radius, float turn, float level) {
+    float c = std::cos(turn);
+    float s = std::sin(turn);
+    float u = (dx * c + dy * s) / radius;
+    float v = (-dx * s + dy * c) / radius;
+    float shade = 1.0f;
+    float d1 = ((u - 0.55f) * (u - 0.55f) + v * v) / (0.22f * 0.22f);
+    float d2 = ((u + 0.2f) * (u + 0.2f) + (v - 0.45f) * (v - 0.45f)) / (0.14f * 0.14f);
+    shade -= 0.5f * std::max(0.0f, 1.0f - d1);
+    shade -= 0.4f * std::max(0.0f, 1.0f - d2);
+    return level * shade;
+}
+
+// a disc of radius moving from `from` to `to` while the shutter is open,
+// blended over what is already there. a pixel's coverage is the share of the
+// exposure the disc spent over it, so fast balls smear and dim like they do
+// on the sensor. the markings are drawn as they are mid-exposure.
+static void draw_ball(cv::Mat& image, cv::Point2f from, cv::Point2f to, float radius, float level, float turn) {
+    cv::Point2f middle = (from + to) * 0.5f;
+    cv::Point2f d = to - from;
+    float length = std::sqrt(d.x * d.x + d.y * d.y);
+    cv::Point2f u = length > 0 ? d * (1.0f / length) : cv::Point2f(1, 0);
+    float reach = radius + 1.0f;
+
+    int x0 = std::max(0, (int)std::floor(std::min(from.x, to.x) - reach));
+    int x1 = std::min(image.cols - 1, (int)std::ceil(std::max(from.x, to.x) + reach));
+    int y0 = std::max(0, (int)std::floor(std::min(from.y, to.y) - reach));
+    int y1 = std::min(image.rows - 1, (int)std::ceil(std::max(from.y, to.y) + reach));
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    float outer = radius + 0.5f;
+    for (int y = y0; y <= y1; y++) {
+        uchar* row = image.ptr<uchar>(y);
+        for (int x = x0; x <= x1; x++) {
+            float px = x - from.x;
+            float py = y - from.y;
+            float coverage;
+            if (length < 0.5f) {
+                // effectively frozen: a disc with a one pixel soft edge
+                coverage = std::min(1.0f, std::max(0.0f, outer - std::sqrt(px * px + py * py)));
+            } else {
+                float along = px * u.x + py * u.y;
+                float across = std::fabs(px * u.y - py * u.x);
+                if (across >= radius) {
+                    continue;
+                }
+                // the chord shrinks to nothing at the edge, which softens it
+                float half = std::sqrt(radius * radius - across * across);
+                float covered = std::min(length, along + half) - std::max(0.0f, along - half);
+                coverage = std::max(0.0f, covered) / length;
+            }
+            if (coverage > 0) {
+                float shade = surface(x - middle.x, y - middle.y, radius, turn, level);
+                row[x] = cv::saturate_cast<uchar>(row[x] + (shade - row[x]) * coverage);
+            }
+        }
+    }
+}
+
+scene_generator::scene_generator(const synthetic_rig& rig, uint64_t seed)
+    : rig(rig)
+    , seed(seed)
+    , epoch(capture_clock::now())
+{
+    for (int camera = 0; camera < 2; camera++) {
+        // hot spots stay put from frame to frame, only the noise changes
+        cv::Mat base(rig.frame_size, CV_8UC1, cv::Scalar(0));
+        cv::RNG fixed(mix(seed + 17 * (camera + 1)));
+        for (int i = 0; i < rig.hot_spots; i++) {
+            cv::Point center(fixed.uniform(0, rig.frame_size.width), fixed.uniform(0, rig.frame_size.height));
+            cv::circle(base, center, fixed.uniform(3, 10), cv::Scalar(fixed.uniform(225, 256)), -1);
+        }
+
+        cv::RNG rng(mix(seed + 101 * (camera + 1)));
+        for (int i = 0; i < background_count; i++) {
+            cv::Mat frame(rig.frame_size, CV_8UC1);
+            rng.fill(frame, cv::RNG::NORMAL, cv::Scalar(rig.background), cv::Scalar(rig.noise_sigma));
+            cv::max(frame, base, frame);
+            backgrounds[camera].push_back(frame);
+        }
+    }
+}
+
+cv::Point2f scene_generator::position(const synthetic_shot& shot, double t) const {
+    double dt = t - shot.launch_time;
+    if (dt <= 0) {
+        return cv::Point2f(0, 0);
+    }
+    double speed = shot.speed_mph * inches_per_second_per_mph;
+    double angle = shot.launch_angle_deg * CV_PI / 180.0;
+    double x = speed * std::cos(angle) * dt;
+    double y = speed * std::sin(angle) * dt - 0.5 * gravity_ips2 * dt * dt;
+    return cv::Point2f((float)x, (float)y);
+}
+
+double scene_generator::turn(const synthetic_shot& shot, double t) const {
+    double dt = t - shot.launch_time;
+    if (dt <= 0) {
+        return 0;
+    }
+    // backspin on a ball heading right is counter-clockwise on screen,
+    // decreasing angle with y down
+    return -shot.spin_rpm * 2.0 * CV_PI / 60.0 * dt;
+}
+
+double scene_generator::frame_time(int camera, uint64_t frame_index) const {
+    double phase = camera == 0 ? rig.top_phase : 0.0;
+    return (frame_index + phase) / rig.calibration.frame_rate;
+}
+
+cv::Point2f scene_generator::project(int camera, cv::Point2f inches) const {
+    float ppi = rig.calibration.pixels_per_inch;
+    float downrange = camera == 0 ? inches.x - rig.calibration.distance_between_inches : inches.x;
+    return cv::Point2f(rig.tee.x + downrange * ppi, rig.tee.y - inches.y * ppi);
+}
+
+synthetic_truth scene_generator::truth(int camera, const synthetic_shot& shot, double t) const {
+    synthetic_truth result;
+    result.pixel = project(camera, position(shot, t));
+    result.in_flight = t > shot.launch_time;
+    result.visible = result.pixel.x >= 0 && result.pixel.y >= 0 &&
+                     result.pixel.x < rig.frame_size.width && result.pixel.y < rig.frame_size.height;
+    return result;
+}
+
+void scene_generator::render(int camera, const synthetic_shot& shot, double t, uint64_t frame_index, cv::Mat& out) const {
+    const std::vector<cv::Mat>& bank = backgrounds[camera];
+    bank[frame_hash(seed, camera, frame_index) % bank.size()].copyTo(out);
+
+    double open = 0.5 * rig.exposure / rig.calibration.frame_rate;
+    cv::Point2f from = project(camera, position(shot, t - open));
+    cv::Point2f to = project(camera, position(shot, t + open));
+    draw_ball(out, from, to, rig.ball_radius_px(), rig.ball_level, (float)turn(shot, t));
+}
+
+bool scene_generator::dropped(int camera, uint64_t frame_index) const {
+    if (rig.drop_rate <= 0) {
+        return false;
+    }
+    // a different stream from the noise choice, same inputs
+    double u = (double)(mix(frame_hash(seed, camera, frame_index)) >> 11) / (double)(1ull << 53);
+    return u < rig.drop_rate;
+}
+
+std::vector<synthetic_shot> random_shots(const synthetic_rig& rig, int count, float min_speed, float max_speed,
+                                         float min_angle, float max_angle, float min_spin, float max_spin,
+                                         uint64_t seed) {
+    std::vector<synthetic_shot> shots;
+    shots.reserve(std::max(0, count));
+    cv::RNG rng(mix(seed));
+    for (int i = 0; i < count; i++) {
+        synthetic_shot shot;
+        shot.speed_mph = (float)rng.uniform((double)min_speed, (double)max_speed);
+        shot.launch_angle_deg = (float)rng.uniform((double)min_angle, (double)max_angle);
+        shot.launch_time = (rig.rest_frames + rng.uniform(0.0, 1.0)) / rig.calibration.frame_rate;
+        shot.spin_rpm = (float)rng.uniform((double)min_spin, (double)max_spin);
+        shots.push_back(shot);
+    }
+    return shots;
+}
+
+synthetic_source::synthetic_source(int camera, std::shared_ptr<const scene_generator> generator,
+                                   const std::vector<synthetic_shot>& shots, bool realtime, bool loop)
+    : camera(camera)
+    , generator(generator)
+    , shots(shots)
+    , realtime(realtime)
+    , loop(loop)
+    , opened(false)
+    , index(0)
+    , dropped_frames(0)
+{
+}
+
+bool synthetic_source::open() {
+    if (!generator || shots.empty()) {
+        std::cerr << "synthetic source has no shots to play" << std::endl;
+        return false;
+    }
+    index = 0;
+    dropped_frames = 0;
+    opened = true;
+    return true;
+}
+
+size_t synthetic_source::shot_index(uint64_t sequence) const {
+    return (size_t)((sequence / generator->get_rig().slot_frames) % shots.size());
+}
+
+bool synthetic_source::read(frame_envelope& frame) {
+    if (!opened) {
+        return false;
+    }
+    const synthetic_rig& rig = generator->get_rig();
+    double period = 1.0 / rig.calibration.frame_rate;
+
+    uint64_t i;
+    do {
+        if (!loop && index >= frame_count()) {
+            return false;
+        }
+        i = index++;
+        if (generator->dropped(camera, i)) {
+            dropped_frames++;
+        } else {
+            break;
+        }
+    } while (true);
+
+    // a fresh buffer each time, earlier frames may still be held downstream
+    frame.image = cv::Mat();
+    // a slot starts on a bottom frame; the top camera trails it by its phase
+    double slot_start = (i - i % rig.slot_frames) * period;
+    double time = generator->frame_time(camera, i);
+    generator->render(camera, shots[shot_index(i)], time - slot_start, i, frame.image);
+    frame.format = frame_format::gray;
+    frame.timestamp = generator->get_epoch() + std::chrono::duration_cast<capture_clock::duration>(
+        std::chrono::duration<double>(time));
+    frame.sequence = i;
+    frame.lease.reset();
+
+    if (realtime) {
+        std::this_thread::sleep_until(frame.timestamp);
+    }
+    return true;
+}
+
+std::string synthetic_source::describe() const {
+    return std::string("synthetic ") + (camera == 0 ? "top" : "bottom") + " (seed " +
+           std::to_string(generator ? generator->get_seed() : 0) + ")";
+}
+
+std::unique_ptr<capture_source> make_synthetic_source(const std::string& spec, const capture_settings& settings) {
+    // synthetic:<top|bottom>[:seed]
+    std::string rest = spec.substr(spec.find(':') + 1);
+    std::string which = rest.substr(0, rest.find(':'));
+    uint64_t seed = 1;
+    if (rest.find(':') != std::string::npos) {
+        seed = std::stoull(rest.substr(rest.find(':') + 1));
+    }
+
+    synthetic_rig rig;
+    rig.frame_size = cv::Size(settings.width, settings.height);
+    rig.calibration.frame_rate = (float)settings.fps;
+
+    // both cameras of one seed share a generator, and with it the clock
+    // their timestamps count from
+    static std::mutex lock;
+    static std::map<uint64_t, std::weak_ptr<const scene_generator>> scenes;
+    std::shared_ptr<const scene_generator> generator;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        generator = scenes[seed].lock();
+        if (!generator) {
+            generator = std::make_shared<scene_generator>(rig, seed);
+            scenes[seed] = generator;
+        }
+    }
+    std::vector<synthetic_shot> shots = random_shots(rig, 1000, 20, 80, 5, 30, 2000, 8000, seed);
+    return std::unique_ptr<capture_source>(new synthetic_source(which == "top" ? 0 : 1, generator, shots, settings.realtime));
+}
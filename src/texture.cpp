@@ -0,0 +1,154 @@
+#define GLFW_INCLUDE_GLEXT
+#include "texture.h"
+#include <cstring>
+
+// buffer objects are newer than what gl.h declares, so the entry points come
+// from the context. only ever touched on the ui thread with the context current
+struct gl_buffer_api {
+    PFNGLGENBUFFERSPROC gen_buffers;
+    PFNGLDELETEBUFFERSPROC delete_buffers;
+    PFNGLBINDBUFFERPROC bind_buffer;
+    PFNGLBUFFERDATAPROC buffer_data;
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range;
+    PFNGLUNMAPBUFFERPROC unmap_buffer;
+
+    bool ok() const {
+        return gen_buffers && delete_buffers && bind_buffer && buffer_data && map_buffer_range && unmap_buffer;
+    }
+};
+
+static const gl_buffer_api& buffer_api() {
+    static gl_buffer_api api = []() {
+        gl_buffer_api a;
+        a.gen_buffers = (PFNGLGENBUFFERSPROC)glfwGetProcAddress("glGenBuffers");
+        a.delete_buffers = (PFNGLDELETEBUFFERSPROC)glfwGetProcAddress("glDeleteBuffers");
+        a.bind_buffer = (PFNGLBINDBUFFERPROC)glfwGetProcAddress("glBindBuffer");
+        a.buffer_data = (PFNGLBUFFERDATAPROC)glfwGetProcAddress("glBufferData");
+        a.map_buffer_range = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+        a.unmap_buffer = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+        return a;
+    }();
+    return api;
+}
+
+image_texture::image_texture()
+    : width(0)
+    , height(0)
+    , channels(0)
+    , texture_id(0)
+    , pbo_next(0)
+    , pbo_size(0)
+{
+    pbo[0] = pbo[1] = 0;
+}
+
+image_texture::~image_texture() {
+    if (pbo[0] != 0) {
+        buffer_api().delete_buffers(2, pbo);
+    }
+    if (texture_id != 0) {
+        glDeleteTextures(1, &texture_id);
+    }
+}
+
+void image_texture::allocate(int w, int h, int c) {
+    width = w;
+    height = h;
+    channels = c;
+
+    if (texture_id == 0) {
+        glGenTextures(1, &texture_id);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (c == 1) {
+        // sample the one red channel as gray
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    } else {
+        GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const gl_buffer_api& gl = buffer_api();
+    if (gl.ok()) {
+        if (pbo[0] == 0) {
+            gl.gen_buffers(2, pbo);
+        }
+        pbo_size = (size_t)w * h * c;
+        for (int i = 0; i < 2; i++) {
+            gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+            gl.buffer_data(GL_PIXEL_UNPACK_BUFFER, pbo_size, nullptr, GL_STREAM_DRAW);
+        }
+        gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+void image_texture::upload(const cv::Mat& image) {
+    GLenum format = image.channels() == 1 ? GL_RED : GL_BGR;
+    size_t row = (size_t)width * channels;
+
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    const gl_buffer_api& gl = buffer_api();
+    void* mapped = nullptr;
+    if (pbo[0] != 0) {
+        // alternate buffers so the map never lands on one still being read by
+        // the last transfer, and invalidate so the driver doesn't keep old contents
+        gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo[pbo_next]);
+        pbo_next ^= 1;
+        mapped = gl.map_buffer_range(GL_PIXEL_UNPACK_BUFFER, 0, pbo_size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    if (mapped) {
+        uint8_t* dst = (uint8_t*)mapped;
+        if (image.isContinuous()) {
+            std::memcpy(dst, image.data, pbo_size);
+        } else {
+            for (int y = 0; y < height; y++) {
+                std::memcpy(dst + y * row, image.ptr(y), row);
+            }
+        }
+        gl.unmap_buffer(GL_PIXEL_UNPACK_BUFFER);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, nullptr);
+        gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        // no buffer objects: straight from client memory, padded rows and all
+        if (pbo[0] != 0) {
+            gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(image.step[0] / image.elemSize()));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, image.data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void image_texture::update(const cv::Mat& frame, cv::Size max_size) {
+    if (frame.empty() || frame.depth() != CV_8U || (frame.channels() != 1 && frame.channels() != 3)) {
+        return;
+    }
+
+    const cv::Mat* image = &frame;
+    if (max_size.width > 0 && max_size.height > 0 &&
+        frame.cols > max_size.width && frame.rows > max_size.height) {
+        double scale = std::min((double)max_size.width / frame.cols, (double)max_size.height / frame.rows);
+        cv::Size target(std::max(1, cvRound(frame.cols * scale)), std::max(1, cvRound(frame.rows * scale)));
+        cv::resize(frame, scaled, target, 0, 0, cv::INTER_AREA);
+        image = &scaled;
+    }
+
+    if (texture_id == 0 || image->cols != width || image->rows != height || image->channels() != channels) {
+        allocate(image->cols, image->rows, image->channels());
+    }
+    upload(*image);
+}
@@ -0,0 +1,472 @@
+#include "track.h"
+#include <algorithm>
+#include <cmath>
+
+ball_tracker::ball_tracker(ball_detector& detector, float min_half_size, double max_gap)
+    : detector(detector)
+    , velocity(0, 0)
+    , has_velocity(false)
+    , locked(false)
+    , gate(0, 0, 0, 0)
+    , min_half_size(min_half_size)
+    , max_gap(max_gap)
+    , gated_hits(0)
+    , gated_misses(0)
+    , full_searches(0)
+    , pixels_searched(0)
+    , pixels_total(0)
+{
+}
+
+void ball_tracker::reset() {
+    last = ball_detection();
+    velocity = cv::Point2f(0, 0);
+    has_velocity = false;
+    locked = false;
+    gate = cv::Rect(0, 0, 0, 0);
+}
+
+cv::Rect ball_tracker::predict_gate(const frame_envelope& frame) const {
+    double dt = std::chrono::duration<double>(frame.timestamp - last.timestamp).count();
+    dt = std::max(0.0, std::min(dt, max_gap));
+
+    cv::Point2f predicted = last.position;
+    float travel = 0;
+    if (has_velocity) {
+        predicted += velocity * (float)dt;
+        travel = (float)cv::norm(velocity) * (float)dt;
+    }
+
+    // room for the ball itself, the blur/morph footprint, and a quarter of the
+    // predicted step for speed error
+    float half = std::max(min_half_size, last.radius * 3.0f) + travel * 0.25f;
+    cv::Rect window((int)std::floor(predicted.x - half), (int)std::floor(predicted.y - half),
+                    (int)std::ceil(2 * half), (int)std::ceil(2 * half));
+    return window & cv::Rect(0, 0, frame.image.cols, frame.image.rows);
+}
+
+void ball_tracker::update(const ball_detection& detection, bool from_gate) {
+    if (last.found) {
+        double dt = std::chrono::duration<double>(detection.timestamp - last.timestamp).count();
+        if (dt > 0 && dt <= max_gap) {
+            cv::Point2f measured = (detection.position - last.position) * (float)(1.0 / dt);
+            // smooth while the gate keeps hitting, take the raw step on (re)acquire
+            velocity = (has_velocity && from_gate) ? (velocity + measured) * 0.5f : measured;
+            has_velocity = true;
+        } else {
+            velocity = cv::Point2f(0, 0);
+            has_velocity = false;
+        }
+    }
+    last = detection;
+    locked = true;
+}
+
+ball_detection ball_tracker::track(const frame_envelope& frame) {
+    ball_detection result;
+    if (frame.empty()) {
+        return result;
+    }
+    pixels_total += (uint64_t)frame.image.total();
+
+    if (locked) {
+        gate = predict_gate(frame);
+        if (gate.area() > 0) {
+            pixels_searched += (uint64_t)gate.area();
+            result = detector.find_ball(frame, gate);
+            if (result.found) {
+                gated_hits++;
+                update(result, true);
+                return result;
+            }
+        }
+        gated_misses++;
+    }
+
+    // lost or never had it: search everywhere the detector is allowed to look
+    full_searches++;
+    pixels_searched += (uint64_t)frame.image.total();
+    gate = cv::Rect(0, 0, 0, 0);
+    result = detector.find_ball(frame);
+    if (result.found) {
+        update(result, false);
+    } else {
+        // keep the last detection around for a velocity if it comes back soon
+        locked = false;
+    }
+    return result;
+}
+
+void ball_tracker::observe(const ball_detection& detection) {
+    if (detection.found) {
+        update(detection, false);
+    } else {
+        locked = false;
+    }
+}
+
+track_manager::track_manager(size_t max_points)
+    : max_points(max_points)
+    , gate_radii(3.0f)
+    , gate_travel(0.5f)
+    , max_jump(400000.0f)
+    , max_misses(3)
+    , min_speed(2000.0f)
+    , gate_margin(16.0f)
+    , full_search_interval(4)
+{
+    for (auto& t : tracks) {
+        t.points.reserve(max_points);
+    }
+}
+
+void track_manager::reset() {
+    for (auto& t : tracks) {
+        t.points.clear();
+        t.velocity = cv::Point2f(0, 0);
+        t.radius = 0;
+        t.misses = 0;
+        t.alive = false;
+    }
+}
+
+int track_manager::free_slot() const {
+    int weakest = -1;
+    float weakest_score = 0;
+    for (int i = 0; i < max_tracks; i++) {
+        if (tracks[i].alive) {
+            continue;
+        }
+        if (tracks[i].points.empty()) {
+            return i;
+        }
+        // finished tracks are kept to be chosen from; give up the least ball-like
+        float s = score(i);
+        if (weakest < 0 || s < weakest_score) {
+            weakest = i;
+            weakest_score = s;
+        }
+    }
+    return weakest;
+}
+
+void track_manager::predict(const candidate_track& t, capture_clock::time_point at,
+                            cv::Point2f& position, float& gate) const {
+    const ball_detection& last = t.points.back();
+    float dt = (float)std::chrono::duration<double>(at - last.timestamp).count();
+    dt = std::max(0.0f, dt);
+    position = last.position;
+    gate = gate_radii * t.radius;
+    if (t.points.size() > 1) {
+        position += t.velocity * dt;
+        gate += gate_travel * (float)cv::norm(t.velocity) * dt;
+    } else {
+        gate += max_jump * dt;
+    }
+}
+
+struct track_match {
+    float cost;
+    int track;
+    int candidate;
+};
+
+void track_manager::update(const candidate_list& candidates) {
+    // every plausible pairing, then the cheapest first so that one track
+    // grabbing a nearby candidate can't steal the ball from another
+    track_match matches[max_tracks * candidate_list::capacity];
+    int match_count = 0;
+    const float max_ratio = std::log(2.0f);
+    for (int i = 0; i < max_tracks; i++) {
+        const candidate_track& t = tracks[i];
+        if (!t.alive) {
+            continue;
+        }
+        cv::Point2f predicted;
+        float gate;
+        predict(t, candidates.timestamp, predicted, gate);
+        for (int c = 0; c < candidates.count; c++) {
+            const ball_candidate& candidate = candidates.items[c];
+            float distance = (float)cv::norm(candidate.position - predicted);
+            float ratio = std::fabs(std::log(std::max(candidate.radius, 1.0f) / std::max(t.radius, 1.0f)));
+            if (distance > gate || ratio > max_ratio) {
+                continue;
+            }
+            track_match m = { distance / gate + ratio, i, c };
+            matches[match_count++] = m;
+        }
+    }
+    std::sort(matches, matches + match_count, [](const track_match& a, const track_match& b) { return a.cost < b.cost; });
+
+    bool track_taken[max_tracks] = {};
+    bool candidate_taken[candidate_list::capacity] = {};
+    for (int m = 0; m < match_count; m++) {
+        const track_match& match = matches[m];
+        if (track_taken[match.track] || candidate_taken[match.candidate]) {
+            continue;
+        }
+        track_taken[match.track] = true;
+        candidate_taken[match.candidate] = true;
+
+        candidate_track& t = tracks[match.track];
+        ball_detection d = candidates.detection(match.candidate);
+        const ball_detection& last = t.points.back();
+        double dt = std::chrono::duration<double>(d.timestamp - last.timestamp).count();
+        if (dt > 0) {
+            t.velocity = (d.position - last.position) * (float)(1.0 / dt);
+        }
+        if (t.points.size() < max_points) {
+            t.points.push_back(d);
+        }
+        t.radius += (d.radius - t.radius) / (float)t.points.size();
+        t.misses = 0;
+    }
+
+    for (int i = 0; i < max_tracks; i++) {
+        if (tracks[i].alive && !track_taken[i] && ++tracks[i].misses > max_misses) {
+            tracks[i].alive = false;
+        }
+    }
+
+    for (int c = 0; c < candidates.count; c++) {
+        if (candidate_taken[c]) {
+            continue;
+        }
+        int slot = free_slot();
+        if (slot < 0) {
+            break;
+        }
+        candidate_track& t = tracks[slot];
+        t.points.clear();
+        t.points.push_back(candidates.detection(c));
+        t.velocity = cv::Point2f(0, 0);
+        t.radius = candidates.items[c].radius;
+        t.misses = 0;
+        t.alive = true;
+    }
+}
+
+// a point's time centred on the span and in units of it, so the normal
+// equations stay well conditioned
+static double span_time(const ball_detection& p, const ball_detection& first, double span) {
+    return std::chrono::duration<double>(p.timestamp - first.timestamp).count() / span - 0.5;
+}
+
+// sum of squared residuals of the best a + b t + c t^2 through x and through y
+// of points[0, n), with t from span_time; straight off the points, no scratch
+static double quadratic_residual(const ball_detection* points, size_t n, double span) {
+    double s[5] = {}, rx[3] = {}, ry[3] = {};
+    for (size_t i = 0; i < n; i++) {
+        double t = span_time(points[i], points[0], span);
+        double p = 1;
+        for (int k = 0; k < 5; k++) {
+            s[k] += p;
+            if (k < 3) {
+                rx[k] += p * points[i].position.x;
+                ry[k] += p * points[i].position.y;
+            }
+            p *= t;
+        }
+    }
+    // normal equations by cramer's rule; 3x3 is cheaper written out
+    auto det3 = [](double a, double b, double c, double d, double e, double f, double g, double h, double i) {
+        return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+    };
+    double det = det3(s[0], s[1], s[2], s[1], s[2], s[3], s[2], s[3], s[4]);
+    if (std::fabs(det) < 1e-12) {
+        return 0;
+    }
+    double coeff[2][3];
+    const double* r[2] = { rx, ry };
+    for (int v = 0; v < 2; v++) {
+        coeff[v][0] = det3(r[v][0], s[1], s[2], r[v][1], s[2], s[3], r[v][2], s[3], s[4]) / det;
+        coeff[v][1] = det3(s[0], r[v][0], s[2], s[1], r[v][1], s[3], s[2], r[v][2], s[4]) / det;
+        coeff[v][2] = det3(s[0], s[1], r[v][0], s[1], s[2], r[v][1], s[2], s[3], r[v][2]) / det;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        double t = span_time(points[i], points[0], span);
+        double ex = points[i].position.x - (coeff[0][0] + coeff[0][1] * t + coeff[0][2] * t * t);
+        double ey = points[i].position.y - (coeff[1][0] + coeff[1][1] * t + coeff[1][2] * t * t);
+        sum += ex * ex + ey * ey;
+    }
+    return sum;
+}
+
+// px/s between two points of a track
+static cv::Point2f step_velocity(const ball_detection& a, const ball_detection& b) {
+    double dt = std::chrono::duration<double>(b.timestamp - a.timestamp).count();
+    return dt > 0 ? (b.position - a.position) * (float)(1.0 / dt) : cv::Point2f(0, 0);
+}
+
+size_t track_manager::flight_start(int index) const {
+    const std::vector<ball_detection>& points = tracks[index].points;
+    size_t start = 0;
+    while (start + 1 < points.size() && cv::norm(step_velocity(points[start], points[start + 1])) < min_speed) {
+        start++;
+    }
+    if (start + 1 >= points.size()) {
+        return 0;
+    }
+    // points[start] is the last one before the track moved, so it's the ball
+    // at rest, unless the track was born in flight: then its first step
+    // already matches the next one in speed and direction. a partial first
+    // step (the ball left part way through the frame interval) doesn't
+    if (start == 0 && points.size() > 2) {
+        cv::Point2f first = step_velocity(points[0], points[1]);
+        cv::Point2f second = step_velocity(points[1], points[2]);
+        float speed = (float)std::max(cv::norm(first), cv::norm(second));
+        if (cv::norm(second - first) <= 0.25f * speed) {
+            return 0;
+        }
+    }
+    return start + 1;
+}
+
+float track_manager::score(int index) const {
+    const candidate_track& t = tracks[index];
+    size_t start = flight_start(index);
+    size_t n = t.points.size() - start;
+    // two points are a line through anything
+    if (n < 3) {
+        return 0;
+    }
+    const ball_detection& first = t.points[start];
+    const ball_detection& last = t.points.back();
+    double span = std::chrono::duration<double>(last.timestamp - first.timestamp).count();
+    if (span <= 0 || cv::norm(last.position - first.position) / span < min_speed) {
+        return 0;
+    }
+
+    double circularity = 0;
+    float small = first.radius, large = first.radius;
+    for (size_t i = 0; i < n; i++) {
+        const ball_detection& p = t.points[start + i];
+        circularity += std::min(1.0f, p.circularity);
+        small = std::min(small, p.radius);
+        large = std::max(large, p.radius);
+    }
+    circularity /= n;
+    float steady = large > 0 ? small / large : 0.0f;
+
+    // off a constant-acceleration path by a fraction of the ball's own size
+    // is detection noise; by more is something else, or two things
+    double rms = n > 3 ? std::sqrt(quadratic_residual(&t.points[start], n, span) / (n - 3)) : 0.0;
+    double off = rms / std::max(1.0f, t.radius);
+    float smooth = (float)(1.0 / (1.0 + 4.0 * off * off));
+
+    return n * circularity * steady * smooth;
+}
+
+int track_manager::best() const {
+    int best_index = -1;
+    float best_score = 0;
+    for (int i = 0; i < max_tracks; i++) {
+        float s = score(i);
+        if (s > best_score) {
+            best_score = s;
+            best_index = i;
+        }
+    }
+    return best_index;
+}
+
+bool track_manager::choose(const std::vector<candidate_list>& frames, size_t count,
+                           std::vector<ball_detection>& detections) const {
+    int index = best();
+    if (index < 0) {
+        return false;
+    }
+    const std::vector<ball_detection>& points = tracks[index].points;
+    size_t next = flight_start(index);
+    detections.assign(count, ball_detection());
+    for (size_t i = 0; i < count && i < frames.size(); i++) {
+        // the frame a point came from, by time and sequence since sequences
+        // restart with a camera
+        while (next < points.size() && points[next].timestamp < frames[i].timestamp) {
+            next++;
+        }
+        if (next < points.size() && points[next].timestamp == frames[i].timestamp &&
+            points[next].sequence == frames[i].sequence) {
+            detections[i] = points[next++];
+        }
+    }
+    return true;
+}
+
+int track_manager::live_tracks() const {
+    int count = 0;
+    for (const auto& t : tracks) {
+        if (t.alive) count++;
+    }
+    return count;
+}
+
+int track_manager::gates(capture_clock::time_point at, cv::Rect bounds, cv::Rect* windows) const {
+    int count = 0;
+    for (const auto& t : tracks) {
+        if (!t.alive || t.points.size() < 2) {
+            continue;
+        }
+        cv::Point2f predicted;
+        float gate;
+        predict(t, at, predicted, gate);
+        // a matching candidate may be twice the track's radius
+        float half = gate + 2.0f * t.radius + gate_margin;
+        cv::Rect window((int)std::floor(predicted.x - half), (int)std::floor(predicted.y - half),
+                        (int)std::ceil(2 * half), (int)std::ceil(2 * half));
+        window &= bounds;
+        if (window.area() <= 0) {
+            continue;
+        }
+        // a merged window can reach ones it missed before, so start over
+        for (int i = 0; i < count;) {
+            if ((window & windows[i]).area() > 0) {
+                window |= windows[i];
+                windows[i] = windows[--count];
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+        windows[count++] = window;
+    }
+    return count;
+}
+
+bool track_manager::needs_full_search(size_t index) const {
+    if (index % full_search_interval == 0) {
+        return true;
+    }
+    for (const auto& t : tracks) {
+        if (!t.alive) continue;
+        if (t.points.size() == 1 ? t.misses == 0 : t.misses == 1 && cv::norm(t.velocity) < min_speed) return true;
+    }
+    return false;
+}
+
+ball_detection track_manager::search(ball_detector& detector, const frame_envelope& frame, size_t index,
+                                     candidate_list& candidates, uint64_t& searched) const {
+    cv::Rect bounds(0, 0, frame.image.cols, frame.image.rows);
+    if (detector.is_using_roi()) {
+        bounds &= detector.get_roi();
+    }
+    cv::Rect windows[max_tracks];
+    int count = frame.empty() || needs_full_search(index) ? 0 : gates(frame.timestamp, bounds, windows);
+    if (count == 0) {
+        searched += (uint64_t)bounds.area();
+        return detector.find_candidates(frame, candidates);
+    }
+    candidates.clear();
+    candidates.timestamp = frame.timestamp;
+    candidates.sequence = frame.sequence;
+    candidate_list gated;
+    for (int i = 0; i < count; i++) {
+        searched += (uint64_t)windows[i].area();
+        detector.find_candidates(frame, gated, windows[i]);
+        for (int c = 0; c < gated.count; c++) {
+            candidates.offer(gated.items[c]);
+        }
+    }
+    return candidates.detection(0);
+}
@@ -0,0 +1,78 @@
+#include "trigger.h"
+#include <algorithm>
+
+trigger_detector::trigger_detector(int block_size, float diff_threshold, int min_blocks)
+    : block_size(block_size)
+    , diff_threshold(diff_threshold)
+    , min_blocks(min_blocks)
+    , adapt_rate(0.05f)
+    , armed(false)
+    , live(true)
+    , region(0, 0, 0, 0)
+    , frames(0)
+    , fires(0)
+    , total_us(0)
+    , last_changed(0)
+    , last_latency_ms(0)
+{
+}
+
+void trigger_detector::arm(cv::Rect r) {
+    region = r;
+    reference.release();
+    armed = r.width > 0 && r.height > 0;
+}
+
+void trigger_detector::disarm() {
+    armed = false;
+    reference.release();
+}
+
+bool trigger_detector::update(const frame_envelope& frame) {
+    if (!armed || frame.empty()) {
+        return false;
+    }
+    capture_clock::time_point start = capture_clock::now();
+
+    cv::Rect r = region & cv::Rect(0, 0, frame.image.cols, frame.image.rows);
+    if (r.width < block_size || r.height < block_size) {
+        return false;
+    }
+
+    // area resampling by an integer factor is an exact block mean
+    cv::Size bins(r.width / block_size, r.height / block_size);
+    cv::resize(frame.image(cv::Rect(r.x, r.y, bins.width * block_size, bins.height * block_size)),
+               binned, bins, 0, 0, cv::INTER_AREA);
+
+    bool fired = false;
+    if (reference.empty() || reference.size() != bins) {
+        binned.convertTo(reference, CV_32F);
+        last_changed = 0;
+    } else {
+        binned.convertTo(binned_f, CV_32F);
+        cv::absdiff(binned_f, reference, diff);
+        cv::compare(diff, diff_threshold, changed, cv::CMP_GT);
+        last_changed = cv::countNonZero(changed);
+        fired = last_changed >= min_blocks;
+        if (!fired) {
+            cv::accumulateWeighted(binned, reference, adapt_rate);
+        }
+    }
+
+    frames++;
+    if (fired) {
+        fires++;
+    }
+    total_us += std::chrono::duration<double, std::micro>(capture_clock::now() - start).count();
+    return fired;
+}
+
+void trigger_detector::mark_triggered(const frame_envelope& frame) {
+    // a replayed or generated frame is stamped on its own clock, and now()
+    // minus that is just how long ago it was recorded
+    if (!live) {
+        last_latency_ms = 0;
+        return;
+    }
+    last_latency_ms = std::chrono::duration<double, std::milli>(capture_clock::now() - frame.timestamp).count();
+}
@@ -0,0 +1,272 @@
+#include "capture.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+// owns the fd and the mappings. leases handed out with frames hold a
+// reference, so the buffers stay mapped until the last frame is gone even if
+// the source itself is closed first.
+struct v4l2_stream {
+    struct mapped_buffer {
+        void* start;
+        size_t length;
+    };
+
+    int fd;
+    std::atomic<bool> streaming;
+    uint32_t pixel_format;
+    int width;
+    int height;
+    int bytes_per_line;
+    std::vector<mapped_buffer> buffers;
+    std::mutex lock;
+
+    v4l2_stream()
+        : fd(-1)
+        , streaming(false)
+        , pixel_format(0)
+        , width(0)
+        , height(0)
+        , bytes_per_line(0)
+    {}
+
+    ~v4l2_stream() {
+        stop();
+        for (const auto& b : buffers) {
+            munmap(b.start, b.length);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!streaming) {
+            return;
+        }
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd, VIDIOC_STREAMOFF, &type);
+        streaming = false;
+    }
+
+    void requeue(uint32_t index) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!streaming) {
+            return;
+        }
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+        if (xioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+            std::cerr << "VIDIOC_QBUF failed: " << strerror(errno) << std::endl;
+        }
+    }
+};
+
+v4l2_source::v4l2_source(const std::string& device, const capture_settings& settings)
+    : device(device)
+    , settings(settings)
+    , have_sequence(false)
+    , last_sequence(0)
+    , dropped_frames(0)
+{
+}
+
+v4l2_source::~v4l2_source() {
+    if (stream) {
+        stream->stop();
+    }
+}
+
+bool v4l2_source::is_open() const {
+    return stream && stream->streaming;
+}
+
+bool v4l2_source::open() {
+    std::shared_ptr<v4l2_stream> s = std::make_shared<v4l2_stream>();
+
+    s->fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (s->fd < 0) {
+        std::cerr << "failed to open " << device << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(s->fd, VIDIOC_QUERYCAP, &cap) < 0
+        || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)
+        || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        std::cerr << device << " is not a streaming capture device" << std::endl;
+        return false;
+    }
+
+    // ask for mjpeg like the opencv path; the driver may hand back grey or yuyv
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = settings.width;
+    fmt.fmt.pix.height = settings.height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(s->fd, VIDIOC_S_FMT, &fmt) < 0) {
+        std::cerr << device << " VIDIOC_S_FMT failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    s->pixel_format = fmt.fmt.pix.pixelformat;
+    s->width = fmt.fmt.pix.width;
+    s->height = fmt.fmt.pix.height;
+    s->bytes_per_line = fmt.fmt.pix.bytesperline;
+
+    if (s->pixel_format != V4L2_PIX_FMT_MJPEG
+        && s->pixel_format != V4L2_PIX_FMT_GREY
+        && s->pixel_format != V4L2_PIX_FMT_YUYV) {
+        std::cerr << device << " unsupported pixel format" << std::endl;
+        return false;
+    }
+
+    v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = settings.fps;
+    xioctl(s->fd, VIDIOC_S_PARM, &parm);
+
+    v4l2_control ctrl;
+    ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+    ctrl.value = V4L2_EXPOSURE_MANUAL;
+    xioctl(s->fd, VIDIOC_S_CTRL, &ctrl);
+
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = settings.buffer_count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(s->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        std::cerr << device << " VIDIOC_REQBUFS failed" << std::endl;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < req.count; i++) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(s->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            std::cerr << device << " VIDIOC_QUERYBUF failed" << std::endl;
+            return false;
+        }
+
+        void* start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, buf.m.offset);
+        if (start == MAP_FAILED) {
+            std::cerr << device << " mmap failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        s->buffers.push_back({start, buf.length});
+
+        if (xioctl(s->fd, VIDIOC_QBUF, &buf) < 0) {
+            std::cerr << device << " VIDIOC_QBUF failed" << std::endl;
+            return false;
+        }
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(s->fd, VIDIOC_STREAMON, &type) < 0) {
+        std::cerr << device << " VIDIOC_STREAMON failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    s->streaming = true;
+
+    stream = s;
+    have_sequence = false;
+    std::cout << device << ": " << s->width << "x" << s->height << " "
+              << s->buffers.size() << " buffers" << std::endl;
+    return true;
+}
+
+bool v4l2_source::read(frame_envelope& frame) {
+    if (!is_open()) {
+        return false;
+    }
+
+    pollfd pfd;
+    pfd.fd = stream->fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100) <= 0) {
+        return false;
+    }
+
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(stream->fd, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno != EAGAIN) {
+            std::cerr << device << " VIDIOC_DQBUF failed: " << strerror(errno) << std::endl;
+        }
+        return false;
+    }
+
+    // the driver counts every frame it produced, so gaps are frames it had
+    // nowhere to put because all buffers were still held downstream. only
+    // counted: a log write here would stall the next dequeue, and dropped()
+    // already reaches the ui and the headless stats line
+    if (have_sequence && buf.sequence > last_sequence + 1) {
+        dropped_frames += buf.sequence - last_sequence - 1;
+    }
+    have_sequence = true;
+    last_sequence = buf.sequence;
+
+    if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+        stream->requeue(buf.index);
+        return false;
+    }
+
+    void* data = stream->buffers[buf.index].start;
+    switch (stream->pixel_format) {
+    case V4L2_PIX_FMT_GREY:
+        frame.image = cv::Mat(stream->height, stream->width, CV_8UC1, data, stream->bytes_per_line);
+        frame.format = frame_format::gray;
+        break;
+    case V4L2_PIX_FMT_YUYV:
+        frame.image = cv::Mat(stream->height, stream->width, CV_8UC2, data, stream->bytes_per_line);
+        frame.format = frame_format::yuyv;
+        break;
+    default:
+        frame.image = cv::Mat(1, buf.bytesused, CV_8UC1, data);
+        frame.format = frame_format::mjpeg;
+        break;
+    }
+
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        frame.timestamp = capture_clock::time_point(
+            std::chrono::seconds(buf.timestamp.tv_sec) + std::chrono::microseconds(buf.timestamp.tv_usec));
+    } else {
+        frame.timestamp = capture_clock::now();
+    }
+    frame.sequence = buf.sequence;
+
+    std::shared_ptr<v4l2_stream> s = stream;
+    uint32_t index = buf.index;
+    frame.lease = std::shared_ptr<void>(nullptr, [s, index](void*) { s->requeue(index); });
+    return true;
+}
@@ -0,0 +1,42 @@
+#include "worker_pool.h"
+
+worker_pool::worker_pool(size_t threads)
+    : stopping(false)
+{
+    if (threads == 0) {
+        size_t cores = std::thread::hardware_concurrency();
+        threads = cores > 3 ? cores - 2 : 1;
+    }
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&worker_pool::run, this);
+    }
+}
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void worker_pool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !tasks.empty(); });
+            // queued work still finishes so no future is left broken
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}